@@ -0,0 +1,124 @@
+// Compares the two sample publish paths against a live broker:
+//   mosquitto - mosquittopp::publish with libmosquitto's network thread (payload copied into its packet)
+//   native    - NativeMqttPublisher, header + topic + sample memory in one sendmsg()
+//
+// Usage: mqtt_publish_bench [host] [port] [block_bytes] [blocks]
+// Reports wall time, process CPU time and throughput for each path (QoS 0).
+#include <mosquittopp.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ctime>
+
+#include "logger.h"
+#include "native_mqtt_publisher.h"
+
+namespace {
+
+const char* kTopic = "bench/hackrf_mqtt/iq";
+
+double process_cpu_seconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+struct Result {
+    double wall_s = 0.0;
+    double cpu_s = 0.0;
+};
+
+void report(const char* path, const Result& result, size_t block_bytes, size_t blocks) {
+    double mbytes = static_cast<double>(block_bytes) * static_cast<double>(blocks) / 1e6;
+    std::printf("%-10s wall %8.3f s  cpu %8.3f s  %9.1f MB/s  %7.3f cpu-ms/MB\n",
+                path, result.wall_s, result.cpu_s, mbytes / result.wall_s, 1000.0 * result.cpu_s / mbytes);
+}
+
+class BenchClient : public mosqpp::mosquittopp {
+public:
+    explicit BenchClient(const char* id) : mosqpp::mosquittopp(id, true) {}
+    std::atomic<bool> connected{false};
+    std::atomic<int> acked_mid{-1};
+    void on_connect(int rc) override { connected = (rc == 0); }
+    void on_publish(int mid) override { acked_mid = mid; }
+};
+
+bool run_mosquitto(const std::string& host, int port, const std::vector<unsigned char>& block, size_t blocks, Result& result) {
+    BenchClient client("hackrf_mqtt_bench_mosq");
+    client.loop_start();
+    if (client.connect_async(host.c_str(), port, 60) != MOSQ_ERR_SUCCESS) return false;
+    for (int i = 0; i < 50 && !client.connected; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (!client.connected) return false;
+
+    double cpu_start = process_cpu_seconds();
+    auto wall_start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < blocks; ++i) {
+        client.publish(nullptr, kTopic, static_cast<int>(block.size()), block.data(), 0, false);
+    }
+    // A QoS 1 sentinel is acknowledged only after everything queued before it went out.
+    int sentinel = 0;
+    client.publish(&sentinel, kTopic, 1, block.data(), 1, false);
+    while (client.acked_mid.load() != sentinel) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    result.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    result.cpu_s = process_cpu_seconds() - cpu_start;
+
+    client.disconnect();
+    client.loop_stop(true);
+    return true;
+}
+
+bool run_native(const std::string& host, int port, const std::vector<unsigned char>& block, size_t blocks, Result& result) {
+    hackrf_mqtt::NativeMqttPublisher::Options options;
+    options.host = host;
+    options.port = port;
+    options.client_id = "hackrf_mqtt_bench_native";
+    hackrf_mqtt::NativeMqttPublisher publisher(options);
+    if (!publisher.connect()) return false;
+    hackrf_mqtt::NativeMqttPublisher::Topic topic = publisher.prepare_topic(kTopic);
+
+    double cpu_start = process_cpu_seconds();
+    auto wall_start = std::chrono::steady_clock::now();
+    iovec part{const_cast<unsigned char*>(block.data()), block.size()};
+    for (size_t i = 0; i < blocks; ++i) {
+        if (!publisher.publish(topic, &part, 1)) return false;
+    }
+    result.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    result.cpu_s = process_cpu_seconds() - cpu_start;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string host = argc > 1 ? argv[1] : "localhost";
+    int port = argc > 2 ? std::atoi(argv[2]) : 1883;
+    size_t block_bytes = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 262144;
+    size_t blocks = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 2000;
+
+    hackrf_mqtt::logger::init(hackrf_mqtt::logger::LogLevel::WARNING);
+    mosqpp::lib_init();
+
+    std::vector<unsigned char> block(block_bytes);
+    for (size_t i = 0; i < block.size(); ++i) block[i] = static_cast<unsigned char>(i * 31);
+
+    std::printf("%zu blocks of %zu bytes to %s:%d\n", blocks, block_bytes, host.c_str(), port);
+    Result mosq_result, native_result;
+    if (run_mosquitto(host, port, block, blocks, mosq_result)) {
+        report("mosquitto", mosq_result, block_bytes, blocks);
+    } else {
+        std::printf("mosquitto  failed to connect\n");
+    }
+    if (run_native(host, port, block, blocks, native_result)) {
+        report("native", native_result, block_bytes, blocks);
+    } else {
+        std::printf("native     failed\n");
+    }
+
+    mosqpp::lib_cleanup();
+    return 0;
+}
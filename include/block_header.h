@@ -0,0 +1,87 @@
+#ifndef BLOCK_HEADER_H
+#define BLOCK_HEADER_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "sample_block.h"
+
+namespace hackrf_mqtt {
+
+// Optional binary header prepended to each published block (mqtt.block_header = true),
+// so consumers can tell the sample format, detect gaps and restore order across
+// sharded connections without a side channel.
+//
+// 40 bytes, all fields little-endian:
+//    0  char[4]  magic "HRFB"
+//    4  uint8    version (2)
+//    5  uint8    SampleFormat
+//    6  uint16   flags (SampleBlock::flags: bit 0 discontinuity, bit 1 settling)
+//    8  uint64   sequence
+//   16  uint64   capture_time_ns (CLOCK_MONOTONIC of the capturing host)
+//   24  uint32   payload bytes following the header
+//   28  uint32   channel (SampleBlock::channel)
+//   32  uint64   center_frequency_hz (0 = unknown)
+// Version 1 headers were 32 bytes: the same layout without center_frequency_hz.
+constexpr size_t kBlockHeaderSize = 40;
+constexpr size_t kBlockHeaderSizeV1 = 32;
+constexpr uint8_t kBlockHeaderVersion = 2;
+
+struct BlockHeaderInfo {
+    uint8_t version = 0;
+    SampleFormat format = SampleFormat::INT8_IQ;
+    uint16_t flags = 0;
+    uint64_t sequence = 0;
+    uint64_t capture_time_ns = 0;
+    uint32_t payload_bytes = 0;
+    uint32_t channel = 0;
+    uint64_t center_frequency_hz = 0;
+    size_t header_bytes = 0; // Where the payload starts
+};
+
+namespace detail {
+inline void put_le(unsigned char* out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) out[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+inline uint64_t get_le(const unsigned char* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    return value;
+}
+} // namespace detail
+
+inline void encode_block_header(const SampleBlock& block, unsigned char* out) {
+    out[0] = 'H'; out[1] = 'R'; out[2] = 'F'; out[3] = 'B';
+    out[4] = kBlockHeaderVersion;
+    out[5] = static_cast<uint8_t>(block.format);
+    detail::put_le(out + 6, block.flags, 2);
+    detail::put_le(out + 8, block.sequence, 8);
+    detail::put_le(out + 16, block.capture_time_ns, 8);
+    detail::put_le(out + 24, block.data.size(), 4);
+    detail::put_le(out + 28, block.channel, 4);
+    detail::put_le(out + 32, block.center_frequency_hz, 8);
+}
+
+// Accepts versions 1 and 2. False if the buffer is too short or does not start with the magic.
+inline bool decode_block_header(const unsigned char* in, size_t len, BlockHeaderInfo& out) {
+    if (len < kBlockHeaderSizeV1 || in[0] != 'H' || in[1] != 'R' || in[2] != 'F' || in[3] != 'B') {
+        return false;
+    }
+    out.version = in[4];
+    out.header_bytes = out.version >= 2 ? kBlockHeaderSize : kBlockHeaderSizeV1;
+    if (len < out.header_bytes) {
+        return false;
+    }
+    out.format = static_cast<SampleFormat>(in[5]);
+    out.flags = static_cast<uint16_t>(detail::get_le(in + 6, 2));
+    out.sequence = detail::get_le(in + 8, 8);
+    out.capture_time_ns = detail::get_le(in + 16, 8);
+    out.payload_bytes = static_cast<uint32_t>(detail::get_le(in + 24, 4));
+    out.channel = static_cast<uint32_t>(detail::get_le(in + 28, 4));
+    out.center_frequency_hz = out.version >= 2 ? detail::get_le(in + 32, 8) : 0;
+    return true;
+}
+
+} // namespace hackrf_mqtt
+
+#endif // BLOCK_HEADER_H
@@ -0,0 +1,103 @@
+#ifndef DEVICE_COMMAND_EXECUTOR_H
+#define DEVICE_COMMAND_EXECUTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace hackrf_mqtt {
+
+// Single thread that owns all HackRF control operations (start/stop RX, retunes).
+// USB control transfers take milliseconds to tens of milliseconds; running them
+// here keeps them off libmosquitto's network threads and serializes them, so two
+// commands never touch the device at once.
+//
+// A submitted command carries a coalesce key. If a command with the same key is
+// still queued, it is replaced by the newer one and completed as superseded
+// (e.g. ten queued retunes run once, with the last frequency).
+class DeviceCommandExecutor {
+public:
+    struct Result {
+        bool ok = true;
+        std::string message;
+    };
+    using Action = std::function<Result()>;
+
+    struct Completion {
+        std::string command;      // Name given to submit()
+        std::string request_id;   // Echoed back to the requester; may be empty
+        bool ok = false;
+        bool superseded = false;  // Replaced by a newer command with the same key; never ran
+        std::string message;
+        uint64_t queue_wait_ns = 0; // Submit to start of execution
+        uint64_t run_ns = 0;        // Execution time of the action
+        bool report = true;         // False for internal commands (e.g. scan hops) nobody waits on
+    };
+    // Runs on the executor thread (or the submitting thread for rejected commands).
+    using CompletionFn = std::function<void(const Completion&)>;
+
+    explicit DeviceCommandExecutor(CompletionFn on_complete = nullptr);
+    ~DeviceCommandExecutor();
+
+    DeviceCommandExecutor(const DeviceCommandExecutor&) = delete;
+    DeviceCommandExecutor& operator=(const DeviceCommandExecutor&) = delete;
+
+    void start();
+    // Runs every command already queued, then joins the thread.
+    void stop();
+
+    // Thread-safe and non-blocking. An empty coalesce_key never coalesces.
+    // `report` is passed through to the Completion.
+    void submit(std::string command, std::string coalesce_key, Action action, std::string request_id = "",
+                bool report = true);
+
+    struct Stats {
+        uint64_t submitted = 0;
+        uint64_t executed = 0;
+        uint64_t coalesced = 0;
+        uint64_t failed = 0;
+        uint64_t total_run_ns = 0;
+        uint64_t max_queue_wait_ns = 0;
+    };
+    Stats stats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending {
+        std::string command;
+        std::string coalesce_key;
+        std::string request_id;
+        Action action;
+        Clock::time_point submitted;
+        bool report = true;
+    };
+
+    void run();
+    void complete(const Completion& completion);
+
+    CompletionFn on_complete_;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Pending> pending_;
+    bool running_ = false;
+    bool stopping_ = false;
+
+    std::atomic<uint64_t> submitted_{0};
+    std::atomic<uint64_t> executed_{0};
+    std::atomic<uint64_t> coalesced_{0};
+    std::atomic<uint64_t> failed_{0};
+    std::atomic<uint64_t> total_run_ns_{0};
+    std::atomic<uint64_t> max_queue_wait_ns_{0};
+};
+
+} // namespace hackrf_mqtt
+
+#endif // DEVICE_COMMAND_EXECUTOR_H
@@ -0,0 +1,143 @@
+#ifndef DEVICE_SESSION_H
+#define DEVICE_SESSION_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "config_model.h"
+#include "device_command_executor.h"
+#include "hackrf_handler.h"
+#include "pipeline.h"
+#include "scan_scheduler.h"
+
+namespace hackrf_mqtt {
+
+class HackRFSourceStage;
+class HackRFSweepSourceStage;
+
+// Writes `target` as one HackRFHandler::apply_config transaction and brackets it for the
+// source: the settle window opens before the first write and always closes again, as a
+// change if anything was applied and cancelled if the first write failed.
+HackRFHandler::ApplyResult apply_live_settings(HackRFHandler& handler, HackRFSourceStage& source,
+                                               const HackRFConfig& target, HackRFConfig& current,
+                                               uint64_t requested_ns);
+
+// Everything one HackRF needs: its handler, pipeline (and so its queues and threads),
+// command executor, applied settings and optional scanner. Devices share only the
+// MQTT connections, so a slow USB bus or a busy pipeline on one device does not
+// hold up another.
+class DeviceSession {
+public:
+    // Stall and recovery events ({"device", "event", ...}) for the status topic.
+    using EventFn = std::function<void(const nlohmann::json& event)>;
+
+    // `app` supplies the shared sections (mqtt, recovery, data_queue_*); the device's own
+    // sections come from `device`. With `multi_device`, stats lines and MQTT client ids carry
+    // the device name so several sessions can be told apart.
+    DeviceSession(const DeviceConfig& device, const AppConfig& app, bool multi_device,
+                  DeviceCommandExecutor::CompletionFn on_complete, EventFn on_event = nullptr);
+    ~DeviceSession();
+
+    DeviceSession(const DeviceSession&) = delete;
+    DeviceSession& operator=(const DeviceSession&) = delete;
+
+    const std::string& name() const { return name_; }
+    // The device's view of the application config: its hackrf/pipeline/scan/sweep sections
+    // and its topics. mqtt_sink stages of this device are created with config().mqtt.
+    const AppConfig& config() const { return config_; }
+
+    // Builds the pipeline and checks it has exactly one HackRF source.
+    bool build(const StageFactory& factory);
+    bool start_pipeline();
+    // Starts the executor, opens the device and applies the configured settings.
+    bool open();
+    // Initial start of RX (or the sweep) and of the scanner.
+    bool start_streaming();
+    // Stops the pipeline, scanner and executor, then RX, and closes the device. Idempotent.
+    void shutdown();
+
+    // A parsed control command ({"cmd", "value", "id"}); the reply goes to on_complete.
+    void handle_command(const std::string& cmd, const nlohmann::json& value, const std::string& id,
+                        uint64_t requested_ns);
+
+    // Called periodically by the DeviceSupervisor (the watchdog thread); never waits for a
+    // device operation.
+    // - Stages with work waiting and no heartbeat for recovery.stage_stall_timeout_ms are
+    //   reported, then recovery.stage_stall_action applies.
+    // - The source's transfer rate is compared with the one sample_rate_hz implies.
+    // - If no libhackrf callback arrived for recovery.stall_timeout_ms while the device should
+    //   be streaming (USB glitch, device reset or unplug), a recovery is queued on the
+    //   executor: close and reopen the device (by serial when configured), write the applied
+    //   settings again and restart RX. The MQTT side is untouched; the first block afterwards
+    //   carries kBlockFlagDiscontinuity.
+    void supervise(uint64_t now_ns);
+
+    // Pipeline, command, scan, USB control transfer, watchdog and recovery stats.
+    void log_stats();
+    // The same figures as metrics, labelled device=<name> (see MetricsRegistry).
+    void collect_metrics(MetricsSnapshot& out) const;
+
+private:
+    bool start_rx();
+    bool write_settings();
+    // Opens the device again after a failed recovery closed it (executor thread).
+    bool reopen();
+    DeviceCommandExecutor::Result recover();
+    Stage* source_stage() const;
+    uint32_t source_sample_rate_hz() const;
+    void check_stages(uint64_t now_ns);
+    void check_source_rate(uint64_t now_ns);
+    void publish_event(nlohmann::json event);
+    DeviceCommandExecutor::Action make_settings_action(nlohmann::json patch, uint64_t requested_ns);
+    std::string stats_tag(const std::string& what) const;
+
+    std::string name_;
+    bool multi_device_;
+    AppConfig config_;
+    int rx_cpu_;
+    int publisher_cpu_;
+
+    HackRFHandler handler_;
+    Pipeline pipeline_;
+    HackRFSourceStage* rx_source_ = nullptr;
+    HackRFSweepSourceStage* sweep_source_ = nullptr;
+    DeviceCommandExecutor executor_;
+    std::unique_ptr<ScanScheduler> scanner_;
+    EventFn on_event_;
+
+    // Device settings as last applied. Only the executor thread touches this once streaming.
+    HackRFConfig device_settings_;
+    std::atomic<bool> should_stream_{true};
+    std::atomic<bool> shut_down_{false};
+
+    // Recovery state. The supervisor thread detects, the executor thread recovers.
+    std::atomic<uint64_t> stream_started_ns_{0};   // Last successful start of RX
+    std::atomic<bool> recovering_{false};          // A recovery is queued or running
+    std::atomic<uint64_t> outage_detected_ns_{0};  // When the current outage was detected, 0 = none
+    std::atomic<uint64_t> next_attempt_ns_{0};     // Earliest time of the next reopen attempt
+    uint32_t outage_attempts_ = 0;                 // Executor thread only
+    std::atomic<uint64_t> recoveries_{0};
+    std::atomic<uint64_t> failed_attempts_{0};
+    std::atomic<uint64_t> last_recovery_us_{0};
+    std::atomic<uint64_t> max_recovery_us_{0};
+
+    // Watchdog state, supervisor thread only.
+    std::set<std::string> stalled_stages_;  // Reported and not yet making progress again
+    uint64_t rate_window_start_ns_ = 0;
+    uint64_t rate_window_heartbeats_ = 0;
+    bool source_slow_ = false;
+    // Watchdog stats
+    std::atomic<uint64_t> stage_stalls_{0};
+    std::atomic<uint64_t> slow_source_reports_{0};
+    std::atomic<uint64_t> source_rate_milli_{0};     // Transfers per 1000 s in the last window
+    std::atomic<uint64_t> expected_rate_milli_{0};
+};
+
+} // namespace hackrf_mqtt
+
+#endif // DEVICE_SESSION_H
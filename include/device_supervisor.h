@@ -0,0 +1,43 @@
+#ifndef DEVICE_SUPERVISOR_H
+#define DEVICE_SUPERVISOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hackrf_mqtt {
+
+class DeviceSession;
+
+// Watchdog thread: checks every device's stage heartbeats and source rate, and has a
+// device with a stalled stream reopened (DeviceSession::supervise). Checks only read
+// heartbeats and queue depths; the reopen itself runs on the device's command executor,
+// so one device's recovery neither blocks the others nor races its commands.
+class DeviceSupervisor {
+public:
+    DeviceSupervisor(std::vector<DeviceSession*> sessions, std::chrono::milliseconds interval);
+    ~DeviceSupervisor();
+
+    DeviceSupervisor(const DeviceSupervisor&) = delete;
+    DeviceSupervisor& operator=(const DeviceSupervisor&) = delete;
+
+    void start();
+    void stop();
+
+private:
+    void run();
+
+    std::vector<DeviceSession*> sessions_;
+    std::chrono::milliseconds interval_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+};
+
+} // namespace hackrf_mqtt
+
+#endif // DEVICE_SUPERVISOR_H
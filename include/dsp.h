@@ -0,0 +1,41 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace hackrf_mqtt {
+namespace dsp {
+
+// Precomputed radix-2 FFT plan. Size must be a power of two.
+class FftPlan {
+public:
+    explicit FftPlan(size_t size);
+
+    size_t size() const { return size_; }
+    // In-place forward transform of exactly size() points.
+    void forward(std::complex<float>* data) const;
+
+private:
+    size_t size_;
+    std::vector<size_t> bit_reverse_;
+    std::vector<std::complex<float>> twiddles_;
+};
+
+bool is_power_of_two(size_t value);
+
+// Hann window coefficients of the given length.
+std::vector<float> hann_window(size_t size);
+
+// Windowed-sinc (Hamming) low-pass FIR with unity DC gain.
+// cutoff is the normalized cutoff frequency in cycles/sample (0 < cutoff <= 0.5).
+std::vector<float> design_lowpass(size_t taps, double cutoff);
+
+// Converts a complex spectrum to power in dB and swaps halves so DC sits in the middle.
+void power_spectrum_db(const std::complex<float>* spectrum, size_t size, float* out_db);
+
+} // namespace dsp
+} // namespace hackrf_mqtt
+
+#endif // DSP_H
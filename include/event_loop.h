@@ -0,0 +1,44 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+
+namespace hackrf_mqtt {
+
+// Minimal single-threaded epoll loop. Handlers run on the thread calling run_once().
+// Only wakeup() may be called from other threads.
+class EventLoop {
+public:
+    using Handler = std::function<void(uint32_t events)>; // events: EPOLLIN/EPOLLOUT/... bits
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // False if epoll is unavailable (non-Linux) or could not be created.
+    bool is_valid() const { return epoll_fd_ >= 0; }
+
+    bool add(int fd, uint32_t events, Handler handler);
+    bool modify(int fd, uint32_t events);
+    void remove(int fd);
+
+    // Waits up to timeout_ms (-1 = forever) and dispatches ready handlers.
+    // Returns the number of handlers run, 0 on timeout or wakeup, -1 on error.
+    int run_once(int timeout_ms);
+
+    // Makes a concurrent or the next run_once() return promptly.
+    void wakeup();
+
+private:
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    std::map<int, Handler> handlers_;
+};
+
+} // namespace hackrf_mqtt
+
+#endif // EVENT_LOOP_H
@@ -5,17 +5,29 @@
 #include <cstdint>
 #include <string>
 #include <atomic>
+#include <functional>
+#include <vector>
+
+#include "config_model.h"
 
 // Forward declaration for the callback type
 typedef int (*hackrf_sample_block_cb_fn)(hackrf_transfer* transfer);
 
 class HackRFHandler {
 public:
-    HackRFHandler();
+    // Bytes of one libhackrf USB transfer, i.e. of one rx callback.
+    static constexpr uint32_t kTransferBytes = 262144;
+
+    // serial: open the device whose serial number ends with this ("" = first device found).
+    explicit HackRFHandler(std::string serial = "");
     ~HackRFHandler();
 
+    // Several handlers may be open at once; the library is initialized with the first
+    // and torn down with the last.
     bool init();
     void deinit();
+    bool is_open() const { return device_ != nullptr; }
+    const std::string& serial() const { return serial_; }
 
     bool set_frequency(uint64_t freq_hz);
     bool set_sample_rate(uint32_t rate_hz);
@@ -24,16 +36,96 @@ public:
     bool set_vga_gain(uint32_t gain_db); // 0-62dB, steps of 2dB
     bool set_amp_enable(bool enable);
 
+    // skip_redundant: remember the last value written for each setting and return success
+    // without a USB control transfer when asked for it again. The cache is cleared when the
+    // device is (re)opened and after a failed write, since the device state is then unknown.
+    // validate: reject values outside the hardware's range before any USB traffic.
+    // Gains and the filter bandwidth are always normalized to the step the hardware applies,
+    // so e.g. LNA 33 dB and 32 dB are the same setting.
+    void set_write_policy(bool skip_redundant, bool validate);
+
+    struct ControlTransferStats {
+        uint64_t issued = 0;    // set_* calls that reached the device
+        uint64_t skipped = 0;   // Already at the requested value
+        uint64_t rejected = 0;  // Failed validation
+        uint64_t failed = 0;    // Device returned an error
+    };
+    ControlTransferStats control_transfer_stats() const;
+
+    // Applies every device setting in `target` that differs from `current`, as one transaction.
+    // Order: amp and gains (plain register writes), sample rate, baseband filter (a rate
+    // write resets the filter, so it is re-applied), and the frequency last, so the PLL
+    // relocks once after everything else is in place.
+    // `current` is updated per successful step; on failure the remaining steps are skipped.
+    // before_first_write runs once, just before the first USB operation (not at all for a no-op).
+    struct ApplyResult {
+        bool ok = true;
+        int applied = 0;        // Settings that differed from `current` and were written
+        int unchanged = 0;      // Settings already at the target value
+        uint64_t transfers = 0; // USB control transfers issued (applied minus writes the cache skipped)
+        bool retuned = false;   // Frequency, sample rate or filter changed (settle time needed)
+        std::string failed;     // Name of the setting that failed
+    };
+    ApplyResult apply_config(const hackrf_mqtt::HackRFConfig& target, hackrf_mqtt::HackRFConfig& current,
+                             const std::function<void()>& before_first_write = nullptr);
+
     // The callback_context will be passed to the callback via transfer->rx_ctx or transfer->tx_ctx
     bool start_rx(hackrf_sample_block_cb_fn callback, void* callback_context);
+    // Firmware sweep mode: the device retunes itself across frequency_list_mhz ([start, stop)
+    // pairs in MHz) in step_width_hz steps, capturing num_bytes (a multiple of 16384) per step.
+    // Each 16384-byte block of a transfer starts with a 10-byte marker holding its tuned frequency.
+    // Stopped with stop_rx().
+    bool start_rx_sweep(const std::vector<uint16_t>& frequency_list_mhz, uint32_t num_bytes, uint32_t step_width_hz,
+                        uint32_t offset_hz, hackrf_sample_block_cb_fn callback, void* callback_context);
     bool stop_rx();
     bool is_streaming() const;
 
 private:
+    template <typename T>
+    struct CachedSetting {
+        bool valid = false;
+        T value{};
+    };
+
+    // True (and counted) when `value` is already applied and the write can be skipped.
+    template <typename T>
+    bool already_applied(const CachedSetting<T>& cached, T value) {
+        if (skip_redundant_ && cached.valid && cached.value == value) {
+            writes_skipped_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+    template <typename T>
+    void record_write(CachedSetting<T>& cached, T value, int result) {
+        writes_issued_.fetch_add(1, std::memory_order_relaxed);
+        cached.valid = (result == HACKRF_SUCCESS);
+        cached.value = value;
+        if (result != HACKRF_SUCCESS) {
+            writes_failed_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    bool reject(const char* setting, uint64_t value, uint64_t min, uint64_t max);
+    void clear_setting_cache();
+
     hackrf_device* device_;
     std::atomic<bool> streaming_;
     // Store the callback context to pass it to libhackrf
     void* rx_callback_context_; 
+    std::string serial_;
+
+    bool skip_redundant_ = true;
+    bool validate_ = true;
+    CachedSetting<uint64_t> frequency_;
+    CachedSetting<uint32_t> sample_rate_;
+    CachedSetting<uint32_t> baseband_filter_bandwidth_;
+    CachedSetting<uint32_t> lna_gain_;
+    CachedSetting<uint32_t> vga_gain_;
+    CachedSetting<bool> amp_enable_;
+    std::atomic<uint64_t> writes_issued_{0};
+    std::atomic<uint64_t> writes_skipped_{0};
+    std::atomic<uint64_t> writes_rejected_{0};
+    std::atomic<uint64_t> writes_failed_{0};
 };
 
 #endif // HACKRF_HANDLER_H
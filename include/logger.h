@@ -1,13 +1,24 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
-#include <iostream>
 #include <string>
-#include <chrono>
-#include <iomanip> // For std::put_time
-#include <sstream> // For string stream
+#include <sstream> // Fallback for types without a LogMessage::append overload
+#include <algorithm>
 #include <atomic>  // For atomic log level
-#include <algorithm> // For std::transform (string to upper)
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+// Lowest level compiled in: 0 DEBUG, 1 INFO, 2 WARNING, 3 ERROR, 4 NONE. Set by the
+// HACKRF_MQTT_MIN_LOG_LEVEL CMake option; calls below it generate no code at all.
+#ifndef HACKRF_MQTT_MIN_LOG_LEVEL
+#define HACKRF_MQTT_MIN_LOG_LEVEL 0
+#endif
 
 namespace hackrf_mqtt {
 namespace logger {
@@ -20,23 +31,20 @@ enum class LogLevel {
     NONE // To disable all logging
 };
 
-// Global atomic variable for current log level
-// Default to INFO if not initialized
-static std::atomic<LogLevel> current_log_level(LogLevel::INFO);
+constexpr bool compiled_in(LogLevel level) {
+    return static_cast<int>(level) >= HACKRF_MQTT_MIN_LOG_LEVEL;
+}
 
-// Helper to convert string to LogLevel
-inline LogLevel string_to_log_level(const std::string& level_str) {
-    std::string upper_level_str = level_str;
-    std::transform(upper_level_str.begin(), upper_level_str.end(), upper_level_str.begin(), ::toupper);
-
-    if (upper_level_str == "DEBUG") return LogLevel::DEBUG;
-    if (upper_level_str == "INFO") return LogLevel::INFO;
-    if (upper_level_str == "WARNING") return LogLevel::WARNING;
-    if (upper_level_str == "ERROR") return LogLevel::ERROR;
-    if (upper_level_str == "NONE") return LogLevel::NONE;
-    return LogLevel::INFO; // Default if unrecognized
+// Process-wide log level (defined in logger.cpp). Default INFO until init().
+extern std::atomic<LogLevel> current_log_level;
+
+inline bool enabled(LogLevel level) {
+    return level >= current_log_level.load(std::memory_order_relaxed);
 }
 
+// Helper to convert string to LogLevel
+LogLevel string_to_log_level(const std::string& level_str);
+
 // Initialize the logger with a specific level
 inline void init(LogLevel level) {
     current_log_level.store(level);
@@ -46,46 +54,231 @@ inline void init(const std::string& level_str) {
     init(string_to_log_level(level_str));
 }
 
-// Helper to get current timestamp as string
-inline std::string get_timestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto now_c = std::chrono::system_clock::to_time_t(now);
-    std::tm now_tm;
+// Asynchronous backend. After start(), callers only copy the formatted message and a
+// timestamp into a lock-free ring; a background thread adds the timestamp text and writes
+// in batches (WARN/ERROR to stderr, the rest to stdout). Before start() and after stop(),
+// messages are written synchronously on the calling thread. The backend is stopped and
+// drained at exit.
+void start();
+void stop();
+// Blocks until everything queued so far is written (e.g. before std::abort()).
+void flush();
+// Messages lost because the ring was full. The logger thread also reports them as a warning.
+uint64_t dropped();
 
-#ifdef _WIN32
-    localtime_s(&now_tm, &now_c); // Windows specific
-#else
-    localtime_r(&now_c, &now_tm); // POSIX specific
-#endif
+// Longest message kept; longer ones are cut to fit a ring slot.
+constexpr size_t kMaxMessageBytes = 1000;
+
+// Queues one formatted message; never blocks.
+void write(LogLevel level, const char* text, size_t length);
+
+// Calls the rate-limited macros below left out (process-wide; see the per-site classes).
+extern std::atomic<uint64_t> suppressed_total;
+inline uint64_t suppressed() { return suppressed_total.load(std::memory_order_relaxed); }
+
+// Appended by the LOG_*_EVERY_N / LOG_*_EVERY_MS macros: " (N similar suppressed)" when
+// N > 0, nothing otherwise.
+struct Suppressed {
+    uint64_t count;
+};
+
+// Message text built on the caller's stack: strings are copied, integers go through
+// std::to_chars and floating point through snprintf("%g"), so the common cases need no
+// stream and no allocation. Output matches what std::ostream would print for these types.
+class LogMessage {
+public:
+    LogMessage& append(std::string_view text) {
+        size_t n = std::min(text.size(), kMaxMessageBytes - size_);
+        std::memcpy(text_ + size_, text.data(), n);
+        size_ += n;
+        return *this;
+    }
+    LogMessage& append(const char* text) { return append(std::string_view(text ? text : "(null)")); }
+    LogMessage& append(const std::string& text) { return append(std::string_view(text)); }
+    LogMessage& append(char c) { return append(std::string_view(&c, 1)); }
+    LogMessage& append(signed char c) { return append(static_cast<char>(c)); }
+    LogMessage& append(unsigned char c) { return append(static_cast<char>(c)); }
+    LogMessage& append(bool value) { return append(value ? '1' : '0'); }
+    LogMessage& append(double value) {
+        char buffer[32];
+        int n = std::snprintf(buffer, sizeof(buffer), "%g", value);
+        return append(std::string_view(buffer, n > 0 ? static_cast<size_t>(n) : 0));
+    }
+    LogMessage& append(float value) { return append(static_cast<double>(value)); }
+    LogMessage& append(Suppressed suppressed) {
+        if (suppressed.count == 0) {
+            return *this;
+        }
+        return append(" (").append(suppressed.count).append(" similar suppressed)");
+    }
+    template<typename T, std::enable_if_t<std::is_integral<T>::value, int> = 0>
+    LogMessage& append(T value) {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        return append(std::string_view(buffer, static_cast<size_t>(result.ptr - buffer)));
+    }
+    // Anything else with an operator<< (enums, pointers, library types).
+    template<typename T, std::enable_if_t<!std::is_integral<T>::value && !std::is_floating_point<T>::value &&
+                                          !std::is_convertible<const T&, std::string_view>::value, int> = 0>
+    LogMessage& append(const T& value) {
+        std::ostringstream stream;
+        stream << value;
+        return append(stream.str());
+    }
+
+    const char* data() const { return text_; }
+    size_t size() const { return size_; }
+
+private:
+    char text_[kMaxMessageBytes];
+    size_t size_ = 0;
+};
+
+template<typename... Args>
+inline void append_all(LogMessage& message, const Args&... args) {
+    (message.append(args), ...);
+}
+
+template<typename... Args>
+inline void log_message(LogLevel level, const Args&... args) {
+    LogMessage message;
+    append_all(message, args...);
+    write(level, message.data(), message.size());
+}
 
-    std::stringstream ss;
-    ss << std::put_time(&now_tm, "%Y-%m-%d %H:%M:%S");
-    
-    // Add milliseconds
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
-    ss << '.' << std::setfill('0') << std::setw(3) << ms.count();
-    
-    return ss.str();
+inline uint64_t monotonic_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
 }
 
-// Generic log function
+// Per-call-site state for the rate-limited macros. Each macro expansion owns one static
+// instance; the members are atomics with constant initialisers, so the static needs no
+// guard and a check is a few relaxed atomic operations. Under races between threads a
+// suppressed call may be counted against the next line instead of the current one.
+
+// Admits the 1st, (n+1)th, (2n+1)th... call.
+class EveryNSite {
+public:
+    bool admit(uint64_t n, uint64_t& suppressed) {
+        const uint64_t index = count_.fetch_add(1, std::memory_order_relaxed);
+        if (n <= 1 || index % n == 0) {
+            suppressed = (index == 0 || n <= 1) ? 0 : n - 1;
+            return true;
+        }
+        suppressed_total.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+private:
+    std::atomic<uint64_t> count_{0};
+};
+
+// Admits at most one call per interval; the admitted call reports how many were skipped.
+class EveryMsSite {
+public:
+    bool admit(uint64_t interval_ms, uint64_t& suppressed) {
+        const uint64_t now = monotonic_ns();
+        uint64_t next = next_ns_.load(std::memory_order_relaxed);
+        if (now >= next &&
+            next_ns_.compare_exchange_strong(next, now + interval_ms * 1000000, std::memory_order_relaxed)) {
+            suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+            return true;
+        }
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        suppressed_total.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+private:
+    std::atomic<uint64_t> next_ns_{0};
+    std::atomic<uint64_t> suppressed_{0};
+};
+
+constexpr uint64_t kDedupSummaryMs = 10000;
+
+// Collapses identical consecutive messages (compared by hash). A repeat is only counted;
+// while repeats continue, one line "<message> (repeated N times)" is written per
+// kDedupSummaryMs, and when a different message arrives the count left over is written
+// first as "Last message repeated N times.".
+class DedupSite {
+public:
+    void log(LogLevel level, const LogMessage& message);
+
+private:
+    std::atomic<uint64_t> last_hash_{0};
+    std::atomic<uint64_t> repeats_{0};
+    std::atomic<uint64_t> last_written_ns_{0};
+};
+
+// Generic log function (filters at run time only; the LOG_* macros also strip at build time)
 template<typename... Args>
-inline void log(LogLevel level, const char* level_str, Args&&... args) {
-    if (level >= current_log_level.load()) {
-        std::stringstream message_ss;
-        // C++17 fold expression for cleaner parameter packing into stringstream
-        (message_ss << ... << std::forward<Args>(args)); 
-        
-        std::ostream& out_stream = (level == LogLevel::ERROR || level == LogLevel::WARNING) ? std::cerr : std::cout;
-        out_stream << "[" << get_timestamp() << "] [" << level_str << "] " << message_ss.str() << std::endl;
+inline void log(LogLevel level, const char* /*level_str*/, const Args&... args) {
+    if (enabled(level)) {
+        log_message(level, args...);
     }
 }
 
-// Logging macros for convenience
-#define LOG_DEBUG(...) hackrf_mqtt::logger::log(hackrf_mqtt::logger::LogLevel::DEBUG, "DEBUG", __VA_ARGS__)
-#define LOG_INFO(...)  hackrf_mqtt::logger::log(hackrf_mqtt::logger::LogLevel::INFO,  "INFO",  __VA_ARGS__)
-#define LOG_WARN(...)  hackrf_mqtt::logger::log(hackrf_mqtt::logger::LogLevel::WARNING,"WARN",  __VA_ARGS__)
-#define LOG_ERROR(...) hackrf_mqtt::logger::log(hackrf_mqtt::logger::LogLevel::ERROR, "ERROR", __VA_ARGS__)
+// Logging macros for convenience. Arguments are only evaluated when the level is enabled,
+// and levels below HACKRF_MQTT_MIN_LOG_LEVEL compile to nothing.
+#define HACKRF_MQTT_LOG(level, ...)                                                       \
+    do {                                                                                  \
+        if constexpr (hackrf_mqtt::logger::compiled_in(level)) {                          \
+            if (hackrf_mqtt::logger::enabled(level)) {                                    \
+                hackrf_mqtt::logger::log_message(level, __VA_ARGS__);                     \
+            }                                                                             \
+        }                                                                                 \
+    } while (0)
+
+// Rate-limited variants for paths that can fail on every block. Each call site keeps its
+// own static state; the level checks come first, so a filtered-out call touches no state.
+#define HACKRF_MQTT_LOG_LIMITED(level, site_type, limit, ...)                            \
+    do {                                                                                  \
+        if constexpr (hackrf_mqtt::logger::compiled_in(level)) {                          \
+            if (hackrf_mqtt::logger::enabled(level)) {                                    \
+                static hackrf_mqtt::logger::site_type hackrf_mqtt_log_site;               \
+                uint64_t hackrf_mqtt_log_suppressed = 0;                                  \
+                if (hackrf_mqtt_log_site.admit((limit), hackrf_mqtt_log_suppressed)) {    \
+                    hackrf_mqtt::logger::log_message(level, __VA_ARGS__,                  \
+                        hackrf_mqtt::logger::Suppressed{hackrf_mqtt_log_suppressed});     \
+                }                                                                         \
+            }                                                                             \
+        }                                                                                 \
+    } while (0)
+
+#define HACKRF_MQTT_LOG_DEDUP(level, ...)                                                 \
+    do {                                                                                  \
+        if constexpr (hackrf_mqtt::logger::compiled_in(level)) {                          \
+            if (hackrf_mqtt::logger::enabled(level)) {                                    \
+                static hackrf_mqtt::logger::DedupSite hackrf_mqtt_log_site;               \
+                hackrf_mqtt::logger::LogMessage hackrf_mqtt_log_text;                     \
+                hackrf_mqtt::logger::append_all(hackrf_mqtt_log_text, __VA_ARGS__);       \
+                hackrf_mqtt_log_site.log(level, hackrf_mqtt_log_text);                    \
+            }                                                                             \
+        }                                                                                 \
+    } while (0)
+
+#define LOG_DEBUG(...) HACKRF_MQTT_LOG(hackrf_mqtt::logger::LogLevel::DEBUG, __VA_ARGS__)
+#define LOG_INFO(...)  HACKRF_MQTT_LOG(hackrf_mqtt::logger::LogLevel::INFO, __VA_ARGS__)
+#define LOG_WARN(...)  HACKRF_MQTT_LOG(hackrf_mqtt::logger::LogLevel::WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) HACKRF_MQTT_LOG(hackrf_mqtt::logger::LogLevel::ERROR, __VA_ARGS__)
+
+// Logs the 1st, (n+1)th, (2n+1)th... call from this site.
+#define LOG_DEBUG_EVERY_N(n, ...) HACKRF_MQTT_LOG_LIMITED(hackrf_mqtt::logger::LogLevel::DEBUG, EveryNSite, n, __VA_ARGS__)
+#define LOG_INFO_EVERY_N(n, ...)  HACKRF_MQTT_LOG_LIMITED(hackrf_mqtt::logger::LogLevel::INFO, EveryNSite, n, __VA_ARGS__)
+#define LOG_WARN_EVERY_N(n, ...)  HACKRF_MQTT_LOG_LIMITED(hackrf_mqtt::logger::LogLevel::WARNING, EveryNSite, n, __VA_ARGS__)
+#define LOG_ERROR_EVERY_N(n, ...) HACKRF_MQTT_LOG_LIMITED(hackrf_mqtt::logger::LogLevel::ERROR, EveryNSite, n, __VA_ARGS__)
+
+// Logs at most once per ms milliseconds from this site.
+#define LOG_DEBUG_EVERY_MS(ms, ...) HACKRF_MQTT_LOG_LIMITED(hackrf_mqtt::logger::LogLevel::DEBUG, EveryMsSite, ms, __VA_ARGS__)
+#define LOG_INFO_EVERY_MS(ms, ...)  HACKRF_MQTT_LOG_LIMITED(hackrf_mqtt::logger::LogLevel::INFO, EveryMsSite, ms, __VA_ARGS__)
+#define LOG_WARN_EVERY_MS(ms, ...)  HACKRF_MQTT_LOG_LIMITED(hackrf_mqtt::logger::LogLevel::WARNING, EveryMsSite, ms, __VA_ARGS__)
+#define LOG_ERROR_EVERY_MS(ms, ...) HACKRF_MQTT_LOG_LIMITED(hackrf_mqtt::logger::LogLevel::ERROR, EveryMsSite, ms, __VA_ARGS__)
+
+// Collapses identical consecutive messages from this site (see DedupSite).
+#define LOG_DEBUG_DEDUP(...) HACKRF_MQTT_LOG_DEDUP(hackrf_mqtt::logger::LogLevel::DEBUG, __VA_ARGS__)
+#define LOG_INFO_DEDUP(...)  HACKRF_MQTT_LOG_DEDUP(hackrf_mqtt::logger::LogLevel::INFO, __VA_ARGS__)
+#define LOG_WARN_DEDUP(...)  HACKRF_MQTT_LOG_DEDUP(hackrf_mqtt::logger::LogLevel::WARNING, __VA_ARGS__)
+#define LOG_ERROR_DEDUP(...) HACKRF_MQTT_LOG_DEDUP(hackrf_mqtt::logger::LogLevel::ERROR, __VA_ARGS__)
 
 } // namespace logger
 } // namespace hackrf_mqtt
@@ -0,0 +1,143 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sample_block.h"
+
+namespace hackrf_mqtt {
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+struct HistogramSnapshot {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    std::vector<uint64_t> buckets; // Per Histogram bucket index
+
+    // Upper bound of the bucket holding the q-quantile (0..1), capped at max. 0 when empty.
+    uint64_t quantile(double q) const;
+    // Adds the counts of `other` (same bucket layout).
+    void merge(const HistogramSnapshot& other);
+};
+
+// Log-linear histogram in the style of HdrHistogram: values below 8 have a bucket each,
+// and every power of two above is split into 8 linear buckets, so a value is known to
+// within 12.5% over the full uint64 range. record() is two relaxed atomic adds and a max
+// update and never locks, so it can sit on the libhackrf callback or publish path.
+class Histogram {
+public:
+    static constexpr int kSubBucketBits = 3;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+    static constexpr size_t kBucketCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    void record(uint64_t value) {
+        buckets_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+        uint64_t prev = max_.load(std::memory_order_relaxed);
+        while (value > prev && !max_.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Counts are read one by one while writers may be active, so a snapshot can be off by
+    // the few records that land during the copy.
+    HistogramSnapshot snapshot() const;
+
+    static size_t bucket_index(uint64_t value) {
+        if (value < kSubBuckets) {
+            return static_cast<size_t>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - kSubBucketBits;
+        return static_cast<size_t>(shift + 1) * kSubBuckets + ((value >> shift) & (kSubBuckets - 1));
+    }
+    // Largest value that falls into bucket `index`.
+    static uint64_t bucket_upper_bound(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets_{};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+// Values gathered from every collector at one point in time.
+struct MetricsSnapshot {
+    enum class Type { COUNTER, GAUGE };
+    struct Value {
+        std::string name;
+        MetricLabels labels;
+        Type type;
+        double value;
+    };
+    struct HistogramValue {
+        std::string name;
+        MetricLabels labels;
+        HistogramSnapshot histogram;
+    };
+
+    uint64_t time_ms = 0;    // Wall clock (ms since the epoch)
+    double uptime_s = 0.0;
+    std::vector<Value> values;
+    std::vector<HistogramValue> histograms;
+
+    void counter(std::string name, MetricLabels labels, double value) {
+        values.push_back(Value{std::move(name), std::move(labels), Type::COUNTER, value});
+    }
+    void gauge(std::string name, MetricLabels labels, double value) {
+        values.push_back(Value{std::move(name), std::move(labels), Type::GAUGE, value});
+    }
+    void histogram(std::string name, MetricLabels labels, HistogramSnapshot histogram) {
+        histograms.push_back(HistogramValue{std::move(name), std::move(labels), std::move(histogram)});
+    }
+};
+
+// `labels` plus key=value, for collectors that nest (device, then stage).
+MetricLabels with_label(MetricLabels labels, std::string key, std::string value);
+
+// The process's metrics. Components keep their own counters (relaxed atomics and
+// Histograms on the hot path) and register a collector that copies them into a snapshot;
+// nothing is aggregated until someone asks. Collectors run on the thread that calls
+// snapshot(), so they must only read atomics or take short locks.
+class MetricsRegistry {
+public:
+    using Collector = std::function<void(MetricsSnapshot& out)>;
+
+    // Returns an id for remove_collector(). Remove before the collected object goes away.
+    uint64_t add_collector(Collector collector);
+    void remove_collector(uint64_t id);
+
+    MetricsSnapshot snapshot() const;
+
+private:
+    const uint64_t created_ns_ = monotonic_now_ns();
+    mutable std::mutex mutex_;
+    std::map<uint64_t, Collector> collectors_;
+    uint64_t next_id_ = 1;
+};
+
+// Compact JSON for the stats topic:
+// {"time_ms": ..., "uptime_s": ..., "counters": {"name{k=v,...}": n, ...}, "gauges": {...},
+//  "histograms": {"name{...}": {"count", "sum", "max", "p50", "p90", "p99", "p999"}}}
+std::string encode_metrics_json(const MetricsSnapshot& snapshot);
+
+// Prometheus text exposition format (version 0.0.4), with the same metric names and labels
+// as the JSON. Histograms become summaries with quantiles 0.5/0.9/0.99/0.999 plus a
+// <name>_max gauge; those recorded in nanoseconds (<name>_ns) are exported as <name>_seconds.
+std::string encode_prometheus_text(const MetricsSnapshot& snapshot);
+
+// CPU time of the process and of each thread, read from /proc/self/task: counters
+// process_cpu_seconds_total and thread_cpu_seconds_total{thread=<name>}. Threads sharing a
+// name (see set_current_thread_name) are summed. Adds nothing where /proc is unavailable.
+void collect_thread_cpu(MetricsSnapshot& out);
+
+} // namespace hackrf_mqtt
+
+#endif // METRICS_H
@@ -0,0 +1,43 @@
+#ifndef METRICS_HTTP_SERVER_H
+#define METRICS_HTTP_SERVER_H
+
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace hackrf_mqtt {
+
+class MetricsRegistry;
+
+// Minimal HTTP/1.0 server for Prometheus scrapes: GET /metrics answers with a registry
+// snapshot in text exposition format (encode_prometheus_text); anything else is a 404.
+// One thread serves one connection at a time and closes it after the reply. Snapshots only
+// read counters, so a scrape never blocks the sample path.
+class MetricsHttpServer {
+public:
+    MetricsHttpServer(const MetricsRegistry& registry, std::string bind_address, uint16_t port);
+    ~MetricsHttpServer();
+
+    MetricsHttpServer(const MetricsHttpServer&) = delete;
+    MetricsHttpServer& operator=(const MetricsHttpServer&) = delete;
+
+    // Binds and starts the thread. False (and logs) if the address cannot be bound.
+    bool start();
+    void stop();
+
+private:
+    void run();
+    void serve(int fd);
+
+    const MetricsRegistry& registry_;
+    std::string bind_address_;
+    uint16_t port_;
+
+    int listen_fd_ = -1;
+    int wake_fd_ = -1;  // eventfd that makes run() return
+    std::thread thread_;
+};
+
+} // namespace hackrf_mqtt
+
+#endif // METRICS_HTTP_SERVER_H
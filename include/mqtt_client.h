@@ -7,6 +7,13 @@
 #include <atomic>
 #include <functional> // For std::function (command callback)
 #include <mutex>      // For potential future use with shared state
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <unordered_map>
+
+#include "config_model.h"
+#include "metrics.h"
 
 class MqttClient : public mosqpp::mosquittopp {
 public:
@@ -18,20 +25,79 @@ public:
     void set_port(int port);
     void set_username_password(const std::string& username, const std::string& password);
     void set_keepalive(int keepalive_seconds);
+    // Socket options applied to each new connection in on_connect (zerocopy/cork are native-only).
+    void set_socket_tuning(const hackrf_mqtt::MqttSocketConfig& tuning);
 
     // Connection management
     bool connect_to_broker();
     bool disconnect_from_broker();
     bool is_connected() const; // Our own connected flag
 
-    // Publishing
-    int publish_message(const std::string& topic, const void* payload, int payloadlen, int qos = 0, bool retain = false);
+    // External network loop: instead of loop_start(), a single caller thread owns the
+    // socket and drives it from its own epoll loop. Select before connect_to_broker();
+    // the connect itself is then issued from the next network_misc() call, so every
+    // libmosquitto call stays on the driving thread.
+    void set_external_network_loop(bool external);
+    bool uses_external_network_loop() const { return external_loop_; }
+    int network_socket();          // -1 while there is no socket
+    bool network_wants_write();    // Outgoing data is buffered; watch for EPOLLOUT
+    int network_read();            // Socket readable (MOSQ_ERR_* code)
+    int network_write();           // Socket writable (MOSQ_ERR_* code)
+    int network_misc();            // Pending connect, keepalive and retries; call about once a second
+
+    // QoS > 0 flow control: at most `max_messages` messages may await their PUBACK/PUBCOMP.
+    // When the window is full, publish_message waits up to `wait_timeout` for on_publish to
+    // free a slot (0 = no wait) and then returns PUBLISH_WINDOW_FULL without publishing.
+    // This bounds libmosquitto's outgoing queue and turns a slow broker into backpressure.
+    // max_messages = 0 disables the window. Also caps libmosquitto's own in-flight limit.
+    // Configure before connecting.
+    static constexpr int PUBLISH_WINDOW_FULL = -1000;
+    void set_inflight_window(size_t max_messages, std::chrono::milliseconds wait_timeout);
+
+    struct InflightStats {
+        size_t in_flight = 0;
+        size_t high_water = 0;
+        uint64_t acked = 0;
+        uint64_t window_full = 0;   // Publishes refused because no slot freed in time
+        uint64_t wait_ns = 0;       // Total time publishers spent waiting for a slot
+        uint64_t progress_ns = 0;   // monotonic_now_ns() of the latest ack, or of the first publish after none were in flight
+    };
+    InflightStats inflight_stats() const;
+
+    // Broker ack latency of QoS 1/2 publishes tracked by the in-flight window: from the
+    // publish call returning to on_publish, and from the block's capture time to on_publish.
+    struct AckLatency {
+        hackrf_mqtt::HistogramSnapshot publish_to_ack_ns;
+        hackrf_mqtt::HistogramSnapshot capture_to_ack_ns;
+    };
+    AckLatency ack_latency() const;
+
+    // Publishing. `capture_time_ns` (monotonic_now_ns() of the data's capture, 0 = unknown)
+    // feeds AckLatency::capture_to_ack_ns.
+    int publish_message(const std::string& topic, const void* payload, int payloadlen, int qos = 0, bool retain = false,
+                        uint64_t capture_time_ns = 0);
     int publish_message(const std::string& topic, const std::string& message, int qos = 0, bool retain = false);
 
     // For control commands (pause/resume)
     void set_control_topic(const std::string& topic, int qos = 0);
     void set_control_command_callback(std::function<void(const std::string& command_payload)> callback);
 
+    // Time from on_message to the control callback returning, per command.
+    struct ControlStats {
+        uint64_t commands = 0;
+        uint64_t total_ns = 0;
+        uint64_t max_ns = 0;
+    };
+    ControlStats control_stats() const;
+
+    // Connection events since start; connects above one are reconnects.
+    struct ConnectionStats {
+        uint64_t connects = 0;
+        uint64_t disconnects = 0;
+        uint64_t connect_failures = 0;
+    };
+    ConnectionStats connection_stats() const;
+
 private:
     // Callbacks from mosqpp::mosquittopp
     void on_connect(int rc) override;
@@ -49,11 +115,38 @@ private:
     std::string client_id_str_; 
 
     std::atomic<bool> connected_flag_;
+    hackrf_mqtt::MqttSocketConfig socket_tuning_;
+    bool external_loop_ = false;
+    std::atomic<bool> connect_pending_{false};
+    // Thread that last called network_*(): the only one allowed to read or write the socket.
+    std::atomic<std::thread::id> network_owner_{};
+
+    // In-flight window. Recursive because, with the external network loop, publish() may
+    // flush queued QoS 0 packets and run on_publish on this same thread.
+    bool acquire_inflight_slot_locked(std::unique_lock<std::recursive_mutex>& lock);
+    mutable std::recursive_mutex inflight_mutex_;
+    std::condition_variable_any inflight_cv_;
+    struct InflightMessage {
+        uint64_t published_ns = 0;
+        uint64_t capture_time_ns = 0;
+    };
+    std::unordered_map<int, InflightMessage> inflight_mids_;
+    size_t inflight_window_ = 0;
+    std::chrono::milliseconds inflight_wait_timeout_{0};
+    InflightStats inflight_stats_;
+    hackrf_mqtt::Histogram publish_to_ack_ns_;
+    hackrf_mqtt::Histogram capture_to_ack_ns_;
 
     // Control topic handling
     std::string control_topic_str_;
     int control_topic_qos_;
     std::function<void(const std::string& command_payload)> on_control_command_received_callback_;
+    std::atomic<uint64_t> control_commands_{0};
+    std::atomic<uint64_t> control_total_ns_{0};
+    std::atomic<uint64_t> control_max_ns_{0};
+    std::atomic<uint64_t> connects_{0};
+    std::atomic<uint64_t> disconnects_{0};
+    std::atomic<uint64_t> connect_failures_{0};
     
     // For reconnect logic (can be added later)
     // int reconnect_delay_s_ = 5;
@@ -0,0 +1,142 @@
+#ifndef MQTT_SINK_H
+#define MQTT_SINK_H
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "config_model.h"
+#include "event_loop.h"
+#include "mqtt_client.h"
+#include "native_mqtt_publisher.h"
+#include "pipeline.h"
+
+namespace hackrf_mqtt {
+
+// Publishes each block's payload to an MQTT topic.
+// params: {"topic": "<defaults to mqtt.topic>", "qos": <defaults to mqtt.qos>,
+//          "transport": <defaults to mqtt.data_transport>, "block_header": <defaults to mqtt.block_header>,
+//          "shards": <defaults to mqtt.data_shards>, "shard_policy": <defaults to mqtt.shard_policy>}
+//
+// With transport "native" the stage opens its own QoS 0 connection (client id
+// "<mqtt.client_id>_<stage name>") and sends block memory with one sendmsg() per
+// block, skipping libmosquitto's payload copy. The control topic stays on MqttClient.
+// With mqtt.socket.zerocopy, blocks sent by MSG_ZEROCOPY are held until the kernel
+// reports completion (at most zerocopy_max_pending; beyond that the sink waits).
+//
+// With shards > 1 the stage spreads blocks over that many connections of its own
+// (client ids "<mqtt.client_id>_<stage name>_<n>"), round-robin or by SampleBlock::channel.
+// Round-robin reorders blocks across connections, so the block header (with its
+// sequence number) is switched on for subscribers to restore order.
+//
+// Runs as an epoll event loop on its dedicated thread: the input queue's eventfd
+// wakes it, and each wakeup drains up to batch_max_items / batch_max_bytes blocks
+// in one critical section. Shutdown closes the queue, which wakes the loop at once.
+//
+// With drive_network set (mqtt.network_loop = "event_loop"), the same loop also owns
+// the client's socket: read/write readiness and keepalive are serviced here instead
+// of on libmosquitto's own thread, so publishing needs no cross-thread handoff.
+class MqttSinkStage : public Stage {
+public:
+    MqttSinkStage(const StageConfig& config, MqttClient& client, const MqttConfig& mqtt_config,
+                  bool drive_network = false);
+
+    bool start() override;
+    void stop() override;
+    void process(SampleBlock&& block) override;
+
+    bool has_event_loop() const override { return true; }
+    void run_event_loop(BlockQueue& input, const std::atomic<bool>& running, const BlockHandler& handle) override;
+
+    // Publish call latency and, with zero-copy, kernel completion latency.
+    std::string stats_detail() override;
+    // Published blocks and bytes, drops by reason, publish call latency and connections.
+    void collect_metrics(MetricsSnapshot& out, const MetricLabels& labels) override;
+    // QoS 1/2 publishes with no broker ack for `timeout_ns` (a wedged network loop or broker).
+    std::string stalled_work(uint64_t now_ns, uint64_t timeout_ns) override;
+
+private:
+    // Keeps the epoll registration of the MQTT socket in line with the client's state.
+    void sync_network_watch(EventLoop& loop);
+    struct PendingZeroCopy {
+        uint64_t ticket;
+        uint64_t sent_ns;
+        SampleBlock block;
+    };
+
+    // One data connection. A single-shard mosquitto sink publishes through the shared
+    // client; every other shard owns its connection.
+    struct Shard {
+        MqttClient* client = nullptr;                 // "mosquitto" transport
+        std::unique_ptr<MqttClient> owned_client;
+        std::unique_ptr<NativeMqttPublisher> native;  // "native" transport
+        std::deque<PendingZeroCopy> zc_pending;
+        int zc_watched_fd = -1;
+        std::atomic<uint64_t> blocks{0};              // Published on this connection
+        std::atomic<uint64_t> bytes{0};
+        uint64_t reported_blocks = 0;                 // Stats thread only
+        uint64_t reported_bytes = 0;
+    };
+
+    enum class ShardPolicy { ROUND_ROBIN, CHANNEL };
+
+    Shard& select_shard(const SampleBlock& block);
+    // Watches a native socket's error queue while its zero-copy blocks are held.
+    void sync_zerocopy_watch(EventLoop& loop, Shard& shard);
+    // Keepalive/reconnect for native connections, at most once a second.
+    void service_native();
+    // Each returns false if the block was not published (discarded or the publish failed).
+    bool publish_native(Shard& shard, SampleBlock&& block);
+    bool publish_mosquitto(Shard& shard, const SampleBlock& block);
+    // Frees zero-copy blocks the kernel is done with; waits while too many are held.
+    void release_zerocopy_blocks(Shard& shard);
+    void update_zerocopy_stats();
+
+    MqttClient& client_;
+    std::string topic_;
+    int qos_;
+    size_t batch_max_items_;
+    size_t batch_max_bytes_;
+    bool drive_network_;
+    bool block_header_;
+    bool native_transport_ = false;
+    ShardPolicy shard_policy_ = ShardPolicy::ROUND_ROBIN;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t next_shard_ = 0;
+    NativeMqttPublisher::Topic native_topic_;
+    std::chrono::steady_clock::time_point last_native_service_{};
+    std::vector<unsigned char> scratch_; // Header + payload for the mosquitto path with block_header
+    size_t zc_max_pending_;
+
+    // Written by the sink thread, read by stats_detail() on the stats thread.
+    std::atomic<uint64_t> publish_count_{0};
+    std::atomic<uint64_t> publish_ns_{0};
+    std::atomic<uint64_t> publish_max_ns_{0};      // Since the last report
+    std::atomic<uint64_t> zc_completions_{0};
+    std::atomic<uint64_t> zc_completion_ns_{0};
+    std::atomic<uint64_t> zc_completion_max_ns_{0}; // Since the last report
+    std::atomic<uint64_t> zc_sends_{0};
+    std::atomic<uint64_t> zc_copied_{0};
+    std::atomic<uint64_t> zc_fallbacks_{0};
+    std::atomic<uint64_t> zc_held_{0};
+    Histogram publish_latency_ns_;                 // Publish call, per block
+    Histogram capture_to_publish_ns_;              // Capture time to the publish call returning
+    std::atomic<uint64_t> dropped_not_connected_{0};
+    std::atomic<uint64_t> dropped_window_full_{0};
+    std::atomic<uint64_t> publish_errors_{0};      // Publish attempted and rejected by the client
+    // Stats thread only
+    uint64_t reported_publish_count_ = 0;
+    uint64_t reported_publish_ns_ = 0;
+    uint64_t reported_zc_completions_ = 0;
+    uint64_t reported_zc_completion_ns_ = 0;
+    uint64_t reported_time_ns_ = 0;
+    int watched_fd_ = -1;
+    uint32_t watched_events_ = 0;
+};
+
+} // namespace hackrf_mqtt
+
+#endif // MQTT_SINK_H
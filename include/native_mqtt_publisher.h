@@ -0,0 +1,124 @@
+#ifndef NATIVE_MQTT_PUBLISHER_H
+#define NATIVE_MQTT_PUBLISHER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "config_model.h"
+
+namespace hackrf_mqtt {
+
+// Minimal publish-only MQTT client (3.1.1 or 5) for the sample stream.
+//
+// libmosquitto copies every payload into its own packet buffer. This client instead
+// pre-encodes the topic once and hands the fixed header, topic, optional metadata and
+// the caller's sample memory to the kernel in a single sendmsg() (scatter-gather),
+// so no payload byte is copied in user space. Only QoS 0 is supported; subscriptions
+// and control traffic stay on MqttClient.
+//
+// Not thread-safe: use from one thread (the owning sink stage).
+class NativeMqttPublisher {
+public:
+    struct Options {
+        std::string host = "localhost";
+        int port = 1883;
+        std::string client_id;
+        std::string username;
+        std::string password;
+        int keepalive_s = 60;
+        int protocol_version = 4;       // 4 = MQTT 3.1.1, 5 = MQTT 5.0
+        int connect_timeout_ms = 3000;  // TCP connect and CONNACK wait
+        int send_timeout_ms = 5000;     // A stalled broker fails the send (and the connection) after this
+        int reconnect_delay_ms = 2000;
+        MqttSocketConfig socket;        // SO_SNDBUF, TCP_NODELAY/CORK, SO_BUSY_POLL, MSG_ZEROCOPY
+    };
+
+    // Topic name (and, for MQTT 5, the empty property list) encoded once per stream.
+    struct Topic {
+        std::vector<unsigned char> encoded;
+    };
+
+    explicit NativeMqttPublisher(Options options);
+    ~NativeMqttPublisher();
+
+    NativeMqttPublisher(const NativeMqttPublisher&) = delete;
+    NativeMqttPublisher& operator=(const NativeMqttPublisher&) = delete;
+
+    // Blocking connect: TCP, CONNECT, CONNACK. Returns false (and logs) on failure.
+    bool connect();
+    // Sends DISCONNECT and closes the socket.
+    void disconnect();
+    // Closes the socket at once, without DISCONNECT, releasing every zero-copy ticket;
+    // service() reconnects after reconnect_delay_ms. For a connection whose sends stall.
+    void abort_connection();
+    bool is_connected() const { return fd_ >= 0; }
+    int socket_fd() const { return fd_; }
+
+    Topic prepare_topic(const std::string& topic) const;
+
+    // One QoS 0 PUBLISH whose payload is the concatenation of `parts`.
+    // On any send error the connection is closed (a partial packet cannot be resumed).
+    //
+    // With socket.zerocopy, a last part of at least zerocopy_min_bytes is sent with
+    // MSG_ZEROCOPY: the kernel keeps reading that memory after publish() returns.
+    // *zerocopy_ticket is then set to a ticket (0 if the payload was copied), and the
+    // memory must stay untouched until zerocopy_done(ticket). Earlier parts are always copied.
+    bool publish(const Topic& topic, const struct iovec* parts, size_t part_count, bool retain = false,
+                 uint64_t* zerocopy_ticket = nullptr);
+
+    // Reads completion notifications from the socket error queue (non-blocking).
+    void reap_zerocopy_completions();
+    // Waits up to timeout_ms for at least one completion notification, then reaps.
+    void wait_zerocopy_completions(int timeout_ms);
+    bool zerocopy_done(uint64_t ticket) const { return ticket <= zc_completed_; }
+
+    struct ZeroCopyStats {
+        uint64_t sends = 0;       // MSG_ZEROCOPY sendmsg calls
+        uint64_t completed = 0;   // Of those, reported complete (or released by a reconnect)
+        uint64_t copied = 0;      // Completed, but the kernel fell back to copying (e.g. loopback)
+        uint64_t fallbacks = 0;   // Sends retried without MSG_ZEROCOPY (ENOBUFS)
+    };
+    ZeroCopyStats zerocopy_stats() const { return zc_stats_; }
+    // Successful connects, including reconnects. Safe to read from any thread.
+    uint64_t connects() const { return connects_.load(std::memory_order_relaxed); }
+
+    // Drains inbound bytes (PINGRESP), sends PINGREQ when idle and reconnects after
+    // failures once reconnect_delay_ms has passed. Call about once a second.
+    void service();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    bool open_socket();
+    bool read_connack();
+    bool send_iov(struct iovec* iov, size_t count, int flags = 0);
+    bool send_zerocopy(struct iovec part);
+    void mark_zerocopy_range(uint32_t lo, uint32_t hi, bool copied);
+    void close_socket();
+
+    Options options_;
+    int fd_ = -1;
+    Clock::time_point last_send_{};
+    Clock::time_point next_reconnect_{};
+
+    // Zero-copy tickets are global and monotonic across reconnects: the kernel numbers
+    // sends per socket from 0, so ticket = zc_socket_base_ + per-socket id + 1.
+    bool zerocopy_enabled_ = false;
+    uint64_t zc_socket_base_ = 0;
+    uint64_t zc_issued_ = 0;                       // Tickets handed out
+    uint64_t zc_completed_ = 0;                    // Every ticket <= this is complete
+    std::map<uint64_t, uint64_t> zc_out_of_order_; // Completed ranges [first, last] beyond zc_completed_ + 1
+    ZeroCopyStats zc_stats_;
+    std::atomic<uint64_t> connects_{0};
+};
+
+} // namespace hackrf_mqtt
+
+#endif // NATIVE_MQTT_PUBLISHER_H
@@ -0,0 +1,287 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config_model.h"
+#include "metrics.h"
+#include "resequencer.h"
+#include "sample_block.h"
+#include "thread_safe_queue.h"
+#include "work_stealing_pool.h"
+
+namespace hackrf_mqtt {
+
+using BlockQueue = ThreadSafeQueue<SampleBlock>;
+
+// Base class for all pipeline stages (sources, transforms and sinks).
+// A stage receives blocks through process() and forwards results with emit().
+// Sources are never handed blocks; they call emit() from their own context
+// (e.g. the libhackrf callback thread).
+class Stage {
+public:
+    explicit Stage(std::string name) : name_(std::move(name)) {}
+    virtual ~Stage() = default;
+
+    Stage(const Stage&) = delete;
+    Stage& operator=(const Stage&) = delete;
+
+    const std::string& name() const { return name_; }
+
+    virtual bool is_source() const { return false; }
+
+    // Called once before any stage thread starts / after all stage threads joined.
+    virtual bool start() { return true; }
+    virtual void stop() {}
+
+    // Handles one input block. Called from a single thread at a time.
+    virtual void process(SampleBlock&& block) = 0;
+
+    // A dedicated stage may drive its own thread instead of the pipeline's batch-pop loop,
+    // e.g. to wait on sockets next to the input queue's event_fd(). run_event_loop() must
+    // hand every block to `handle` (which accounts stats and calls process()) and return
+    // soon after `running` turns false; the input queue is closed at the same time.
+    using BlockHandler = std::function<void(SampleBlock&&)>;
+    virtual bool has_event_loop() const { return false; }
+    virtual void run_event_loop(BlockQueue& input, const std::atomic<bool>& running, const BlockHandler& handle) {
+        (void)input; (void)running; (void)handle;
+    }
+
+    // Stage-specific figures appended to the periodic stats report, empty for none.
+    // Called from the stats thread while the stage runs, so read atomics only.
+    virtual std::string stats_detail() { return {}; }
+
+    // Liveness heartbeat: monotonic_now_ns() of the latest progress (0 = none yet) and the
+    // number of beats. The pipeline beats for every block a stage finishes; sources beat
+    // once per libhackrf callback, so their beat count is the transfer count.
+    uint64_t last_heartbeat_ns() const { return heartbeat_ns_.load(std::memory_order_relaxed); }
+    uint64_t heartbeats() const { return heartbeats_.load(std::memory_order_relaxed); }
+
+    // Stage-specific metrics (labels already name the device and stage). Called from the
+    // metrics thread while the stage runs, so read atomics only. Unlike stats_detail(),
+    // it must not reset anything: several readers may poll at their own pace.
+    virtual void collect_metrics(MetricsSnapshot& out, const MetricLabels& labels) {
+        (void)out; (void)labels;
+    }
+
+    // Work in flight that the pipeline cannot see, e.g. publishes waiting for broker acks.
+    // Returns a description if it has made no progress for `timeout_ns`, else empty.
+    // Called from the watchdog thread, so read atomics (or take short locks) only.
+    virtual std::string stalled_work(uint64_t now_ns, uint64_t timeout_ns) {
+        (void)now_ns; (void)timeout_ns;
+        return {};
+    }
+
+protected:
+    // Passes a block to every downstream stage (copies only on fan-out).
+    void emit(SampleBlock&& block) {
+        if (output_) output_(std::move(block));
+    }
+
+    void heartbeat(uint64_t now_ns) {
+        heartbeat_ns_.store(now_ns, std::memory_order_relaxed);
+        heartbeats_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    friend class Pipeline;
+    std::string name_;
+    std::function<void(SampleBlock&&)> output_;
+    std::atomic<uint64_t> heartbeat_ns_{0};
+    std::atomic<uint64_t> heartbeats_{0};
+};
+
+// Input that preceded a block, for filters that need overlap across block boundaries.
+struct BlockHistory {
+    const unsigned char* data = nullptr; // Tail of the preceding input, oldest byte first
+    size_t size = 0;                     // Shorter than requested at stream start
+    uint64_t stream_offset = 0;          // Input bytes that preceded this block
+};
+
+// Keeps the last N input bytes and the running input offset between blocks.
+class StreamHistory {
+public:
+    const std::vector<unsigned char>& tail() const { return tail_; }
+    uint64_t stream_offset() const { return stream_offset_; }
+    BlockHistory view() const { return BlockHistory{tail_.data(), tail_.size(), stream_offset_}; }
+    // Appends `input` and keeps only the last keep_bytes of the combined stream.
+    void advance(const std::vector<unsigned char>& input, size_t keep_bytes);
+
+private:
+    std::vector<unsigned char> tail_;
+    uint64_t stream_offset_ = 0;
+};
+
+// A stage whose per-block work can run concurrently (threading "pool").
+// transform() must only read shared state; any dependency on earlier input is
+// expressed through history_bytes(), which the pipeline supplies with each block.
+class ParallelStage : public Stage {
+public:
+    using Stage::Stage;
+
+    // Bytes of preceding input needed to process a block in `format`. 0 = stateless.
+    virtual size_t history_bytes(SampleFormat format) const { (void)format; return 0; }
+    // Appends zero or more output blocks to `out`. May run on several threads at once.
+    virtual void transform(const BlockHistory& history, SampleBlock&& block, std::vector<SampleBlock>& out) const = 0;
+
+    // Serial path used by "dedicated" and "inline" threading.
+    void process(SampleBlock&& block) override;
+
+private:
+    StreamHistory history_;
+    std::vector<SampleBlock> out_;
+};
+
+// Creates stages by their config "type" string.
+class StageFactory {
+public:
+    using Creator = std::function<std::unique_ptr<Stage>(const StageConfig& config)>;
+
+    void register_type(const std::string& type, Creator creator);
+    bool has_type(const std::string& type) const;
+    // Returns nullptr (and logs) if the type is unknown or the creator rejects the config.
+    std::unique_ptr<Stage> create(const StageConfig& config) const;
+
+private:
+    std::map<std::string, Creator> creators_;
+};
+
+// Throughput counters kept per stage, updated with relaxed atomics on the hot path.
+struct StageStats {
+    std::atomic<uint64_t> blocks_in{0};
+    std::atomic<uint64_t> bytes_in{0};
+    std::atomic<uint64_t> blocks_out{0};
+    std::atomic<uint64_t> bytes_out{0};
+    std::atomic<uint64_t> busy_ns{0};  // Time spent processing (summed over workers for pool stages)
+    std::atomic<uint64_t> busy_since_ns{0}; // Start of the process() call in progress, 0 = none
+    // Latency tracing, dedicated stages only: capture time to the push into the input queue
+    // (for the stage after the source, the libhackrf callback to queue hop), and time spent
+    // queued until processing starts.
+    Histogram capture_to_enqueue_ns;
+    Histogram queue_wait_ns;
+};
+
+struct StageStatsSnapshot {
+    std::string name;
+    uint64_t blocks_in = 0;
+    uint64_t bytes_in = 0;
+    uint64_t blocks_out = 0;
+    uint64_t bytes_out = 0;
+    uint64_t busy_ns = 0;
+    QueueStats queue; // Input queue gauges and drops (all zero for inline stages)
+    std::string detail; // Stage::stats_detail()
+};
+
+// A non-source stage that has had work waiting (queued input, a process() call in
+// progress or Stage::stalled_work()) without a heartbeat for the stall timeout.
+struct StageStall {
+    std::string name;
+    uint64_t stalled_ns = 0;     // Since the last heartbeat with work waiting
+    uint64_t busy_ns = 0;        // Inside the current process() call, 0 = not in process()
+    size_t queued = 0;           // Blocks waiting in the input queue
+    std::string detail;          // Stage::stalled_work()
+};
+
+// A DAG of stages wired from PipelineConfig. Every "dedicated" stage owns a
+// bounded input queue and a thread; "inline" stages run on the producer's thread.
+// "pool" stages own an input queue and a dispatcher thread that fans blocks out to
+// the shared WorkStealingPool; a Resequencer re-emits results in input order.
+class Pipeline {
+public:
+    Pipeline() = default;
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // Instantiates and validates the graph (unique names, known outputs, no cycles).
+    bool build(const PipelineConfig& config, const StageFactory& factory);
+    bool start();
+    void stop(); // Stops sources, drains threads, then calls Stage::stop() on every stage
+    bool is_running() const { return running_.load(); }
+
+    Stage* find_stage(const std::string& name) const;
+
+    // Returns the first stage of the given concrete type, or nullptr.
+    template <typename T>
+    T* find_stage_of_type() const {
+        for (const auto& node : nodes_) {
+            if (T* stage = dynamic_cast<T*>(node->stage.get())) return stage;
+        }
+        return nullptr;
+    }
+
+    std::vector<StageStatsSnapshot> stats_snapshot() const;
+    // Non-source stages that stalled for at least `timeout_ns`. An idle stage (nothing
+    // queued) never counts. Call from one watchdog thread only; it keeps per-stage state.
+    std::vector<StageStall> find_stalls(uint64_t now_ns, uint64_t timeout_ns);
+    // Logs per-stage rates since the previous call.
+    void log_stats();
+    // Per-stage counters, queue gauges and drops, plus Stage::collect_metrics().
+    // Does not touch the log_stats() baseline.
+    void collect_metrics(MetricsSnapshot& out, const MetricLabels& labels) const;
+    // Prefixes stage names in the stats log (e.g. with the device name when several run).
+    void set_label(std::string label) { label_ = std::move(label); }
+
+private:
+    struct Node {
+        StageConfig config;
+        std::unique_ptr<Stage> stage;
+        bool dedicated = false;             // Owns an input queue and a thread (also true for pool stages)
+        std::unique_ptr<BlockQueue> input;  // Only for dedicated stages
+        std::vector<Node*> outputs;
+        size_t input_count = 0;
+        std::thread thread;
+        std::atomic<bool> running{false};   // Cleared when stop() reaches this stage
+        StageStats stats;
+        // Watchdog thread only: heartbeat seen at the last check and since when work waited on it.
+        uint64_t watched_heartbeat_ns = 0;
+        uint64_t waiting_since_ns = 0;
+
+        // Pool stages only
+        ParallelStage* parallel = nullptr;
+        std::unique_ptr<Resequencer<std::vector<SampleBlock>>> resequencer;
+        StreamHistory history;
+        uint64_t next_ticket = 0;
+        std::mutex in_flight_mutex;
+        std::condition_variable in_flight_cv;
+        size_t in_flight = 0;
+    };
+
+    void deliver(Node& node, SampleBlock&& block);
+    void deliver_bulk(Node& node, std::vector<SampleBlock>& blocks);
+    void run_process(Node& node, SampleBlock&& block);
+    void record_queue_wait(Node& node, const SampleBlock& block, uint64_t now_ns);
+    void dispatch_to_pool(Node& node, SampleBlock&& block);
+    void forward(Node& node, SampleBlock&& block);
+    void forward_bulk(Node& node, std::vector<SampleBlock>&& blocks);
+    void thread_loop(Node& node);
+
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::vector<Node*> order_;  // Topological order, sources first (stop() walks it)
+    std::unique_ptr<WorkStealingPool> pool_;
+    size_t pool_max_in_flight_ = 0;
+    std::atomic<bool> running_{false};
+    std::vector<StageStatsSnapshot> last_stats_;
+    uint64_t last_stats_time_ns_ = 0;
+    std::string label_;
+};
+
+// Graph equivalent to the original fixed data flow: libhackrf callback -> queue -> MQTT publisher.
+// The sink queue takes its limits and overflow policy from the data_queue_* settings.
+PipelineConfig make_default_pipeline_config(const AppConfig& app_config);
+
+// Input queue options of a dedicated stage.
+QueueOptions queue_options_from_config(const StageConfig& config);
+
+} // namespace hackrf_mqtt
+
+#endif // PIPELINE_H
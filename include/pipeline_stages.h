@@ -0,0 +1,169 @@
+#ifndef PIPELINE_STAGES_H
+#define PIPELINE_STAGES_H
+
+#include <hackrf.h>
+#include <atomic>
+#include <complex>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dsp.h"
+#include "pipeline.h"
+
+namespace hackrf_mqtt {
+
+// Entry point of the graph: the libhackrf RX callback emits each transfer as a block.
+// Pass rx_callback and the stage pointer to HackRFHandler::start_rx.
+// params: {"channel": 0} (stamped into SampleBlock::channel)
+// StageConfig::cpu pins the libhackrf callback thread (on its first callback).
+class HackRFSourceStage : public Stage {
+public:
+    explicit HackRFSourceStage(const StageConfig& config);
+
+    bool is_source() const override { return true; }
+    bool start() override;
+    void stop() override;
+    void process(SampleBlock&& block) override;
+
+    static int rx_callback(hackrf_transfer* transfer);
+
+    // Device tuning as last applied; stamped into every block and used to date its first sample.
+    void set_tuning(uint64_t center_frequency_hz, uint32_t sample_rate_hz);
+    uint32_t sample_rate_hz() const { return sample_rate_hz_.load(std::memory_order_relaxed); }
+    // Live setting changes: a block whose first sample precedes the end of settling is dropped,
+    // or kept with kBlockFlagSettling when mark_only. The first valid block afterwards carries
+    // kBlockFlagDiscontinuity.
+    void set_settle_policy(uint64_t settle_ns, bool mark_only);
+    // Called by the device command thread around each live change. requested_ns is when the
+    // command arrived (monotonic_now_ns), for the command-to-valid-samples latency.
+    void begin_setting_change(uint64_t requested_ns);
+    void end_setting_change(bool needs_settle);
+    // Undoes begin_setting_change() when the change never happened (e.g. a failed reopen).
+    void cancel_setting_change();
+
+    std::string stats_detail() override;
+    void collect_metrics(MetricsSnapshot& out, const MetricLabels& labels) override;
+
+private:
+    std::atomic<bool> accepting_{false};
+    uint32_t channel_;
+    int cpu_;
+    std::thread::id callback_thread_;  // Named/pinned thread; only touched from the libhackrf callback
+    uint64_t next_sequence_ = 0;     // Ditto
+
+    std::atomic<uint64_t> center_frequency_hz_{0};
+    std::atomic<uint32_t> sample_rate_hz_{0};
+    std::atomic<uint64_t> settle_ns_{0};
+    std::atomic<bool> mark_settling_{false};
+    std::atomic<uint64_t> settle_until_ns_{0};   // Blocks starting before this are settling
+    std::atomic<uint64_t> change_requested_ns_{0};
+    std::atomic<uint64_t> change_generation_{0};
+    uint64_t seen_generation_ = 0;               // Callback thread only
+
+    std::atomic<uint64_t> samples_{0};
+    std::atomic<uint64_t> changes_{0};
+    std::atomic<uint64_t> settle_dropped_{0};
+    std::atomic<uint64_t> settle_marked_{0};
+    Histogram valid_latency_ns_;   // Command to first valid block
+};
+
+// Changes sample representation. params: {"to": "int16" | "float32"}
+class ConvertStage : public Stage {
+public:
+    explicit ConvertStage(const StageConfig& config);
+    void process(SampleBlock&& block) override;
+
+private:
+    SampleFormat target_;
+};
+
+// Integer-factor decimation with a low-pass FIR. Output is float32 I/Q.
+// The filter history comes from the preceding block, so blocks can run on the pool.
+// params: {"factor": N, "taps": <default 8 * factor + 1>}
+class DecimateStage : public ParallelStage {
+public:
+    explicit DecimateStage(const StageConfig& config);
+    size_t history_bytes(SampleFormat format) const override;
+    void transform(const BlockHistory& history, SampleBlock&& block, std::vector<SampleBlock>& out) const override;
+
+private:
+    size_t factor_;
+    std::vector<float> taps_;
+};
+
+// Hann-windowed FFT averaged over every full frame of a block; emits one power spectrum (dB) per block.
+// Stateless, so blocks can run on the pool.
+// params: {"size": 1024}
+class FftStage : public ParallelStage {
+public:
+    explicit FftStage(const StageConfig& config);
+    void transform(const BlockHistory& history, SampleBlock&& block, std::vector<SampleBlock>& out) const override;
+
+private:
+    dsp::FftPlan plan_;
+    std::vector<float> window_;
+};
+
+// Appends raw block payloads to a file. params: {"path": "...", "append": false}
+class FileSinkStage : public Stage {
+public:
+    explicit FileSinkStage(const StageConfig& config);
+    bool start() override;
+    void stop() override;
+    void process(SampleBlock&& block) override;
+
+private:
+    std::string path_;
+    bool append_;
+    std::ofstream out_;
+};
+
+// Writes blocks into a POSIX shared-memory ring for local consumers.
+// params: {"name": "/hackrf_mqtt_iq", "size_bytes": 16777216}
+//
+// Layout: ShmRingHeader followed by `capacity` data bytes. Each record is a
+// ShmRecordHeader plus payload, written at write_pos % capacity (wrapping).
+// Readers compare their own position with write_pos to detect overruns.
+class ShmSinkStage : public Stage {
+public:
+    struct ShmRingHeader {
+        char magic[8];                     // "HRFSHM1"
+        uint64_t capacity;                 // Size of the data area in bytes
+        std::atomic<uint64_t> write_pos;   // Total bytes ever written, published with release ordering
+        std::atomic<uint64_t> records;     // Total records written
+    };
+    struct ShmRecordHeader {
+        uint32_t length;   // Payload bytes following this header
+        uint8_t format;    // SampleFormat
+        uint8_t reserved[3];
+        uint64_t sequence;
+    };
+
+    explicit ShmSinkStage(const StageConfig& config);
+    ~ShmSinkStage() override;
+    bool start() override;
+    void stop() override;
+    void process(SampleBlock&& block) override;
+
+private:
+    void write_wrapped(uint64_t pos, const void* src, size_t len);
+
+    std::string shm_name_;
+    size_t size_bytes_;
+    int fd_ = -1;
+    void* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+    ShmRingHeader* header_ = nullptr;
+    unsigned char* ring_ = nullptr;
+};
+
+// Registers hackrf_source, hackrf_sweep (sweep_source.h), convert, decimate, fft, file_sink and shm_sink.
+// Stages that need application objects (e.g. mqtt_sink) are registered by the caller.
+void register_builtin_stages(StageFactory& factory);
+
+} // namespace hackrf_mqtt
+
+#endif // PIPELINE_STAGES_H
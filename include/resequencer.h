@@ -0,0 +1,61 @@
+#ifndef RESEQUENCER_H
+#define RESEQUENCER_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+
+namespace hackrf_mqtt {
+
+// Restores submission order for results that complete out of order (e.g. on the DSP pool).
+// Each job gets a consecutive ticket; complete() buffers early results and releases
+// every result whose predecessors are done, strictly in ticket order.
+template <typename T>
+class Resequencer {
+public:
+    using Release = std::function<void(T&& value)>;
+
+    explicit Resequencer(Release release, uint64_t first_ticket = 0)
+        : release_(std::move(release)), next_ticket_(first_ticket) {}
+
+    Resequencer(const Resequencer&) = delete;
+    Resequencer& operator=(const Resequencer&) = delete;
+
+    // Thread-safe. The release callback runs under the internal lock, so releases never interleave.
+    void complete(uint64_t ticket, T value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ticket != next_ticket_) {
+            pending_.emplace(ticket, std::move(value));
+            if (pending_.size() > high_water_mark_) high_water_mark_ = pending_.size();
+            return;
+        }
+        release_(std::move(value));
+        ++next_ticket_;
+        for (auto it = pending_.begin(); it != pending_.end() && it->first == next_ticket_; it = pending_.erase(it)) {
+            release_(std::move(it->second));
+            ++next_ticket_;
+        }
+    }
+
+    size_t pending() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pending_.size();
+    }
+
+    size_t high_water_mark() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return high_water_mark_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    Release release_;
+    uint64_t next_ticket_;
+    std::map<uint64_t, T> pending_;
+    size_t high_water_mark_ = 0;
+};
+
+} // namespace hackrf_mqtt
+
+#endif // RESEQUENCER_H
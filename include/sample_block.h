@@ -0,0 +1,75 @@
+#ifndef SAMPLE_BLOCK_H
+#define SAMPLE_BLOCK_H
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace hackrf_mqtt {
+
+// Layout of the bytes carried in SampleBlock::data
+enum class SampleFormat : uint8_t {
+    INT8_IQ = 0,         // Interleaved signed 8-bit I/Q, as delivered by libhackrf
+    INT16_IQ = 1,        // Interleaved signed 16-bit I/Q
+    FLOAT32_IQ = 2,      // Interleaved 32-bit float I/Q
+    FLOAT32_POWER_DB = 3, // Power spectrum, one float (dB) per bin
+    SPECTRUM_U8 = 4      // Sweep panorama: spectrum_message.h header, then one byte per bin
+};
+
+inline const char* sample_format_name(SampleFormat format) {
+    switch (format) {
+        case SampleFormat::INT8_IQ: return "int8";
+        case SampleFormat::INT16_IQ: return "int16";
+        case SampleFormat::FLOAT32_IQ: return "float32";
+        case SampleFormat::FLOAT32_POWER_DB: return "power_db";
+        case SampleFormat::SPECTRUM_U8: return "spectrum_u8";
+    }
+    return "unknown";
+}
+
+// Bytes per complex sample (or per bin for spectra)
+inline size_t bytes_per_sample(SampleFormat format) {
+    switch (format) {
+        case SampleFormat::INT8_IQ: return 2;
+        case SampleFormat::INT16_IQ: return 4;
+        case SampleFormat::FLOAT32_IQ: return 8;
+        case SampleFormat::FLOAT32_POWER_DB: return 4;
+        case SampleFormat::SPECTRUM_U8: return 1;
+    }
+    return 1;
+}
+
+// Monotonic timestamp in nanoseconds, used for capture time and stage timing
+inline uint64_t monotonic_now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// SampleBlock::flags
+constexpr uint16_t kBlockFlagDiscontinuity = 1u << 0; // First block after a device setting changed
+constexpr uint16_t kBlockFlagSettling = 1u << 1;      // Captured while the device was settling (kept only
+                                                      // with settle_policy "mark"; otherwise dropped)
+
+// Unit of data flowing between pipeline stages.
+// The payload is owned by the block; stages move blocks along and only copy on fan-out.
+struct SampleBlock {
+    std::vector<unsigned char> data;
+    SampleFormat format = SampleFormat::INT8_IQ;
+    uint64_t sequence = 0;          // Assigned by the source, monotonically increasing
+    uint64_t capture_time_ns = 0;   // monotonic_now_ns() when the source produced the block
+    uint32_t channel = 0;           // Stream id set by the source (hackrf_source param "channel")
+    uint64_t center_frequency_hz = 0; // Tuning the block was captured at (0 = unknown)
+    uint16_t flags = 0;             // kBlockFlag*
+    uint64_t enqueue_time_ns = 0;   // monotonic_now_ns() when last pushed into a stage's input queue
+};
+
+// Memory a queued block holds, charged against ThreadSafeQueue byte budgets
+inline size_t queue_item_bytes(const SampleBlock& block) {
+    return sizeof(SampleBlock) + block.data.capacity();
+}
+
+} // namespace hackrf_mqtt
+
+#endif // SAMPLE_BLOCK_H
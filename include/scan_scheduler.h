@@ -0,0 +1,67 @@
+#ifndef SCAN_SCHEDULER_H
+#define SCAN_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "config_model.h"
+
+namespace hackrf_mqtt {
+
+// Timer thread that hops the receiver across a list of frequencies.
+// Visits are interleaved by smooth weighted round robin on priority, so a priority-2
+// entry comes up twice per cycle, spread out rather than back to back. Hop times are
+// absolute (each one dwell after the previous), so the schedule does not drift with
+// the time the retune itself takes.
+class ScanScheduler {
+public:
+    // Requests a retune; must not block (e.g. queue it on the DeviceCommandExecutor).
+    using HopFn = std::function<void(uint64_t frequency_hz)>;
+
+    ScanScheduler(std::vector<ScanEntry> entries, HopFn hop);
+    ~ScanScheduler();
+
+    ScanScheduler(const ScanScheduler&) = delete;
+    ScanScheduler& operator=(const ScanScheduler&) = delete;
+
+    // False (and logs) if there is nothing to scan.
+    bool start();
+    void stop();
+
+    struct Stats {
+        uint64_t hops = 0;
+        uint64_t late = 0;          // Hops issued more than 1 ms after their scheduled time
+        uint64_t max_late_us = 0;
+    };
+    Stats stats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    size_t next_entry();
+    void run();
+
+    std::vector<ScanEntry> entries_;
+    std::vector<int64_t> current_weight_; // Smooth weighted round robin state
+    int64_t total_weight_ = 0;
+    HopFn hop_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+
+    std::atomic<uint64_t> hops_{0};
+    std::atomic<uint64_t> late_{0};
+    std::atomic<uint64_t> max_late_us_{0};
+};
+
+} // namespace hackrf_mqtt
+
+#endif // SCAN_SCHEDULER_H
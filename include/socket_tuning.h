@@ -0,0 +1,18 @@
+#ifndef SOCKET_TUNING_H
+#define SOCKET_TUNING_H
+
+#include "config_model.h"
+
+namespace hackrf_mqtt {
+
+// Applies SO_SNDBUF, TCP_NODELAY, SO_BUSY_POLL and (when requested) SO_ZEROCOPY to a
+// connected TCP socket. Each failure is logged and skipped. Returns true only if
+// zero-copy was requested and enabled. `label` names the connection in log lines.
+// TCP_CORK is per-packet, so the sender applies it (see set_tcp_cork).
+bool apply_socket_tuning(int fd, const MqttSocketConfig& config, const char* label);
+
+void set_tcp_cork(int fd, bool on);
+
+} // namespace hackrf_mqtt
+
+#endif // SOCKET_TUNING_H
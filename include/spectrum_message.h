@@ -0,0 +1,76 @@
+#ifndef SPECTRUM_MESSAGE_H
+#define SPECTRUM_MESSAGE_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "block_header.h"
+
+namespace hackrf_mqtt {
+
+// Payload of a sweep panorama block (SampleFormat::SPECTRUM_U8), published by hackrf_sweep.
+//
+// 32-byte header, all fields little-endian, followed by one byte per bin:
+//    0  char[4]  magic "HRFS"
+//    4  uint8    version (1)
+//    5  uint8    bin encoding (0: power = -128 dB + 0.5 dB * value; 0 also means "no data")
+//    6  uint16   reserved (0)
+//    8  uint64   start_hz (lower edge of bin 0)
+//   16  uint64   stop_hz (upper edge of the last bin; bin width = (stop_hz - start_hz) / bins)
+//   24  uint32   bins
+//   28  uint32   sweep_duration_us (time the sweep covering this panorama took)
+// Power is in dB relative to full scale, averaged (in linear power) over all FFT bins
+// that fell into the panorama bin during the sweep.
+constexpr size_t kSpectrumHeaderSize = 32;
+constexpr uint8_t kSpectrumVersion = 1;
+constexpr float kSpectrumDbFloor = -128.0f;
+constexpr float kSpectrumDbStep = 0.5f;
+
+struct SpectrumHeaderInfo {
+    uint8_t version = 0;
+    uint8_t encoding = 0;
+    uint64_t start_hz = 0;
+    uint64_t stop_hz = 0;
+    uint32_t bins = 0;
+    uint32_t sweep_duration_us = 0;
+};
+
+inline void encode_spectrum_header(const SpectrumHeaderInfo& info, unsigned char* out) {
+    out[0] = 'H'; out[1] = 'R'; out[2] = 'F'; out[3] = 'S';
+    out[4] = kSpectrumVersion;
+    out[5] = info.encoding;
+    detail::put_le(out + 6, 0, 2);
+    detail::put_le(out + 8, info.start_hz, 8);
+    detail::put_le(out + 16, info.stop_hz, 8);
+    detail::put_le(out + 24, info.bins, 4);
+    detail::put_le(out + 28, info.sweep_duration_us, 4);
+}
+
+// False if the buffer is too short or does not start with the magic.
+inline bool decode_spectrum_header(const unsigned char* in, size_t len, SpectrumHeaderInfo& out) {
+    if (len < kSpectrumHeaderSize || in[0] != 'H' || in[1] != 'R' || in[2] != 'F' || in[3] != 'S') {
+        return false;
+    }
+    out.version = in[4];
+    out.encoding = in[5];
+    out.start_hz = detail::get_le(in + 8, 8);
+    out.stop_hz = detail::get_le(in + 16, 8);
+    out.bins = static_cast<uint32_t>(detail::get_le(in + 24, 4));
+    out.sweep_duration_us = static_cast<uint32_t>(detail::get_le(in + 28, 4));
+    return true;
+}
+
+// Measured power never encodes as 0 (reserved for "no data"); the floor clamps to 1.
+inline uint8_t encode_spectrum_db(float db) {
+    float steps = (db - kSpectrumDbFloor) / kSpectrumDbStep;
+    if (!(steps > 1.0f)) return 1;
+    return steps >= 255.0f ? 255 : static_cast<uint8_t>(steps + 0.5f);
+}
+
+inline float decode_spectrum_db(uint8_t value) {
+    return kSpectrumDbFloor + kSpectrumDbStep * value;
+}
+
+} // namespace hackrf_mqtt
+
+#endif // SPECTRUM_MESSAGE_H
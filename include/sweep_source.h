@@ -0,0 +1,94 @@
+#ifndef SWEEP_SOURCE_H
+#define SWEEP_SOURCE_H
+
+#include <hackrf.h>
+#include <atomic>
+#include <complex>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dsp.h"
+#include "pipeline.h"
+
+namespace hackrf_mqtt {
+
+// Source for the firmware sweep mode (HackRFHandler::start_rx_sweep). The device retunes
+// itself in 20 MHz steps with no host round trip per hop; every 16 KiB block of a transfer
+// is tagged with the frequency it was captured at. Each block is transformed where it
+// arrives and folded into one panorama covering all ranges; a SPECTRUM_U8 block
+// (spectrum_message.h) is emitted each time the sweep wraps to the first range.
+//
+// Uses the tuning of the hackrf_sweep tool: 20 MS/s, LO 7.5 MHz above the tagged
+// frequency, and only the FFT bins 2.5-7.5 MHz either side of the LO (away from the DC
+// spike and the filter edges). The interleaved step pattern fills the gaps in between.
+//
+// params: {"ranges_mhz": [[2400, 2490]], "fft_size": 256, "blocks_per_step": 1, "channel": 0}
+// Each range is widened to a whole number of 20 MHz steps, as hackrf_sweep does.
+// StageConfig::cpu pins the libhackrf callback thread, as for hackrf_source.
+class HackRFSweepSourceStage : public Stage {
+public:
+    static constexpr uint32_t kSampleRateHz = 20000000;
+    static constexpr uint32_t kStepWidthHz = 20000000;
+    static constexpr uint32_t kOffsetHz = 7500000;
+    static constexpr uint32_t kBlockBytes = 16384;
+    static constexpr uint32_t kBasebandFilterHz = 15000000;
+
+    explicit HackRFSweepSourceStage(const StageConfig& config);
+
+    bool is_source() const override { return true; }
+    bool start() override;
+    void stop() override;
+    void process(SampleBlock&& block) override;
+
+    static int rx_callback(hackrf_transfer* transfer);
+
+    // [start, stop] MHz pairs for HackRFHandler::start_rx_sweep, after widening.
+    const std::vector<uint16_t>& frequency_list() const { return frequency_list_mhz_; }
+    uint32_t bytes_per_step() const { return blocks_per_step_ * kBlockBytes; }
+
+    // The sweep restarts (e.g. after the device was reopened): the partial panorama is
+    // discarded and the next one carries kBlockFlagDiscontinuity.
+    void mark_discontinuity() { discontinuity_requested_.store(true, std::memory_order_release); }
+
+    std::string stats_detail() override;
+    void collect_metrics(MetricsSnapshot& out, const MetricLabels& labels) override;
+
+private:
+    void process_step_block(const unsigned char* block, uint64_t frequency_hz);
+    void emit_panorama(uint64_t now_ns);
+
+    std::atomic<bool> accepting_{false};
+    std::atomic<bool> discontinuity_requested_{false};
+    uint32_t channel_;
+    int cpu_;
+    uint32_t blocks_per_step_;
+    std::vector<uint16_t> frequency_list_mhz_;
+    uint64_t start_hz_ = 0;           // Panorama lower edge (lowest range start)
+    uint64_t first_step_hz_ = 0;      // Tag of the first step of each sweep
+    uint32_t bins_ = 0;
+
+    dsp::FftPlan plan_;
+    std::vector<float> window_;
+
+    // Only touched from the libhackrf callback thread.
+    std::thread::id callback_thread_;  // Named/pinned
+    std::vector<std::complex<float>> frame_;
+    std::vector<double> power_sum_;
+    std::vector<uint32_t> power_count_;
+    uint64_t last_step_hz_ = 0;
+    uint64_t sweep_start_ns_ = 0;
+    bool sweep_has_data_ = false;
+    bool discontinuity_ = false;
+    uint64_t next_sequence_ = 0;
+
+    std::atomic<uint64_t> sweeps_{0};
+    std::atomic<uint64_t> blocks_{0};
+    std::atomic<uint64_t> missing_markers_{0};
+    std::atomic<uint64_t> last_sweep_us_{0};
+};
+
+} // namespace hackrf_mqtt
+
+#endif // SWEEP_SOURCE_H
@@ -5,16 +5,87 @@
 #include <mutex>
 #include <condition_variable>
 #include <optional> // For try_pop with timeout or non-blocking
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <algorithm> // For std::transform (string to lower)
+#include <vector>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
 
 #include <iostream> // For potential warning messages
 
 namespace hackrf_mqtt {
 
+// What try_push does when the queue is over its item or byte budget
+enum class OverflowPolicy {
+    DROP_NEWEST,    // Reject the incoming item (original behavior)
+    DROP_OLDEST,    // Evict from the front until the incoming item fits
+    BLOCK,          // Wait up to block_timeout for room, then reject the incoming item
+    KEEP_EVERY_NTH  // While full, admit every Nth incoming item (evicting the oldest), reject the rest
+};
+
+inline OverflowPolicy string_to_overflow_policy(const std::string& policy_str) {
+    std::string lower = policy_str;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+    if (lower == "drop_oldest") return OverflowPolicy::DROP_OLDEST;
+    if (lower == "block") return OverflowPolicy::BLOCK;
+    if (lower == "keep_every_nth") return OverflowPolicy::KEEP_EVERY_NTH;
+    return OverflowPolicy::DROP_NEWEST; // Default if unrecognized
+}
+
+inline const char* overflow_policy_name(OverflowPolicy policy) {
+    switch (policy) {
+        case OverflowPolicy::DROP_NEWEST: return "drop_newest";
+        case OverflowPolicy::DROP_OLDEST: return "drop_oldest";
+        case OverflowPolicy::BLOCK: return "block";
+        case OverflowPolicy::KEEP_EVERY_NTH: return "keep_every_nth";
+    }
+    return "unknown";
+}
+
+struct QueueOptions {
+    size_t max_items = 0;   // 0 = no item limit
+    size_t max_bytes = 0;   // 0 = no byte limit (see queue_item_bytes)
+    OverflowPolicy policy = OverflowPolicy::DROP_NEWEST;
+    std::chrono::milliseconds block_timeout{100}; // BLOCK only
+    size_t keep_every_n = 2;                       // KEEP_EVERY_NTH only
+};
+
+// Occupancy gauges and drop counters, read with stats()
+struct QueueStats {
+    size_t items = 0;
+    size_t bytes = 0;
+    size_t high_water_items = 0;
+    size_t high_water_bytes = 0;
+    uint64_t pushed = 0;
+    uint64_t dropped_newest = 0;  // Incoming items rejected (including BLOCK timeouts)
+    uint64_t dropped_oldest = 0;  // Queued items evicted to make room
+};
+
+// Memory charged for an item against max_bytes. Types that own heap buffers
+// provide an overload in their own namespace (found by argument-dependent lookup).
+template <typename T>
+size_t queue_item_bytes(const T&) {
+    return sizeof(T);
+}
+
 template <typename T>
 class ThreadSafeQueue {
 public:
-    explicit ThreadSafeQueue(size_t max_size = 0) : max_size_(max_size) {} // 0 means unbounded
-    ~ThreadSafeQueue() = default;
+    explicit ThreadSafeQueue(size_t max_size = 0) { options_.max_items = max_size; } // 0 means unbounded
+    explicit ThreadSafeQueue(const QueueOptions& options) : options_(options) {
+        if (options_.keep_every_n == 0) options_.keep_every_n = 1;
+    }
+    ~ThreadSafeQueue() {
+#ifdef __linux__
+        if (event_fd_ >= 0) ::close(event_fd_);
+#endif
+    }
 
     // Rule of five: disable copy/move operations for simplicity
     ThreadSafeQueue(const ThreadSafeQueue&) = delete;
@@ -22,19 +93,34 @@ public:
     ThreadSafeQueue(ThreadSafeQueue&&) = delete;
     ThreadSafeQueue& operator=(ThreadSafeQueue&&) = delete;
 
-    // Returns true if pushed successfully, false if queue was full (for bounded queues)
+    // Returns true if the value was enqueued, false if the overflow policy rejected it
+    // or the queue is closed. Under DROP_OLDEST / KEEP_EVERY_NTH older items may be evicted to admit it.
     bool try_push(T value) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (max_size_ > 0 && queue_.size() >= max_size_) {
-            // Optional: Log a warning, perhaps rate-limited
-            // std::cerr << "Warning: ThreadSafeQueue is full. Discarding new item." << std::endl;
-            return false; // Queue is full
+        std::unique_lock<std::mutex> lock(mutex_);
+        bool pushed = push_locked(lock, std::move(value));
+        if (pushed) {
+            condition_.notify_one();
         }
-        queue_.push(std::move(value));
-        condition_.notify_one();
-        return true;
+        return pushed;
     }
-    
+
+    // Pushes every item of `values` in one critical section (each item still goes through
+    // the overflow policy). Returns the number enqueued; `values` is left empty.
+    size_t try_push_bulk(std::vector<T>& values) {
+        size_t pushed = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (T& value : values) {
+                if (push_locked(lock, std::move(value))) ++pushed;
+            }
+            if (pushed > 0) {
+                condition_.notify_all();
+            }
+        }
+        values.clear();
+        return pushed;
+    }
+
     // Legacy push, for unbounded or when push failure is not critical to signal immediately
     // For bounded queue, this will discard if full.
     void push(T value) {
@@ -51,9 +137,7 @@ public:
     T wait_and_pop() {
         std::unique_lock<std::mutex> lock(mutex_);
         condition_.wait(lock, [this] { return !queue_.empty(); });
-        T value = std::move(queue_.front());
-        queue_.pop();
-        return value;
+        return pop_front_locked();
     }
 
     // Tries to pop an item without waiting. Returns std::nullopt if empty.
@@ -62,22 +146,81 @@ public:
         if (queue_.empty()) {
             return std::nullopt;
         }
-        T value = std::move(queue_.front());
-        queue_.pop();
-        return value;
+        return pop_front_locked();
     }
 
     // Tries to pop an item, waiting up to a specified duration.
-    // Returns std::nullopt if timeout occurs or queue is empty after wait.
+    // Returns std::nullopt if timeout occurs, or the queue is closed, and it is empty after wait.
     template<typename Rep, typename Period>
     std::optional<T> wait_for_and_pop(const std::chrono::duration<Rep, Period>& rel_time) {
         std::unique_lock<std::mutex> lock(mutex_);
-        if (!condition_.wait_for(lock, rel_time, [this] { return !queue_.empty(); })) {
-            return std::nullopt; // Timeout or spurious wake up with empty queue
+        condition_.wait_for(lock, rel_time, [this] { return !queue_.empty() || closed_; });
+        if (queue_.empty()) {
+            return std::nullopt; // Timeout, close() or spurious wake up with empty queue
         }
-        T value = std::move(queue_.front());
-        queue_.pop();
-        return value;
+        return pop_front_locked();
+    }
+
+    // Moves up to max_items items (0 = no limit) and roughly max_bytes bytes (0 = no limit)
+    // into `out` in one critical section. At least one item is taken when available,
+    // even if it alone exceeds max_bytes. Returns the number of items taken.
+    size_t try_pop_batch(std::vector<T>& out, size_t max_items, size_t max_bytes = 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pop_batch_locked(out, max_items, max_bytes);
+    }
+
+    // Like try_pop_batch, but waits up to rel_time for the first item.
+    // Returns immediately (possibly with 0 items) once the queue is closed.
+    template<typename Rep, typename Period>
+    size_t wait_for_pop_batch(std::vector<T>& out, size_t max_items, size_t max_bytes,
+                              const std::chrono::duration<Rep, Period>& rel_time) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait_for(lock, rel_time, [this] { return !queue_.empty() || closed_; });
+        return pop_batch_locked(out, max_items, max_bytes);
+    }
+
+    // Waits (without timeout) for the first item or for close().
+    size_t wait_pop_batch(std::vector<T>& out, size_t max_items, size_t max_bytes = 0) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this] { return !queue_.empty() || closed_; });
+        return pop_batch_locked(out, max_items, max_bytes);
+    }
+
+    // Wakes every waiting consumer and BLOCK producer immediately and rejects further pushes.
+    // Items already queued can still be popped. reopen() undoes it.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            signal_event_fd();
+        }
+        condition_.notify_all();
+        not_full_.notify_all();
+    }
+
+    void reopen() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = false;
+        if (queue_.empty()) clear_event_fd();
+    }
+
+    bool is_closed() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return closed_;
+    }
+
+    // Non-blocking eventfd that is readable exactly while the queue holds items (or is closed),
+    // for use with epoll/poll. Created on first call; -1 where eventfd is unavailable.
+    // Consumers must not read it themselves; the queue drains it when it becomes empty.
+    int event_fd() {
+        std::lock_guard<std::mutex> lock(mutex_);
+#ifdef __linux__
+        if (event_fd_ < 0) {
+            event_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (!queue_.empty() || closed_) signal_event_fd();
+        }
+#endif
+        return event_fd_;
     }
 
     bool empty() const {
@@ -90,11 +233,136 @@ public:
         return queue_.size();
     }
 
+    size_t bytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+    QueueStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        QueueStats snapshot = stats_;
+        snapshot.items = queue_.size();
+        snapshot.bytes = bytes_;
+        return snapshot;
+    }
+
+    const QueueOptions& options() const { return options_; }
+
 private:
-    mutable std::mutex mutex_; 
+    bool push_locked(std::unique_lock<std::mutex>& lock, T value) {
+        if (closed_) {
+            return false;
+        }
+        const size_t item_bytes = queue_item_bytes(value);
+        if (would_overflow(item_bytes)) {
+            switch (options_.policy) {
+                case OverflowPolicy::DROP_NEWEST:
+                    ++stats_.dropped_newest;
+                    return false; // Queue is full
+                case OverflowPolicy::DROP_OLDEST:
+                    evict_until_fits(item_bytes);
+                    break;
+                case OverflowPolicy::BLOCK:
+                    if (!not_full_.wait_for(lock, options_.block_timeout,
+                                            [&] { return closed_ || !would_overflow(item_bytes); }) || closed_) {
+                        ++stats_.dropped_newest;
+                        return false; // Still full after the timeout, or closed while waiting
+                    }
+                    break;
+                case OverflowPolicy::KEEP_EVERY_NTH:
+                    if (++overflow_count_ % options_.keep_every_n != 0) {
+                        ++stats_.dropped_newest;
+                        return false;
+                    }
+                    evict_until_fits(item_bytes);
+                    break;
+            }
+        } else {
+            overflow_count_ = 0;
+        }
+        if (queue_.empty()) {
+            signal_event_fd(); // Empty -> non-empty transition
+        }
+        queue_.push(std::move(value));
+        bytes_ += item_bytes;
+        ++stats_.pushed;
+        stats_.high_water_items = std::max(stats_.high_water_items, queue_.size());
+        stats_.high_water_bytes = std::max(stats_.high_water_bytes, bytes_);
+        return true;
+    }
+
+    size_t pop_batch_locked(std::vector<T>& out, size_t max_items, size_t max_bytes) {
+        size_t taken = 0;
+        size_t taken_bytes = 0;
+        while (!queue_.empty() && (max_items == 0 || taken < max_items)) {
+            size_t item_bytes = queue_item_bytes(queue_.front());
+            if (taken > 0 && max_bytes > 0 && taken_bytes + item_bytes > max_bytes) break;
+            out.push_back(pop_front_locked());
+            taken_bytes += item_bytes;
+            ++taken;
+        }
+        return taken;
+    }
+
+    void signal_event_fd() {
+#ifdef __linux__
+        if (event_fd_ >= 0) {
+            uint64_t one = 1;
+            ssize_t written = ::write(event_fd_, &one, sizeof(one));
+            (void)written; // Only fails if the counter would overflow, i.e. it is already readable
+        }
+#endif
+    }
+
+    void clear_event_fd() {
+#ifdef __linux__
+        if (event_fd_ >= 0) {
+            uint64_t counter;
+            ssize_t read_bytes = ::read(event_fd_, &counter, sizeof(counter));
+            (void)read_bytes; // EAGAIN when already clear
+        }
+#endif
+    }
+
+    // An oversized item is still admitted into an empty queue, otherwise it could never pass.
+    bool would_overflow(size_t item_bytes) const {
+        if (queue_.empty()) return false;
+        if (options_.max_items > 0 && queue_.size() >= options_.max_items) return true;
+        if (options_.max_bytes > 0 && bytes_ + item_bytes > options_.max_bytes) return true;
+        return false;
+    }
+
+    void evict_until_fits(size_t item_bytes) {
+        while (would_overflow(item_bytes)) {
+            bytes_ -= queue_item_bytes(queue_.front());
+            queue_.pop();
+            ++stats_.dropped_oldest;
+        }
+    }
+
+    T pop_front_locked() {
+        T value = std::move(queue_.front());
+        queue_.pop();
+        bytes_ -= queue_item_bytes(value);
+        if (options_.policy == OverflowPolicy::BLOCK) {
+            not_full_.notify_one();
+        }
+        if (queue_.empty() && !closed_) {
+            clear_event_fd();
+        }
+        return value;
+    }
+
+    mutable std::mutex mutex_;
     std::queue<T> queue_;
     std::condition_variable condition_;
-    size_t max_size_; // 0 for unbounded
+    std::condition_variable not_full_; // Only waited on by BLOCK producers
+    QueueOptions options_;
+    size_t bytes_ = 0;
+    uint64_t overflow_count_ = 0;      // KEEP_EVERY_NTH: consecutive items offered while full
+    QueueStats stats_;
+    bool closed_ = false;
+    int event_fd_ = -1;                // Readable while non-empty or closed (see event_fd())
 };
 
 } // namespace hackrf_mqtt
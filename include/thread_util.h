@@ -0,0 +1,17 @@
+#ifndef THREAD_UTIL_H
+#define THREAD_UTIL_H
+
+#include <string>
+
+namespace hackrf_mqtt {
+
+// Pins the calling thread to one CPU. Returns false (and logs) on failure.
+bool pin_current_thread_to_cpu(int cpu);
+
+// Names the calling thread (cut to 15 characters) for top -H, perf and the per-thread CPU
+// metrics (collect_thread_cpu).
+void set_current_thread_name(const std::string& name);
+
+} // namespace hackrf_mqtt
+
+#endif // THREAD_UTIL_H
@@ -0,0 +1,66 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hackrf_mqtt {
+
+// Fixed-size thread pool for independent DSP jobs.
+// Each worker owns a deque: it takes its own work LIFO (cache-warm) and, when idle,
+// steals FIFO from the other workers, so uneven job costs even out across cores.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    // workers == 0 uses std::thread::hardware_concurrency().
+    // cpu_affinity: worker i is pinned to cpu_affinity[i % size()]; empty = no pinning.
+    explicit WorkStealingPool(size_t workers, std::vector<int> cpu_affinity = {});
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void start();
+    // Runs every task already submitted, then joins the workers.
+    void shutdown();
+
+    // Thread-safe. Tasks submitted from a worker go to that worker's own deque.
+    void submit(Task task);
+
+    size_t worker_count() const { return queues_.size(); }
+    uint64_t steal_count() const { return steals_.load(std::memory_order_relaxed); }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void worker_loop(size_t index);
+    bool try_pop_local(size_t index, Task& task);
+    bool try_steal(size_t thief, Task& task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> threads_;
+    std::vector<int> cpu_affinity_;
+
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> next_queue_{0};
+    std::atomic<bool> stopping_{false};
+    std::atomic<uint64_t> steals_{0};
+};
+
+} // namespace hackrf_mqtt
+
+#endif // WORK_STEALING_POOL_H
@@ -1,7 +1,9 @@
 #ifndef CONFIG_MODEL_H
 #define CONFIG_MODEL_H
 
+#include <array>
 #include <string>
+#include <vector>
 #include <cstdint> // For uint64_t, uint32_t
 #include <nlohmann/json.hpp> // Include the nlohmann/json library
 
@@ -16,7 +18,23 @@ struct HackRFConfig {
     uint32_t baseband_filter_bandwidth_hz = 1750000;
     uint32_t lna_gain = 32; // IF gain
     uint32_t vga_gain = 24; // Baseband gain (RX VGA)
-    // bool amp_enable = false; // Typically false for RX
+    bool amp_enable = false; // Typically false for RX
+    uint32_t retune_settle_us = 1000;    // After a live retune, samples captured within this time are not valid
+    std::string settle_policy = "drop";  // Blocks overlapping a setting change: "drop" or "mark" (kBlockFlagSettling)
+    bool skip_redundant_writes = true;   // No USB control transfer when a setting already has the value
+    bool validate_settings = true;       // Reject out-of-range settings before they reach the device
+};
+
+// Socket options for the data connection (see socket_tuning.h).
+// All default to the kernel's behaviour.
+struct MqttSocketConfig {
+    int sndbuf_bytes = 0;              // SO_SNDBUF, 0 = kernel default (autotuned)
+    bool tcp_nodelay = false;          // TCP_NODELAY
+    bool tcp_cork = false;             // "native" transport: cork each PUBLISH so it leaves in full segments
+    int busy_poll_us = 0;              // SO_BUSY_POLL, 0 = off
+    bool zerocopy = false;             // "native" transport: MSG_ZEROCOPY for large payloads (Linux >= 4.14)
+    size_t zerocopy_min_bytes = 16384; // Smaller payloads are copied; pinning pages costs more than copying them
+    size_t zerocopy_max_pending = 64;  // Blocks held until the kernel reports completion before the sink waits
 };
 
 struct MqttConfig {
@@ -25,16 +43,135 @@ struct MqttConfig {
     std::string client_id = "usv_hackrf_transmitter";
     std::string topic = "usv/signals/hackrf_raw_iq";
     std::string control_topic = "usv/hackrf/control"; // New: Topic for control commands
+    std::string control_connection = "separate"; // "separate": control_topic gets its own connection and network
+                                                 // thread (client id <client_id>_ctl, TCP_NODELAY), so commands never
+                                                 // queue behind sample data. "shared": use the data connection.
+    std::string control_response_topic = "usv/hackrf/control/response"; // Command status replies ("" = none)
     int qos = 0;
     int keepalive_s = 60;
     std::string username = ""; // Optional
     std::string password = ""; // Optional
+    std::string network_loop = "threaded"; // "threaded" (libmosquitto's own thread) or "event_loop"
+                                           // (the first dedicated mqtt_sink drives the socket from its epoll loop)
+    std::string data_transport = "mosquitto"; // Sample stream: "mosquitto" (via MqttClient) or "native"
+                                              // (own zero-copy QoS 0 connection per mqtt_sink, see native_mqtt_publisher.h)
+    int native_protocol_version = 4;          // "native" transport: 4 = MQTT 3.1.1, 5 = MQTT 5.0
+    bool block_header = false;                // Prepend the 40-byte block header (block_header.h) to sample payloads
+    MqttSocketConfig socket;                  // Data connection socket tuning
+    size_t data_shards = 1;                   // Connections each mqtt_sink spreads blocks over (> 1: own connections)
+    std::string shard_policy = "round_robin"; // "round_robin" or "channel" (SampleBlock::channel % data_shards)
+    size_t inflight_window = 64;              // QoS 1/2: unacknowledged messages per connection, 0 = unbounded
+    int inflight_wait_ms = 1000;              // Window full: how long a publish waits for an ack before the block is
+                                              // dropped (0 = drop at once). While it waits, the sink's input queue
+                                              // fills and its overflow_policy applies.
+    std::string stats_topic = "usv/hackrf/stats"; // Metrics snapshot as JSON (see metrics.h), "" = off
+    int stats_interval_s = 10;                // Between snapshots on stats_topic
+};
+
+// One node of the processing graph (see pipeline.h)
+struct StageConfig {
+    std::string name;                    // Unique stage name, referenced by "outputs"
+    std::string type;                    // e.g. "hackrf_source", "convert", "decimate", "fft", "mqtt_sink", "file_sink", "shm_sink"
+    std::string threading = "dedicated"; // "dedicated" (own thread + input queue), "inline" (runs on the producer's thread)
+                                         // or "pool" (blocks processed in parallel on the DSP pool, output kept in order)
+    size_t queue_max_size = 100;         // Input queue item bound for dedicated stages, 0 = unbounded
+    size_t queue_max_bytes = 0;          // Input queue memory bound in bytes, 0 = unbounded
+    std::string overflow_policy = "drop_newest"; // "drop_newest", "drop_oldest", "block" or "keep_every_nth"
+    int block_timeout_ms = 100;          // "block": longest a producer waits for room
+    size_t keep_every_n = 2;             // "keep_every_nth": admit 1 of N blocks while full
+    size_t batch_max_items = 16;         // Blocks taken from the input queue per lock acquisition, 0 = all
+    size_t batch_max_bytes = 0;          // Byte cap per batch, 0 = none
+    std::vector<std::string> outputs;    // Downstream stage names
+    nlohmann::json params = nlohmann::json::object(); // Stage-specific parameters
+    int cpu = -1;                        // Pin the stage's thread (for sources: the libhackrf callback thread), -1 = no pinning
+};
+
+// Shared work-stealing pool used by stages with threading "pool"
+struct DspPoolConfig {
+    size_t workers = 0;              // 0 = one per hardware thread
+    std::vector<int> cpu_affinity;   // Worker i pinned to cpu_affinity[i % size]; empty = no pinning
+    size_t max_in_flight = 0;        // Blocks in flight per pool stage, 0 = 2 x workers
+};
+
+struct PipelineConfig {
+    std::vector<StageConfig> stages; // Empty: default graph hackrf_source -> mqtt_sink
+    DspPoolConfig pool;
+    int stats_interval_s = 10;       // Per-stage throughput log period, 0 disables
+};
+
+// One stop of the frequency-hopping scan (see scan_scheduler.h)
+struct ScanEntry {
+    uint64_t frequency_hz = 0;
+    uint32_t dwell_ms = 100;  // Time tuned here per visit, settle time included
+    uint32_t priority = 1;    // Relative visit rate: priority 3 is visited three times as often as priority 1
+};
+
+struct ScanConfig {
+    bool enabled = false;
+    std::vector<ScanEntry> entries;
+};
+
+// Firmware sweep mode (see sweep_source.h). Replaces the IQ stream while enabled.
+struct SweepConfig {
+    bool enabled = false;
+    std::vector<std::array<uint32_t, 2>> ranges_mhz = {{2400, 2490}}; // Up to 10 [start, stop] ranges
+    uint32_t fft_size = 256;         // Per tuning step; power of two, 16-4096 (bin width = 20 MHz / fft_size)
+    uint32_t blocks_per_step = 1;    // 16 KiB sample blocks captured at each tuning step
+    std::string topic = "usv/signals/hackrf_spectrum";
+};
+
+// Watchdog (see device_supervisor.h): per-stage liveness checks, and reopening a device
+// whose stream stopped.
+struct RecoveryConfig {
+    bool enabled = true;               // Reopen stalled devices (the checks and reports always run)
+    uint32_t stall_timeout_ms = 300;   // No libhackrf callback for this long while streaming = stalled
+                                       // (raised to 4 transfers if the sample rate needs more)
+    uint32_t check_interval_ms = 50;
+    uint32_t retry_interval_ms = 500;  // Between failed reopen attempts (e.g. while the device is unplugged)
+    uint32_t stage_stall_timeout_ms = 2000; // A stage with work waiting and no heartbeat for this long = stalled
+    std::string stage_stall_action = "report"; // "report" (log and event) or "abort" (for a service manager to restart)
+    double min_rate_ratio = 0.5;       // Report the source below this fraction of the transfer rate
+                                       // sample_rate_hz implies, 0 = off
+    uint32_t rate_window_ms = 2000;    // Window the source rate is measured over
+    std::string status_topic = "usv/hackrf/status"; // Stall and recovery events as JSON ("" = log only)
+};
+
+// Prometheus endpoint (see metrics_http_server.h). The stats topic is configured in MqttConfig.
+struct MetricsConfig {
+    bool http_enabled = false;
+    std::string http_bind = "127.0.0.1"; // Listen address, "0.0.0.0" to allow remote scrapes
+    uint16_t http_port = 9464;
+};
+
+// One HackRF of a multi-device setup (AppConfig::devices). Each device gets its own handler,
+// pipeline, queues, command executor and topics. Keys left out take the built-in defaults,
+// not the top-level hackrf/pipeline/scan/sweep sections.
+struct DeviceConfig {
+    std::string name;            // Unique; used in logs, MQTT client ids and the "device" field of control commands
+    std::string serial;          // Opened with hackrf_open_by_serial ("" = first device found)
+    std::string topic_prefix;    // Data to <prefix>/iq, sweep panoramas to <prefix>/spectrum ("" = mqtt.topic / sweep.topic)
+    HackRFConfig hackrf;
+    PipelineConfig pipeline;     // Empty stages: default graph
+    ScanConfig scan;
+    SweepConfig sweep;
+    int rx_cpu = -1;             // Default graph: pin the libhackrf callback thread, -1 = no pinning
+    int publisher_cpu = -1;      // Default graph: pin the mqtt_sink thread, -1 = no pinning
 };
 
 struct AppConfig {
     HackRFConfig hackrf;
     MqttConfig mqtt;
+    PipelineConfig pipeline;
+    ScanConfig scan;
+    SweepConfig sweep;
+    std::vector<DeviceConfig> devices; // Empty: one device from the hackrf/pipeline/scan/sweep sections above
+    RecoveryConfig recovery;
+    MetricsConfig metrics;
     size_t data_queue_max_size = 100; 
+    size_t data_queue_max_bytes = 0;  // Memory budget of the default pipeline's queue, 0 = unbounded
+    std::string data_queue_overflow_policy = "drop_newest"; // See StageConfig::overflow_policy
+    int data_queue_block_timeout_ms = 100;
+    size_t data_queue_keep_every_n = 2;
     std::string log_level = "INFO"; // New: Logging level (e.g., "DEBUG", "INFO", "WARNING", "ERROR")
 };
 
@@ -42,29 +179,136 @@ struct AppConfig {
 // Helper macros or functions to map struct members to JSON keys.
 // NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE is used for structs that don't have
 // to_json/from_json member functions. It requires the members to be public.
+// The _WITH_DEFAULT variant keeps the struct default for keys missing from config.json,
+// so older config files stay valid as new options are added.
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(HackRFConfig,
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(HackRFConfig,
                                    center_frequency_hz,
                                    sample_rate_hz,
                                    baseband_filter_bandwidth_hz,
                                    lna_gain,
-                                   vga_gain)
+                                   vga_gain,
+                                   amp_enable,
+                                   retune_settle_us,
+                                   settle_policy,
+                                   skip_redundant_writes,
+                                   validate_settings)
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(MqttSocketConfig,
+                                   sndbuf_bytes,
+                                   tcp_nodelay,
+                                   tcp_cork,
+                                   busy_poll_us,
+                                   zerocopy,
+                                   zerocopy_min_bytes,
+                                   zerocopy_max_pending)
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(MqttConfig,
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(MqttConfig,
                                    broker_host,
                                    broker_port,
                                    client_id,
                                    topic,
                                    control_topic, // New
+                                   control_connection,
+                                   control_response_topic,
                                    qos,
                                    keepalive_s,
                                    username,
-                                   password)
+                                   password,
+                                   network_loop,
+                                   data_transport,
+                                   native_protocol_version,
+                                   block_header,
+                                   socket,
+                                   data_shards,
+                                   shard_policy,
+                                   inflight_window,
+                                   inflight_wait_ms,
+                                   stats_topic,
+                                   stats_interval_s)
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(StageConfig,
+                                   name,
+                                   type,
+                                   threading,
+                                   queue_max_size,
+                                   queue_max_bytes,
+                                   overflow_policy,
+                                   block_timeout_ms,
+                                   keep_every_n,
+                                   batch_max_items,
+                                   batch_max_bytes,
+                                   outputs,
+                                   params,
+                                   cpu)
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(DspPoolConfig,
+                                   workers,
+                                   cpu_affinity,
+                                   max_in_flight)
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(PipelineConfig,
+                                   stages,
+                                   pool,
+                                   stats_interval_s)
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(ScanEntry,
+                                   frequency_hz,
+                                   dwell_ms,
+                                   priority)
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(ScanConfig,
+                                   enabled,
+                                   entries)
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(SweepConfig,
+                                   enabled,
+                                   ranges_mhz,
+                                   fft_size,
+                                   blocks_per_step,
+                                   topic)
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(RecoveryConfig,
+                                   enabled,
+                                   stall_timeout_ms,
+                                   check_interval_ms,
+                                   retry_interval_ms,
+                                   stage_stall_timeout_ms,
+                                   stage_stall_action,
+                                   min_rate_ratio,
+                                   rate_window_ms,
+                                   status_topic)
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(MetricsConfig,
+                                   http_enabled,
+                                   http_bind,
+                                   http_port)
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(DeviceConfig,
+                                   name,
+                                   serial,
+                                   topic_prefix,
+                                   hackrf,
+                                   pipeline,
+                                   scan,
+                                   sweep,
+                                   rx_cpu,
+                                   publisher_cpu)
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(AppConfig,
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(AppConfig,
                                    hackrf,
                                    mqtt,
+                                   pipeline,
+                                   scan,
+                                   sweep,
+                                   devices,
+                                   recovery,
+                                   metrics,
                                    data_queue_max_size,
+                                   data_queue_max_bytes,
+                                   data_queue_overflow_policy,
+                                   data_queue_block_timeout_ms,
+                                   data_queue_keep_every_n,
                                    log_level) // New
 
 } // namespace hackrf_mqtt
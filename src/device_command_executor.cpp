@@ -0,0 +1,167 @@
+#include "device_command_executor.h"
+#include "logger.h"
+#include "thread_util.h"
+
+#include <exception>
+
+namespace hackrf_mqtt {
+
+namespace {
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+}
+}
+
+DeviceCommandExecutor::DeviceCommandExecutor(CompletionFn on_complete)
+    : on_complete_(std::move(on_complete)) {
+}
+
+DeviceCommandExecutor::~DeviceCommandExecutor() {
+    stop();
+}
+
+void DeviceCommandExecutor::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    stopping_ = false;
+    thread_ = std::thread([this] { run(); });
+    LOG_INFO("Device command executor started.");
+}
+
+void DeviceCommandExecutor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        stopping_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+    LOG_INFO("Device command executor stopped.");
+}
+
+void DeviceCommandExecutor::submit(std::string command, std::string coalesce_key, Action action, std::string request_id,
+                                   bool report) {
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+    Completion replaced;
+    bool have_replaced = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_ || stopping_) {
+            replaced.command = std::move(command);
+            replaced.request_id = std::move(request_id);
+            replaced.message = "device command executor is not running";
+            replaced.report = report;
+            failed_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            Pending pending{std::move(command), std::move(coalesce_key), std::move(request_id), std::move(action),
+                            Clock::now(), report};
+            auto existing = pending_.end();
+            if (!pending.coalesce_key.empty()) {
+                for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+                    if (it->coalesce_key == pending.coalesce_key) {
+                        existing = it;
+                        break;
+                    }
+                }
+            }
+            if (existing != pending_.end()) {
+                // Keep the queue position (and thus ordering against other keys), take the newer command.
+                replaced.command = std::move(existing->command);
+                replaced.request_id = std::move(existing->request_id);
+                replaced.superseded = true;
+                replaced.report = existing->report;
+                replaced.message = "superseded by a newer '" + pending.command + "'";
+                replaced.queue_wait_ns = elapsed_ns(existing->submitted, pending.submitted);
+                pending.submitted = existing->submitted;
+                *existing = std::move(pending);
+                coalesced_.fetch_add(1, std::memory_order_relaxed);
+                have_replaced = true;
+            } else {
+                pending_.push_back(std::move(pending));
+                cv_.notify_one();
+                return;
+            }
+        }
+    }
+    if (!have_replaced) {
+        LOG_WARN("Device command '", replaced.command, "' rejected: ", replaced.message);
+    }
+    complete(replaced);
+}
+
+DeviceCommandExecutor::Stats DeviceCommandExecutor::stats() const {
+    Stats stats;
+    stats.submitted = submitted_.load(std::memory_order_relaxed);
+    stats.executed = executed_.load(std::memory_order_relaxed);
+    stats.coalesced = coalesced_.load(std::memory_order_relaxed);
+    stats.failed = failed_.load(std::memory_order_relaxed);
+    stats.total_run_ns = total_run_ns_.load(std::memory_order_relaxed);
+    stats.max_queue_wait_ns = max_queue_wait_ns_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void DeviceCommandExecutor::run() {
+    set_current_thread_name("executor");
+    for (;;) {
+        Pending pending;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+            if (pending_.empty()) {
+                return; // stopping_ and drained
+            }
+            pending = std::move(pending_.front());
+            pending_.pop_front();
+        }
+
+        Completion completion;
+        completion.command = std::move(pending.command);
+        completion.request_id = std::move(pending.request_id);
+        completion.report = pending.report;
+        auto started = Clock::now();
+        completion.queue_wait_ns = elapsed_ns(pending.submitted, started);
+        try {
+            Result result = pending.action();
+            completion.ok = result.ok;
+            completion.message = std::move(result.message);
+        } catch (const std::exception& e) {
+            completion.ok = false;
+            completion.message = e.what();
+        }
+        completion.run_ns = elapsed_ns(started, Clock::now());
+
+        executed_.fetch_add(1, std::memory_order_relaxed);
+        if (!completion.ok) {
+            failed_.fetch_add(1, std::memory_order_relaxed);
+            LOG_WARN("Device command '", completion.command, "' failed: ", completion.message);
+        }
+        total_run_ns_.fetch_add(completion.run_ns, std::memory_order_relaxed);
+        uint64_t prev_max = max_queue_wait_ns_.load(std::memory_order_relaxed);
+        while (completion.queue_wait_ns > prev_max &&
+               !max_queue_wait_ns_.compare_exchange_weak(prev_max, completion.queue_wait_ns)) {
+        }
+        complete(completion);
+    }
+}
+
+void DeviceCommandExecutor::complete(const Completion& completion) {
+    if (!on_complete_) {
+        return;
+    }
+    try {
+        on_complete_(completion);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Device command completion handler threw: ", e.what());
+    }
+}
+
+} // namespace hackrf_mqtt
@@ -0,0 +1,621 @@
+#include "device_session.h"
+#include "logger.h"
+#include "pipeline_stages.h"
+#include "sweep_source.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+namespace hackrf_mqtt {
+
+namespace {
+
+using DeviceResult = DeviceCommandExecutor::Result;
+
+// Live-settable HackRFConfig fields and the range each accepts (the HackRFHandler limits).
+struct SettingRange {
+    double min;
+    double max;
+};
+const std::map<std::string, SettingRange> kDeviceSettingLimits = {
+    {"center_frequency_hz", {1000000.0, 7250000000.0}},
+    {"sample_rate_hz", {1000000.0, 20000000.0}},
+    {"baseband_filter_bandwidth_hz", {1750000.0, 28000000.0}},
+    {"lna_gain", {0.0, 40.0}},
+    {"vga_gain", {0.0, 62.0}},
+    {"amp_enable", {0.0, 1.0}},
+};
+
+// Single-setting control commands and the field each one sets.
+const std::map<std::string, std::string> kSettingCommands = {
+    {"set_frequency", "center_frequency_hz"},
+    {"set_sample_rate", "sample_rate_hz"},
+    {"set_baseband_filter_bandwidth", "baseband_filter_bandwidth_hz"},
+    {"set_lna_gain", "lna_gain"},
+    {"set_vga_gain", "vga_gain"},
+    {"set_amp_enable", "amp_enable"},
+};
+
+// Checks one setting from a control command and adds it to `patch` (a partial HackRFConfig).
+bool validate_device_setting(const std::string& field, const nlohmann::json& value,
+                             nlohmann::json& patch, std::string& error) {
+    auto limit = kDeviceSettingLimits.find(field);
+    if (limit == kDeviceSettingLimits.end()) {
+        error = "'" + field + "' cannot be changed live";
+        return false;
+    }
+    if (field == "amp_enable" && value.is_boolean()) {
+        patch[field] = value.get<bool>();
+        return true;
+    }
+    const SettingRange& range = limit->second;
+    if (!value.is_number() || value.get<double>() < range.min || value.get<double>() > range.max) {
+        error = "'" + field + "' must be a number from " + std::to_string(static_cast<uint64_t>(range.min)) +
+                " to " + std::to_string(static_cast<uint64_t>(range.max));
+        return false;
+    }
+    if (field == "amp_enable") {
+        patch[field] = value.get<double>() != 0.0;
+    } else {
+        patch[field] = static_cast<uint64_t>(value.get<double>());
+    }
+    return true;
+}
+
+} // namespace
+
+HackRFHandler::ApplyResult apply_live_settings(HackRFHandler& handler, HackRFSourceStage& source,
+                                               const HackRFConfig& target, HackRFConfig& current,
+                                               uint64_t requested_ns) {
+    bool began = false;
+    HackRFHandler::ApplyResult result = handler.apply_config(target, current, [&] {
+        source.begin_setting_change(requested_ns);
+        began = true;
+    });
+    if (result.applied > 0) {
+        source.set_tuning(current.center_frequency_hz, current.sample_rate_hz);
+        source.end_setting_change(result.retuned);
+    } else if (began) {
+        // The first write failed, so nothing changed: blocks are valid again at once.
+        source.cancel_setting_change();
+    }
+    return result;
+}
+
+DeviceSession::DeviceSession(const DeviceConfig& device, const AppConfig& app, bool multi_device,
+                             DeviceCommandExecutor::CompletionFn on_complete, EventFn on_event)
+    : name_(device.name),
+      multi_device_(multi_device),
+      config_(app),
+      rx_cpu_(device.rx_cpu),
+      publisher_cpu_(device.publisher_cpu),
+      handler_(device.serial),
+      executor_(std::move(on_complete)),
+      on_event_(std::move(on_event)) {
+    config_.hackrf = device.hackrf;
+    config_.pipeline = device.pipeline;
+    config_.scan = device.scan;
+    config_.sweep = device.sweep;
+    config_.devices.clear();
+    if (!device.topic_prefix.empty()) {
+        config_.mqtt.topic = device.topic_prefix + "/iq";
+        config_.sweep.topic = device.topic_prefix + "/spectrum";
+    }
+    if (multi_device_) {
+        // Own connections of this device's sinks (shards, native transport) get distinct client ids.
+        config_.mqtt.client_id += "_" + name_;
+    }
+    handler_.set_write_policy(config_.hackrf.skip_redundant_writes, config_.hackrf.validate_settings);
+    device_settings_ = config_.hackrf;
+}
+
+DeviceSession::~DeviceSession() {
+    shutdown();
+}
+
+std::string DeviceSession::stats_tag(const std::string& what) const {
+    return multi_device_ ? name_ + "/" + what : what;
+}
+
+bool DeviceSession::build(const StageFactory& factory) {
+    PipelineConfig pipeline_config = config_.pipeline;
+    if (pipeline_config.stages.empty()) {
+        // No explicit graph: keep the classic callback -> queue -> publisher flow.
+        pipeline_config.stages = make_default_pipeline_config(config_).stages;
+        pipeline_config.stages[0].cpu = rx_cpu_;
+        pipeline_config.stages[1].cpu = publisher_cpu_;
+    }
+    if (multi_device_) {
+        pipeline_.set_label(name_);
+    }
+    if (!pipeline_.build(pipeline_config, factory)) {
+        LOG_ERROR("Device '", name_, "': Failed to build processing pipeline from configuration.");
+        return false;
+    }
+    rx_source_ = pipeline_.find_stage_of_type<HackRFSourceStage>();
+    sweep_source_ = pipeline_.find_stage_of_type<HackRFSweepSourceStage>();
+    if (!rx_source_ == !sweep_source_) {
+        LOG_ERROR("Device '", name_, "': Pipeline needs exactly one 'hackrf_source' or 'hackrf_sweep' stage.");
+        return false;
+    }
+    if (sweep_source_ && config_.scan.enabled) {
+        LOG_WARN("Scan: Disabled on '", name_, "'; the firmware sweep already retunes the device.");
+        config_.scan.enabled = false;
+    }
+
+    // Frequency-hopping scan: hops go through the executor like any other retune, so they
+    // serialize with control commands and a slow device coalesces them instead of queueing.
+    if (config_.scan.enabled) {
+        scanner_ = std::make_unique<ScanScheduler>(config_.scan.entries, [this](uint64_t frequency_hz) {
+            nlohmann::json patch = {{"center_frequency_hz", frequency_hz}};
+            executor_.submit("scan_hop", "scan_hop", make_settings_action(std::move(patch), monotonic_now_ns()),
+                             "", false);
+        });
+        // A dwell yields valid samples only if a whole libhackrf transfer fits after settling,
+        // and hops land at arbitrary points within a transfer.
+        double transfer_ms = HackRFHandler::kTransferBytes / 2.0 / config_.hackrf.sample_rate_hz * 1000.0;
+        for (const auto& entry : config_.scan.entries) {
+            if (entry.dwell_ms < 2 * transfer_ms + config_.hackrf.retune_settle_us / 1000.0) {
+                LOG_WARN("Scan: dwell ", entry.dwell_ms, " ms at ", entry.frequency_hz / 1e6,
+                         " MHz is under two transfers (", 2 * transfer_ms, " ms) plus settle time; expect few valid blocks.");
+            }
+        }
+    }
+    return true;
+}
+
+bool DeviceSession::start_pipeline() {
+    if (!pipeline_.start()) {
+        LOG_ERROR("Device '", name_, "': Failed to start processing pipeline.");
+        return false;
+    }
+    return true;
+}
+
+bool DeviceSession::open() {
+    executor_.start();
+
+    LOG_INFO("Initializing HackRF '", name_, "'...");
+    if (!handler_.init()) {
+        LOG_ERROR("Failed to initialize HackRF '", name_, "'.");
+        return false;
+    }
+
+    if (sweep_source_) {
+        // Sweep mode runs at the fixed rate its bin mapping assumes; the firmware sets the frequency.
+        device_settings_.sample_rate_hz = HackRFSweepSourceStage::kSampleRateHz;
+        device_settings_.baseband_filter_bandwidth_hz = HackRFSweepSourceStage::kBasebandFilterHz;
+        LOG_INFO("Sweep mode: ", sweep_source_->frequency_list().size() / 2, " range(s) at ",
+                 device_settings_.sample_rate_hz / 1e6, " MS/s, publishing to ", config_.sweep.topic);
+    }
+    write_settings();
+    if (rx_source_) {
+        rx_source_->set_tuning(config_.hackrf.center_frequency_hz, config_.hackrf.sample_rate_hz);
+        if (config_.hackrf.settle_policy != "drop" && config_.hackrf.settle_policy != "mark") {
+            LOG_WARN("Unknown hackrf.settle_policy '", config_.hackrf.settle_policy, "'; using 'drop'.");
+        }
+        rx_source_->set_settle_policy(uint64_t(config_.hackrf.retune_settle_us) * 1000,
+                                      config_.hackrf.settle_policy == "mark");
+    }
+    return true;
+}
+
+bool DeviceSession::write_settings() {
+    // Writes every applied setting; used on open and after a reopen, when the cache is empty.
+    // In sweep mode the firmware sets the frequency.
+    bool ok = true;
+    if (!sweep_source_) {
+        ok = handler_.set_frequency(device_settings_.center_frequency_hz) && ok;
+    }
+    ok = handler_.set_sample_rate(device_settings_.sample_rate_hz) && ok;
+    ok = handler_.set_baseband_filter_bandwidth(device_settings_.baseband_filter_bandwidth_hz) && ok;
+    LOG_INFO("Setting LNA gain to: ", device_settings_.lna_gain, " dB");
+    ok = handler_.set_lna_gain(device_settings_.lna_gain) && ok;
+    LOG_INFO("Setting VGA gain to: ", device_settings_.vga_gain, " dB");
+    ok = handler_.set_vga_gain(device_settings_.vga_gain) && ok;
+    ok = handler_.set_amp_enable(device_settings_.amp_enable) && ok;
+    return ok;
+}
+
+bool DeviceSession::reopen() {
+    LOG_INFO("HackRF '", name_, "': reopening the device.");
+    if (rx_source_) {
+        rx_source_->begin_setting_change(monotonic_now_ns());
+    }
+    if (!handler_.init() || !write_settings()) {
+        handler_.deinit();
+        if (rx_source_) {
+            rx_source_->cancel_setting_change();
+        }
+        return false;
+    }
+    if (rx_source_) {
+        rx_source_->set_tuning(device_settings_.center_frequency_hz, device_settings_.sample_rate_hz);
+        rx_source_->end_setting_change(true);
+    } else {
+        sweep_source_->mark_discontinuity();
+    }
+    return true;
+}
+
+bool DeviceSession::start_rx() {
+    // Starts RX in the mode the pipeline was built for (IQ stream or firmware sweep).
+    bool started = sweep_source_
+        ? handler_.start_rx_sweep(sweep_source_->frequency_list(), sweep_source_->bytes_per_step(),
+                                  HackRFSweepSourceStage::kStepWidthHz, HackRFSweepSourceStage::kOffsetHz,
+                                  HackRFSweepSourceStage::rx_callback, sweep_source_)
+        : handler_.start_rx(HackRFSourceStage::rx_callback, rx_source_);
+    if (started) {
+        stream_started_ns_.store(monotonic_now_ns(), std::memory_order_relaxed);
+    }
+    return started;
+}
+
+Stage* DeviceSession::source_stage() const {
+    return rx_source_ ? static_cast<Stage*>(rx_source_) : static_cast<Stage*>(sweep_source_);
+}
+
+uint32_t DeviceSession::source_sample_rate_hz() const {
+    return rx_source_ ? rx_source_->sample_rate_hz() : HackRFSweepSourceStage::kSampleRateHz;
+}
+
+void DeviceSession::publish_event(nlohmann::json event) {
+    if (on_event_) {
+        event["device"] = name_;
+        on_event_(event);
+    }
+}
+
+void DeviceSession::check_stages(uint64_t now_ns) {
+    std::vector<StageStall> stalls =
+        pipeline_.find_stalls(now_ns, uint64_t(config_.recovery.stage_stall_timeout_ms) * 1000000);
+    std::set<std::string> stalled;
+    for (const StageStall& stall : stalls) {
+        stalled.insert(stall.name);
+        if (stalled_stages_.count(stall.name)) {
+            continue; // Reported when it began
+        }
+        stage_stalls_.fetch_add(1, std::memory_order_relaxed);
+        std::string what = !stall.detail.empty() ? stall.detail
+                         : stall.busy_ns > 0     ? "inside process() for " + std::to_string(stall.busy_ns / 1000000) + " ms"
+                                                 : "no block taken for " + std::to_string(stall.stalled_ns / 1000000) + " ms";
+        LOG_ERROR("Watchdog: Stage '", stall.name, "' stalled with ", stall.queued, " blocks queued: ", what, ".");
+        publish_event({{"event", "stage_stalled"}, {"stage", stall.name}, {"stalled_ms", stall.stalled_ns / 1000000},
+                       {"queued", stall.queued}, {"detail", what}});
+        if (config_.recovery.stage_stall_action == "abort") {
+            LOG_ERROR("Watchdog: Aborting (recovery.stage_stall_action is 'abort').");
+            logger::flush();
+            std::abort();
+        }
+    }
+    for (const std::string& name : stalled_stages_) {
+        if (!stalled.count(name)) {
+            LOG_INFO("Watchdog: Stage '", name, "' is making progress again.");
+            publish_event({{"event", "stage_resumed"}, {"stage", name}});
+        }
+    }
+    stalled_stages_ = std::move(stalled);
+}
+
+void DeviceSession::check_source_rate(uint64_t now_ns) {
+    // One callback per USB transfer, so the sample rate fixes the callback rate. Fewer
+    // callbacks mean the USB link or the host is losing data before the pipeline sees it.
+    uint64_t heartbeats = source_stage()->heartbeats();
+    if (rate_window_start_ns_ == 0 || stream_started_ns_.load(std::memory_order_relaxed) > rate_window_start_ns_) {
+        rate_window_start_ns_ = now_ns; // New window after a (re)start
+        rate_window_heartbeats_ = heartbeats;
+        return;
+    }
+    uint64_t elapsed_ns = now_ns - rate_window_start_ns_;
+    if (elapsed_ns < uint64_t(config_.recovery.rate_window_ms) * 1000000) {
+        return;
+    }
+    double rate = (heartbeats - rate_window_heartbeats_) * 1e9 / elapsed_ns;
+    double expected = source_sample_rate_hz() * 2.0 / HackRFHandler::kTransferBytes;
+    rate_window_start_ns_ = now_ns;
+    rate_window_heartbeats_ = heartbeats;
+    source_rate_milli_.store(static_cast<uint64_t>(rate * 1000), std::memory_order_relaxed);
+    expected_rate_milli_.store(static_cast<uint64_t>(expected * 1000), std::memory_order_relaxed);
+    if (config_.recovery.min_rate_ratio <= 0.0 || expected <= 0.0) {
+        return;
+    }
+    bool slow = rate < expected * config_.recovery.min_rate_ratio;
+    if (slow && !source_slow_) {
+        slow_source_reports_.fetch_add(1, std::memory_order_relaxed);
+        LOG_WARN("Watchdog: Source '", source_stage()->name(), "' of HackRF '", name_, "' delivers ", rate,
+                 " transfers/s; ", source_sample_rate_hz() / 1e6, " MS/s implies ", expected, ".");
+        publish_event({{"event", "source_slow"}, {"stage", source_stage()->name()}, {"rate", rate},
+                       {"expected_rate", expected}});
+    } else if (!slow && source_slow_) {
+        LOG_INFO("Watchdog: Source '", source_stage()->name(), "' of HackRF '", name_, "' is back to ", rate,
+                 " transfers/s.");
+        publish_event({{"event", "source_rate_ok"}, {"stage", source_stage()->name()}, {"rate", rate},
+                       {"expected_rate", expected}});
+    }
+    source_slow_ = slow;
+}
+
+void DeviceSession::supervise(uint64_t now_ns) {
+    if (shut_down_.load()) {
+        return;
+    }
+    check_stages(now_ns);
+    if (!should_stream_.load() || recovering_.load()) {
+        rate_window_start_ns_ = 0;
+        return;
+    }
+    if (outage_detected_ns_.load() == 0) {
+        check_source_rate(now_ns);
+    } else {
+        rate_window_start_ns_ = 0; // A silent source is reported as stalled, not as slow
+    }
+
+    // The source must beat at least once per transfer; allow four before calling it stalled.
+    uint32_t rate = source_sample_rate_hz();
+    uint64_t timeout_ns = uint64_t(config_.recovery.stall_timeout_ms) * 1000000;
+    if (rate > 0) {
+        timeout_ns = std::max(timeout_ns, 4 * uint64_t(HackRFHandler::kTransferBytes / 2) * 1000000000 / rate);
+    }
+    uint64_t last = std::max(source_stage()->last_heartbeat_ns(), stream_started_ns_.load(std::memory_order_relaxed));
+    if (last == 0 || now_ns < last + timeout_ns) {
+        // Recovery clears the outage itself; this covers a stream that came back otherwise.
+        if (outage_detected_ns_.exchange(0) != 0) {
+            next_attempt_ns_ = 0;
+            LOG_INFO("Watchdog: HackRF '", name_, "' is delivering data again.");
+            publish_event({{"event", "resumed"}, {"stage", source_stage()->name()}});
+        }
+        return;
+    }
+    uint64_t expected = 0;
+    if (outage_detected_ns_.compare_exchange_strong(expected, now_ns)) {
+        LOG_WARN("Watchdog: Source '", source_stage()->name(), "' of HackRF '", name_, "' silent for ",
+                 (now_ns - last) / 1000000, " ms", config_.recovery.enabled ? "; reopening the device." : ".");
+        publish_event({{"event", "stalled"}, {"stage", source_stage()->name()}, {"silent_ms", (now_ns - last) / 1000000}});
+    }
+    if (!config_.recovery.enabled || now_ns < next_attempt_ns_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    recovering_ = true;
+    // Runs on the executor, so it never overlaps a control command on this device.
+    executor_.submit("recover", "recover", [this]() { return recover(); }, "", false);
+}
+
+DeviceCommandExecutor::Result DeviceSession::recover() {
+    if (!should_stream_.load() || shut_down_.load()) {
+        // Paused (or shutting down) since the stall was detected: nothing to restart.
+        outage_detected_ns_ = 0;
+        outage_attempts_ = 0;
+        recovering_ = false;
+        return {true, "not streaming"};
+    }
+    const uint64_t detected_ns = outage_detected_ns_.load();
+    ++outage_attempts_;
+    LOG_WARN("HackRF '", name_, "': reopening (attempt ", outage_attempts_, "), libhackrf reports the stream ",
+             handler_.is_streaming() ? "still running" : "stopped", ".");
+    if (rx_source_) {
+        rx_source_->begin_setting_change(detected_ns);
+    }
+
+    // Closing drops the device handle (and the USB transfers of a dead stream); the library
+    // stays initialized while other devices use it.
+    handler_.deinit();
+    bool ok = handler_.init() && write_settings() && start_rx();
+    if (!ok) {
+        handler_.deinit();
+        if (rx_source_) {
+            rx_source_->cancel_setting_change();
+        }
+        failed_attempts_.fetch_add(1, std::memory_order_relaxed);
+        next_attempt_ns_ = monotonic_now_ns() + uint64_t(config_.recovery.retry_interval_ms) * 1000000;
+        publish_event({{"event", "recovery_failed"}, {"attempt", outage_attempts_}});
+        recovering_ = false;
+        return {false, "reopen attempt " + std::to_string(outage_attempts_) + " failed"};
+    }
+
+    if (rx_source_) {
+        rx_source_->set_tuning(device_settings_.center_frequency_hz, device_settings_.sample_rate_hz);
+        rx_source_->end_setting_change(true);
+    } else {
+        sweep_source_->mark_discontinuity();
+    }
+    uint64_t recovery_us = (monotonic_now_ns() - detected_ns) / 1000;
+    recoveries_.fetch_add(1, std::memory_order_relaxed);
+    last_recovery_us_.store(recovery_us, std::memory_order_relaxed);
+    max_recovery_us_.store(std::max(max_recovery_us_.load(std::memory_order_relaxed), recovery_us),
+                           std::memory_order_relaxed);
+    LOG_INFO("HackRF '", name_, "': recovered in ", recovery_us / 1000, " ms after ", outage_attempts_,
+             " attempt(s).");
+    publish_event({{"event", "recovered"}, {"recovery_ms", recovery_us / 1000.0}, {"attempts", outage_attempts_}});
+
+    outage_attempts_ = 0;
+    next_attempt_ns_ = 0;
+    outage_detected_ns_ = 0;
+    recovering_ = false;
+    return {};
+}
+
+bool DeviceSession::start_streaming() {
+    if (!should_stream_.load()) {
+        LOG_INFO("HackRF '", name_, "' initially set to not stream.");
+        return true;
+    }
+    if (!start_rx()) {
+        LOG_ERROR("Failed to start HackRF '", name_, "' stream initially.");
+        return false;
+    }
+    if (scanner_ && !scanner_->start()) {
+        scanner_.reset();
+    }
+    return true;
+}
+
+void DeviceSession::shutdown() {
+    if (shut_down_) {
+        return;
+    }
+    shut_down_ = true;
+    pipeline_.stop();
+    if (scanner_) {
+        scanner_->stop();
+    }
+    // Queued commands still run, so no device operation races the teardown below.
+    executor_.stop();
+
+    if (handler_.is_streaming()) {
+        LOG_INFO("Stopping HackRF '", name_, "' stream...");
+        handler_.stop_rx();
+    }
+    handler_.deinit();
+}
+
+DeviceCommandExecutor::Action DeviceSession::make_settings_action(nlohmann::json patch, uint64_t requested_ns) {
+    // Merges `patch` (a partial HackRFConfig) into the applied settings at execution time,
+    // so the diff is against what the device has now, and writes the difference as one
+    // apply_config transaction.
+    return [this, patch = std::move(patch), requested_ns]() -> DeviceResult {
+        nlohmann::json merged = device_settings_;
+        merged.update(patch);
+        HackRFConfig target = merged.get<HackRFConfig>();
+        HackRFHandler::ApplyResult result =
+            apply_live_settings(handler_, *rx_source_, target, device_settings_, requested_ns);
+        std::string summary = std::to_string(result.applied) + " applied (" +
+                              std::to_string(result.transfers) + " USB transfers), " +
+                              std::to_string(result.unchanged) + " unchanged";
+        if (!result.ok) {
+            return {false, "failed at " + result.failed + " (" + summary + ")"};
+        }
+        return {true, summary};
+    };
+}
+
+void DeviceSession::handle_command(const std::string& cmd, const nlohmann::json& value, const std::string& id,
+                                   uint64_t requested_ns) {
+    if (cmd == "PAUSE" || cmd == "pause") {
+        // PAUSE and RESUME share a key: of several queued, only the latest runs.
+        executor_.submit(cmd, "stream", [this]() -> DeviceResult {
+            if (should_stream_.load()) {
+                // Also during an outage (stream already dead): pausing ends the recovery attempts.
+                LOG_INFO("Pausing HackRF '", name_, "' stream via MQTT command.");
+                if (handler_.is_streaming()) {
+                    handler_.stop_rx();
+                }
+                should_stream_ = false;
+                outage_detected_ns_ = 0;
+                outage_attempts_ = 0;
+                next_attempt_ns_ = 0;
+                return {};
+            }
+            return {true, "already paused"};
+        }, id);
+        return;
+    }
+    if (cmd == "RESUME" || cmd == "resume") {
+        executor_.submit(cmd, "stream", [this]() -> DeviceResult {
+            if (!should_stream_.load() && !handler_.is_streaming()) {
+                LOG_INFO("Resuming HackRF '", name_, "' stream via MQTT command.");
+                if (!handler_.is_open() && !reopen()) {
+                    return {false, "failed to reopen the device"};
+                }
+                if (!start_rx()) {
+                    return {false, "failed to start RX"};
+                }
+                should_stream_ = true;
+                return {};
+            }
+            return {true, "already streaming"};
+        }, id);
+        return;
+    }
+
+    // Live setting changes: applied while RX keeps running, as one apply_config transaction
+    // per command. Repeated commands of one kind coalesce, and the source drops (or marks)
+    // the blocks captured across the change.
+    nlohmann::json patch = nlohmann::json::object();
+    std::string error;
+    if (!rx_source_) {
+        error = "device settings cannot be changed in sweep mode";
+    } else if (cmd == "apply_config") {
+        if (!value.is_object() || value.empty()) {
+            error = "'value' must be an object of hackrf settings";
+        } else {
+            for (const auto& item : value.items()) {
+                if (!validate_device_setting(item.key(), item.value(), patch, error)) break;
+            }
+        }
+    } else {
+        auto it = kSettingCommands.find(cmd);
+        if (it == kSettingCommands.end()) {
+            LOG_WARN("Unknown control command received: '", cmd, "'");
+            error = "unknown command";
+        } else {
+            validate_device_setting(it->second, value, patch, error);
+        }
+    }
+    if (!error.empty()) {
+        executor_.submit(cmd, "", [error]() -> DeviceResult { return {false, error}; }, id);
+        return;
+    }
+
+    executor_.submit(cmd, cmd, make_settings_action(std::move(patch), requested_ns), id);
+}
+
+void DeviceSession::collect_metrics(MetricsSnapshot& out) const {
+    const MetricLabels labels = {{"device", name_}};
+    pipeline_.collect_metrics(out, labels);
+    out.gauge("device_streaming", labels, should_stream_.load() && outage_detected_ns_.load() == 0 ? 1 : 0);
+
+    DeviceCommandExecutor::Stats commands = executor_.stats();
+    out.counter("device_commands_total", labels, commands.executed);
+    out.counter("device_command_failures_total", labels, commands.failed);
+    out.counter("device_commands_coalesced_total", labels, commands.coalesced);
+    if (scanner_) {
+        out.counter("scan_hops_total", labels, scanner_->stats().hops);
+    }
+    HackRFHandler::ControlTransferStats transfers = handler_.control_transfer_stats();
+    out.counter("hackrf_control_transfers_total", with_label(labels, "result", "issued"), transfers.issued);
+    out.counter("hackrf_control_transfers_total", with_label(labels, "result", "skipped"), transfers.skipped);
+    out.counter("hackrf_control_transfers_total", with_label(labels, "result", "rejected"), transfers.rejected);
+    out.counter("hackrf_control_transfers_total", with_label(labels, "result", "failed"), transfers.failed);
+
+    out.counter("device_recoveries_total", labels, recoveries_.load(std::memory_order_relaxed));
+    out.counter("device_recovery_failures_total", labels, failed_attempts_.load(std::memory_order_relaxed));
+    out.gauge("device_last_recovery_seconds", labels, last_recovery_us_.load(std::memory_order_relaxed) / 1e6);
+    out.counter("stage_stalls_total", labels, stage_stalls_.load(std::memory_order_relaxed));
+    out.gauge("rx_transfer_rate", labels, source_rate_milli_.load(std::memory_order_relaxed) / 1000.0);
+    out.gauge("rx_expected_transfer_rate", labels, expected_rate_milli_.load(std::memory_order_relaxed) / 1000.0);
+}
+
+void DeviceSession::log_stats() {
+    pipeline_.log_stats();
+    DeviceCommandExecutor::Stats device_stats = executor_.stats();
+    if (device_stats.submitted > 0) {
+        LOG_INFO("Stats [", stats_tag("commands"), "]: device ops ", device_stats.executed,
+                 " run (", device_stats.failed, " failed, ", device_stats.coalesced, " coalesced), ",
+                 device_stats.executed ? device_stats.total_run_ns / device_stats.executed / 1000 : 0,
+                 " us avg, queue wait ", device_stats.max_queue_wait_ns / 1000, " us max");
+    }
+    if (scanner_) {
+        ScanScheduler::Stats scan_stats = scanner_->stats();
+        LOG_INFO("Stats [", stats_tag("scan"), "]: ", scan_stats.hops, " hops, ", scan_stats.late, " late (max ",
+                 scan_stats.max_late_us, " us); hop-to-valid latency is in the source stats");
+    }
+    LOG_INFO("Stats [", stats_tag("watchdog"), "]: source ", source_rate_milli_.load(std::memory_order_relaxed) / 1000.0,
+             " of ", expected_rate_milli_.load(std::memory_order_relaxed) / 1000.0, " transfers/s expected, ",
+             stage_stalls_.load(std::memory_order_relaxed), " stage stalls, ",
+             slow_source_reports_.load(std::memory_order_relaxed), " slow-source reports");
+    uint64_t recoveries = recoveries_.load(std::memory_order_relaxed);
+    uint64_t failed_attempts = failed_attempts_.load(std::memory_order_relaxed);
+    if (recoveries > 0 || failed_attempts > 0) {
+        LOG_INFO("Stats [", stats_tag("recovery"), "]: ", recoveries, " recoveries (last ",
+                 last_recovery_us_.load(std::memory_order_relaxed) / 1000, " ms, max ",
+                 max_recovery_us_.load(std::memory_order_relaxed) / 1000, " ms from detection), ",
+                 failed_attempts, " failed reopen attempts");
+    }
+    HackRFHandler::ControlTransferStats transfer_stats = handler_.control_transfer_stats();
+    LOG_INFO("Stats [", stats_tag("hackrf"), "]: control transfers issued ", transfer_stats.issued, ", skipped ",
+             transfer_stats.skipped, " (unchanged), rejected ", transfer_stats.rejected,
+             ", failed ", transfer_stats.failed);
+}
+
+} // namespace hackrf_mqtt
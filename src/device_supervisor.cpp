@@ -0,0 +1,59 @@
+#include "device_supervisor.h"
+#include "device_session.h"
+#include "logger.h"
+#include "sample_block.h"
+#include "thread_util.h"
+
+#include <algorithm>
+
+namespace hackrf_mqtt {
+
+DeviceSupervisor::DeviceSupervisor(std::vector<DeviceSession*> sessions, std::chrono::milliseconds interval)
+    : sessions_(std::move(sessions)),
+      interval_(std::max(interval, std::chrono::milliseconds(1))) {
+}
+
+DeviceSupervisor::~DeviceSupervisor() {
+    stop();
+}
+
+void DeviceSupervisor::start() {
+    if (thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = false;
+    }
+    thread_ = std::thread([this] { run(); });
+    LOG_INFO("Watchdog: Checking ", sessions_.size(), " device(s) every ", interval_.count(), " ms.");
+}
+
+void DeviceSupervisor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void DeviceSupervisor::run() {
+    set_current_thread_name("watchdog");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (cv_.wait_for(lock, interval_, [this] { return stopping_; })) {
+            break;
+        }
+        lock.unlock();
+        uint64_t now = monotonic_now_ns();
+        for (DeviceSession* session : sessions_) {
+            session->supervise(now);
+        }
+        lock.lock();
+    }
+}
+
+} // namespace hackrf_mqtt
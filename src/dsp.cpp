@@ -0,0 +1,97 @@
+#include "dsp.h"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace hackrf_mqtt {
+namespace dsp {
+
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+}
+
+bool is_power_of_two(size_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+FftPlan::FftPlan(size_t size) : size_(size) {
+    if (!is_power_of_two(size)) {
+        throw std::invalid_argument("FFT size must be a power of two");
+    }
+    size_t bits = 0;
+    while ((size_t(1) << bits) < size) ++bits;
+
+    bit_reverse_.resize(size);
+    for (size_t i = 0; i < size; ++i) {
+        size_t reversed = 0;
+        for (size_t b = 0; b < bits; ++b) {
+            if (i & (size_t(1) << b)) reversed |= size_t(1) << (bits - 1 - b);
+        }
+        bit_reverse_[i] = reversed;
+    }
+
+    twiddles_.resize(size / 2);
+    for (size_t i = 0; i < size / 2; ++i) {
+        double angle = -2.0 * kPi * static_cast<double>(i) / static_cast<double>(size);
+        twiddles_[i] = std::complex<float>(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+    }
+}
+
+void FftPlan::forward(std::complex<float>* data) const {
+    for (size_t i = 0; i < size_; ++i) {
+        size_t j = bit_reverse_[i];
+        if (i < j) std::swap(data[i], data[j]);
+    }
+    for (size_t len = 2; len <= size_; len <<= 1) {
+        size_t half = len / 2;
+        size_t step = size_ / len;
+        for (size_t start = 0; start < size_; start += len) {
+            for (size_t k = 0; k < half; ++k) {
+                std::complex<float> t = twiddles_[k * step] * data[start + k + half];
+                data[start + k + half] = data[start + k] - t;
+                data[start + k] += t;
+            }
+        }
+    }
+}
+
+std::vector<float> hann_window(size_t size) {
+    std::vector<float> window(size, 1.0f);
+    if (size < 2) return window;
+    for (size_t i = 0; i < size; ++i) {
+        window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * kPi * static_cast<double>(i) / static_cast<double>(size - 1)));
+    }
+    return window;
+}
+
+std::vector<float> design_lowpass(size_t taps, double cutoff) {
+    if (taps == 0 || cutoff <= 0.0 || cutoff > 0.5) {
+        throw std::invalid_argument("Invalid low-pass design parameters");
+    }
+    std::vector<float> coefficients(taps);
+    const double center = (static_cast<double>(taps) - 1.0) / 2.0;
+    double sum = 0.0;
+    for (size_t i = 0; i < taps; ++i) {
+        double x = static_cast<double>(i) - center;
+        double sinc = (x == 0.0) ? 2.0 * cutoff : std::sin(2.0 * kPi * cutoff * x) / (kPi * x);
+        double window = (taps > 1) ? 0.54 - 0.46 * std::cos(2.0 * kPi * static_cast<double>(i) / (static_cast<double>(taps) - 1.0)) : 1.0;
+        coefficients[i] = static_cast<float>(sinc * window);
+        sum += coefficients[i];
+    }
+    for (float& c : coefficients) {
+        c = static_cast<float>(c / sum);
+    }
+    return coefficients;
+}
+
+void power_spectrum_db(const std::complex<float>* spectrum, size_t size, float* out_db) {
+    const size_t half = size / 2;
+    const float norm = 1.0f / static_cast<float>(size * size);
+    for (size_t i = 0; i < size; ++i) {
+        float power = std::norm(spectrum[i]) * norm;
+        out_db[(i + half) % size] = 10.0f * std::log10(power + 1e-20f);
+    }
+}
+
+} // namespace dsp
+} // namespace hackrf_mqtt
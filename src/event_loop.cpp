@@ -0,0 +1,125 @@
+#include "event_loop.h"
+#include "logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace hackrf_mqtt {
+
+#ifdef __linux__
+
+EventLoop::EventLoop() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        LOG_ERROR("EventLoop: epoll_create1 failed: ", std::strerror(errno));
+        return;
+    }
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        LOG_ERROR("EventLoop: eventfd failed: ", std::strerror(errno));
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+        return;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+}
+
+EventLoop::~EventLoop() {
+    if (wake_fd_ >= 0) close(wake_fd_);
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
+bool EventLoop::add(int fd, uint32_t events, Handler handler) {
+    if (!is_valid() || fd < 0) {
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        LOG_ERROR("EventLoop: Cannot watch fd ", fd, ": ", std::strerror(errno));
+        return false;
+    }
+    handlers_[fd] = std::move(handler);
+    return true;
+}
+
+bool EventLoop::modify(int fd, uint32_t events) {
+    if (!is_valid() || handlers_.count(fd) == 0) {
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventLoop::remove(int fd) {
+    if (handlers_.erase(fd) && is_valid()) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+int EventLoop::run_once(int timeout_ms) {
+    if (!is_valid()) {
+        return -1;
+    }
+    epoll_event events[16];
+    int ready = epoll_wait(epoll_fd_, events, 16, timeout_ms);
+    if (ready < 0) {
+        if (errno == EINTR) return 0;
+        LOG_ERROR("EventLoop: epoll_wait failed: ", std::strerror(errno));
+        return -1;
+    }
+    int dispatched = 0;
+    for (int i = 0; i < ready; ++i) {
+        int fd = events[i].data.fd;
+        if (fd == wake_fd_) {
+            uint64_t counter;
+            ssize_t read_bytes = read(wake_fd_, &counter, sizeof(counter));
+            (void)read_bytes;
+            continue;
+        }
+        // A handler may remove fds, so look each one up again.
+        auto it = handlers_.find(fd);
+        if (it == handlers_.end()) continue;
+        Handler handler = it->second;
+        handler(events[i].events);
+        ++dispatched;
+    }
+    return dispatched;
+}
+
+void EventLoop::wakeup() {
+    if (wake_fd_ >= 0) {
+        uint64_t one = 1;
+        ssize_t written = write(wake_fd_, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+#else // !__linux__
+
+EventLoop::EventLoop() {
+    LOG_WARN("EventLoop: epoll is not available on this platform.");
+}
+EventLoop::~EventLoop() = default;
+bool EventLoop::add(int, uint32_t, Handler) { return false; }
+bool EventLoop::modify(int, uint32_t) { return false; }
+void EventLoop::remove(int) {}
+int EventLoop::run_once(int) { return -1; }
+void EventLoop::wakeup() {}
+
+#endif
+
+} // namespace hackrf_mqtt
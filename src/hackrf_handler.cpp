@@ -1,7 +1,38 @@
 #include "hackrf_handler.h"
 #include "logger.h" // Include our logger
 
-HackRFHandler::HackRFHandler() : device_(nullptr), streaming_(false), rx_callback_context_(nullptr) {
+#include <mutex>
+
+namespace {
+// hackrf_init/hackrf_exit are process-wide: the library is initialized by the first
+// handler that opens a device and torn down when the last one closes.
+std::mutex g_library_mutex;
+int g_library_users = 0;
+
+bool acquire_library() {
+    std::lock_guard<std::mutex> lock(g_library_mutex);
+    if (g_library_users == 0) {
+        int result = hackrf_init();
+        if (result != HACKRF_SUCCESS) {
+            LOG_ERROR("Failed to initialize HackRF library: ", hackrf_error_name((hackrf_error)result));
+            return false;
+        }
+    }
+    ++g_library_users;
+    return true;
+}
+
+void release_library() {
+    std::lock_guard<std::mutex> lock(g_library_mutex);
+    if (g_library_users > 0 && --g_library_users == 0) {
+        hackrf_exit();
+        LOG_INFO("HackRF library deinitialized.");
+    }
+}
+} // namespace
+
+HackRFHandler::HackRFHandler(std::string serial)
+    : device_(nullptr), streaming_(false), rx_callback_context_(nullptr), serial_(std::move(serial)) {
 }
 
 HackRFHandler::~HackRFHandler() {
@@ -13,20 +44,21 @@ bool HackRFHandler::init() {
         LOG_WARN("HackRF already initialized.");
         return true; // Or false, depending on desired behavior
     }
-    int result = hackrf_init();
-    if (result != HACKRF_SUCCESS) {
-        LOG_ERROR("Failed to initialize HackRF library: ", hackrf_error_name((hackrf_error)result));
+    if (!acquire_library()) {
         return false;
     }
 
-    result = hackrf_open(&device_);
+    // hackrf_open_by_serial matches a suffix of the serial number, so the last digits are enough.
+    int result = serial_.empty() ? hackrf_open(&device_) : hackrf_open_by_serial(serial_.c_str(), &device_);
     if (result != HACKRF_SUCCESS || device_ == nullptr) {
-        LOG_ERROR("Failed to open HackRF device: ", hackrf_error_name((hackrf_error)result));
-        hackrf_exit(); // Clean up library initialization if open fails
+        LOG_ERROR("Failed to open HackRF device", (serial_.empty() ? "" : " with serial " + serial_), ": ",
+                  hackrf_error_name((hackrf_error)result));
+        release_library(); // Clean up library initialization if open fails
         device_ = nullptr;
         return false;
     }
-    LOG_INFO("HackRF device opened successfully.");
+    clear_setting_cache();
+    LOG_INFO("HackRF device", (serial_.empty() ? "" : " " + serial_), " opened successfully.");
     return true;
 }
 
@@ -37,13 +69,42 @@ void HackRFHandler::deinit() {
     if (device_) {
         hackrf_close(device_);
         device_ = nullptr;
+        clear_setting_cache();
         LOG_INFO("HackRF device closed.");
+        release_library();
     }
-    // hackrf_exit should ideally be called when the application is completely done with libhackrf.
-    // Calling it here might be too soon if other handlers exist, but for a single handler app, it's okay.
-    // If multiple HackRFHandler instances could exist, manage hackrf_init/exit globally.
-    hackrf_exit(); 
-    LOG_INFO("HackRF library deinitialized.");
+}
+
+void HackRFHandler::set_write_policy(bool skip_redundant, bool validate) {
+    skip_redundant_ = skip_redundant;
+    validate_ = validate;
+}
+
+HackRFHandler::ControlTransferStats HackRFHandler::control_transfer_stats() const {
+    ControlTransferStats stats;
+    stats.issued = writes_issued_.load(std::memory_order_relaxed);
+    stats.skipped = writes_skipped_.load(std::memory_order_relaxed);
+    stats.rejected = writes_rejected_.load(std::memory_order_relaxed);
+    stats.failed = writes_failed_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool HackRFHandler::reject(const char* setting, uint64_t value, uint64_t min, uint64_t max) {
+    if (!validate_ || (value >= min && value <= max)) {
+        return false;
+    }
+    writes_rejected_.fetch_add(1, std::memory_order_relaxed);
+    LOG_ERROR("HackRF ", setting, " ", value, " is outside ", min, "-", max, "; not applied.");
+    return true;
+}
+
+void HackRFHandler::clear_setting_cache() {
+    frequency_ = {};
+    sample_rate_ = {};
+    baseband_filter_bandwidth_ = {};
+    lna_gain_ = {};
+    vga_gain_ = {};
+    amp_enable_ = {};
 }
 
 bool HackRFHandler::set_frequency(uint64_t freq_hz) {
@@ -51,7 +112,10 @@ bool HackRFHandler::set_frequency(uint64_t freq_hz) {
         LOG_ERROR("HackRF device not initialized. Cannot set frequency.");
         return false;
     }
+    if (reject("frequency (Hz)", freq_hz, 1000000ULL, 7250000000ULL)) return false;
+    if (already_applied(frequency_, freq_hz)) return true;
     int result = hackrf_set_freq(device_, freq_hz);
+    record_write(frequency_, freq_hz, result);
     if (result != HACKRF_SUCCESS) {
         LOG_ERROR("Failed to set frequency: ", hackrf_error_name((hackrf_error)result));
         return false;
@@ -65,10 +129,15 @@ bool HackRFHandler::set_sample_rate(uint32_t rate_hz) {
         LOG_ERROR("HackRF device not initialized. Cannot set sample rate.");
         return false;
     }
+    if (reject("sample rate (Hz)", rate_hz, 1000000, 20000000)) return false;
+    if (already_applied(sample_rate_, rate_hz)) return true;
     // libhackrf expects sample rate as a double for hackrf_set_sample_rate_manual
     // but we'll use hackrf_set_sample_rate which takes uint32_t for common rates
     // For more fine-grained control, one might use hackrf_set_sample_rate_manual.
     int result = hackrf_set_sample_rate(device_, rate_hz);
+    record_write(sample_rate_, rate_hz, result);
+    // libhackrf also reprograms the baseband filter (automatic bandwidth), whatever the result.
+    baseband_filter_bandwidth_.valid = false;
     if (result != HACKRF_SUCCESS) {
         LOG_ERROR("Failed to set sample rate: ", hackrf_error_name((hackrf_error)result));
         return false;
@@ -82,7 +151,11 @@ bool HackRFHandler::set_baseband_filter_bandwidth(uint32_t bw_hz) {
         LOG_ERROR("HackRF device not initialized. Cannot set baseband filter bandwidth.");
         return false;
     }
+    if (reject("baseband filter bandwidth (Hz)", bw_hz, 1750000, 28000000)) return false;
+    bw_hz = hackrf_compute_baseband_filter_bw(bw_hz); // The filter has 16 discrete settings
+    if (already_applied(baseband_filter_bandwidth_, bw_hz)) return true;
     int result = hackrf_set_baseband_filter_bandwidth(device_, bw_hz);
+    record_write(baseband_filter_bandwidth_, bw_hz, result);
     if (result != HACKRF_SUCCESS) {
         LOG_ERROR("Failed to set baseband filter bandwidth: ", hackrf_error_name((hackrf_error)result));
         return false;
@@ -96,7 +169,11 @@ bool HackRFHandler::set_lna_gain(uint32_t gain_db) {
         LOG_ERROR("HackRF device not initialized. Cannot set LNA gain.");
         return false;
     }
+    if (reject("LNA gain (dB)", gain_db, 0, 40)) return false;
+    gain_db &= ~0x07u; // 8 dB steps, rounded down as libhackrf does
+    if (already_applied(lna_gain_, gain_db)) return true;
     int result = hackrf_set_lna_gain(device_, gain_db);
+    record_write(lna_gain_, gain_db, result);
     if (result != HACKRF_SUCCESS) {
         LOG_ERROR("Failed to set LNA gain: ", hackrf_error_name((hackrf_error)result));
         return false;
@@ -110,7 +187,11 @@ bool HackRFHandler::set_vga_gain(uint32_t gain_db) {
         LOG_ERROR("HackRF device not initialized. Cannot set VGA gain.");
         return false;
     }
+    if (reject("VGA gain (dB)", gain_db, 0, 62)) return false;
+    gain_db &= ~0x01u; // 2 dB steps, rounded down as libhackrf does
+    if (already_applied(vga_gain_, gain_db)) return true;
     int result = hackrf_set_vga_gain(device_, gain_db);
+    record_write(vga_gain_, gain_db, result);
     if (result != HACKRF_SUCCESS) {
         LOG_ERROR("Failed to set VGA gain: ", hackrf_error_name((hackrf_error)result));
         return false;
@@ -124,7 +205,9 @@ bool HackRFHandler::set_amp_enable(bool enable) {
         LOG_ERROR("HackRF device not initialized. Cannot set amp enable.");
         return false;
     }
+    if (already_applied(amp_enable_, enable)) return true;
     int result = hackrf_set_amp_enable(device_, enable ? 1 : 0);
+    record_write(amp_enable_, enable, result);
     if (result != HACKRF_SUCCESS) {
         LOG_ERROR("Failed to set amp enable: ", hackrf_error_name((hackrf_error)result));
         return false;
@@ -133,6 +216,70 @@ bool HackRFHandler::set_amp_enable(bool enable) {
     return true;
 }
 
+HackRFHandler::ApplyResult HackRFHandler::apply_config(const hackrf_mqtt::HackRFConfig& target,
+                                                       hackrf_mqtt::HackRFConfig& current,
+                                                       const std::function<void()>& before_first_write) {
+    ApplyResult result;
+    uint64_t issued_before = writes_issued_.load(std::memory_order_relaxed);
+    bool written = false;
+    auto step = [&](bool differs, const char* name, bool retunes, const std::function<bool()>& apply) {
+        if (!result.ok) return;
+        if (!differs) {
+            ++result.unchanged;
+            return;
+        }
+        if (!written && before_first_write) {
+            before_first_write();
+        }
+        written = true;
+        if (!apply()) {
+            result.ok = false;
+            result.failed = name;
+            return;
+        }
+        ++result.applied;
+        result.retuned = result.retuned || retunes;
+    };
+    step(target.amp_enable != current.amp_enable, "amp_enable", false, [&] {
+        if (!set_amp_enable(target.amp_enable)) return false;
+        current.amp_enable = target.amp_enable;
+        return true;
+    });
+    step(target.lna_gain != current.lna_gain, "lna_gain", false, [&] {
+        if (!set_lna_gain(target.lna_gain)) return false;
+        current.lna_gain = target.lna_gain;
+        return true;
+    });
+    step(target.vga_gain != current.vga_gain, "vga_gain", false, [&] {
+        if (!set_vga_gain(target.vga_gain)) return false;
+        current.vga_gain = target.vga_gain;
+        return true;
+    });
+    step(target.sample_rate_hz != current.sample_rate_hz, "sample_rate_hz", true, [&] {
+        if (!set_sample_rate(target.sample_rate_hz)) return false;
+        current.sample_rate_hz = target.sample_rate_hz;
+        // libhackrf has just set the filter to its automatic bandwidth. Put the configured
+        // one back, unless the filter step below changes it anyway.
+        if (target.baseband_filter_bandwidth_hz == current.baseband_filter_bandwidth_hz) {
+            return set_baseband_filter_bandwidth(current.baseband_filter_bandwidth_hz);
+        }
+        return true;
+    });
+    step(target.baseband_filter_bandwidth_hz != current.baseband_filter_bandwidth_hz,
+         "baseband_filter_bandwidth_hz", true, [&] {
+        if (!set_baseband_filter_bandwidth(target.baseband_filter_bandwidth_hz)) return false;
+        current.baseband_filter_bandwidth_hz = target.baseband_filter_bandwidth_hz;
+        return true;
+    });
+    step(target.center_frequency_hz != current.center_frequency_hz, "center_frequency_hz", true, [&] {
+        if (!set_frequency(target.center_frequency_hz)) return false;
+        current.center_frequency_hz = target.center_frequency_hz;
+        return true;
+    });
+    result.transfers = writes_issued_.load(std::memory_order_relaxed) - issued_before;
+    return result;
+}
+
 bool HackRFHandler::start_rx(hackrf_sample_block_cb_fn callback, void* callback_context) {
     if (!device_) {
         LOG_ERROR("HackRF device not initialized. Cannot start RX.");
@@ -153,6 +300,40 @@ bool HackRFHandler::start_rx(hackrf_sample_block_cb_fn callback, void* callback_
     return true;
 }
 
+bool HackRFHandler::start_rx_sweep(const std::vector<uint16_t>& frequency_list_mhz, uint32_t num_bytes,
+                                   uint32_t step_width_hz, uint32_t offset_hz,
+                                   hackrf_sample_block_cb_fn callback, void* callback_context) {
+    if (!device_) {
+        LOG_ERROR("HackRF device not initialized. Cannot start sweep.");
+        return false;
+    }
+    if (streaming_) {
+        LOG_WARN("HackRF is already streaming. Start sweep request ignored.");
+        return false;
+    }
+    if (frequency_list_mhz.empty() || frequency_list_mhz.size() % 2 != 0) {
+        LOG_ERROR("Sweep frequency list must hold [start, stop] MHz pairs.");
+        return false;
+    }
+    int result = hackrf_init_sweep(device_, frequency_list_mhz.data(), static_cast<int>(frequency_list_mhz.size() / 2),
+                                   num_bytes, step_width_hz, offset_hz, INTERLEAVED);
+    if (result != HACKRF_SUCCESS) {
+        LOG_ERROR("Failed to configure sweep: ", hackrf_error_name((hackrf_error)result));
+        return false;
+    }
+    // The firmware owns the frequency from here on; a later set_frequency() must reach the device.
+    frequency_.valid = false;
+    rx_callback_context_ = callback_context;
+    result = hackrf_start_rx_sweep(device_, callback, rx_callback_context_);
+    if (result != HACKRF_SUCCESS) {
+        LOG_ERROR("Failed to start sweep: ", hackrf_error_name((hackrf_error)result));
+        return false;
+    }
+    streaming_ = true;
+    LOG_INFO("HackRF sweep started over ", frequency_list_mhz.size() / 2, " range(s).");
+    return true;
+}
+
 bool HackRFHandler::stop_rx() {
     if (!device_ || !streaming_) {
         LOG_WARN("HackRF not streaming or not initialized. Stop RX request ignored.");
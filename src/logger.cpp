@@ -0,0 +1,341 @@
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "thread_util.h"
+
+namespace hackrf_mqtt {
+namespace logger {
+
+std::atomic<LogLevel> current_log_level(LogLevel::INFO);
+std::atomic<uint64_t> suppressed_total(0);
+
+LogLevel string_to_log_level(const std::string& level_str) {
+    std::string upper_level_str = level_str;
+    std::transform(upper_level_str.begin(), upper_level_str.end(), upper_level_str.begin(), ::toupper);
+
+    if (upper_level_str == "DEBUG") return LogLevel::DEBUG;
+    if (upper_level_str == "INFO") return LogLevel::INFO;
+    if (upper_level_str == "WARNING") return LogLevel::WARNING;
+    if (upper_level_str == "ERROR") return LogLevel::ERROR;
+    if (upper_level_str == "NONE") return LogLevel::NONE;
+    return LogLevel::INFO; // Default if unrecognized
+}
+
+namespace {
+
+constexpr size_t kRingSlots = 1024;           // Power of two
+constexpr size_t kSlotTextBytes = kMaxMessageBytes;
+constexpr auto kIdleWait = std::chrono::milliseconds(10);
+
+const char* level_name(LogLevel level) {
+    switch (level) {
+        case LogLevel::DEBUG: return "DEBUG";
+        case LogLevel::INFO: return "INFO";
+        case LogLevel::WARNING: return "WARN";
+        case LogLevel::ERROR: return "ERROR";
+        case LogLevel::NONE: break;
+    }
+    return "NONE";
+}
+
+bool is_error_stream(LogLevel level) {
+    return level == LogLevel::ERROR || level == LogLevel::WARNING;
+}
+
+uint64_t wall_clock_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+// Appends "[YYYY-mm-dd HH:MM:SS.mmm] [LEVEL] text\n". localtime_r runs once per second.
+class LineFormatter {
+public:
+    void append(std::string& out, uint64_t time_ns, LogLevel level, const char* text, size_t length) {
+        const time_t seconds = static_cast<time_t>(time_ns / 1000000000);
+        if (seconds != cached_second_ || cached_prefix_[0] == '\0') {
+            std::tm now_tm;
+            localtime_r(&seconds, &now_tm);
+            std::strftime(cached_prefix_, sizeof(cached_prefix_), "[%Y-%m-%d %H:%M:%S", &now_tm);
+            cached_second_ = seconds;
+        }
+        const unsigned ms = static_cast<unsigned>(time_ns / 1000000 % 1000);
+        char millis[6] = {'.', char('0' + ms / 100), char('0' + ms / 10 % 10), char('0' + ms % 10), ']', '\0'};
+        out += cached_prefix_;
+        out += millis;
+        out += " [";
+        out += level_name(level);
+        out += "] ";
+        out.append(text, length);
+        out += '\n';
+    }
+
+private:
+    time_t cached_second_ = 0;
+    char cached_prefix_[32] = {};
+};
+
+// Bounded MPSC ring (Vyukov's sequence-numbered slots). Producers claim a slot with one
+// CAS on tail_ and publish it by bumping the slot's sequence; a full ring fails the push
+// instead of waiting. Only the logger thread consumes.
+class Backend {
+public:
+    ~Backend() { stop(); }
+
+    void start() {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        if (running_.load()) {
+            return;
+        }
+        for (size_t i = 0; i < kRingSlots; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        tail_.store(0, std::memory_order_relaxed);
+        head_ = 0;
+        stopping_ = false;
+        thread_ = std::thread([this] { run(); });
+        running_.store(true, std::memory_order_release);
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        if (!running_.load()) {
+            return;
+        }
+        // Producers that saw running_ may still be filling slots; run() drains until tail_.
+        running_.store(false, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> wake_lock(wake_mutex_);
+            stopping_ = true;
+        }
+        wake_cv_.notify_one();
+        thread_.join();
+    }
+
+    void flush() {
+        if (!running_.load(std::memory_order_acquire)) {
+            std::cout.flush();
+            std::cerr.flush();
+            return;
+        }
+        const uint64_t target = tail_.load(std::memory_order_acquire);
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        flush_requested_ = true;
+        wake_cv_.notify_one();
+        written_cv_.wait_for(lock, std::chrono::seconds(2), [&] { return written_ >= target || stopping_; });
+    }
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    void write(LogLevel level, const char* text, size_t length) {
+        const uint64_t time_ns = wall_clock_ns();
+        length = std::min(length, kSlotTextBytes);
+        if (!running_.load(std::memory_order_acquire)) {
+            write_direct(time_ns, level, text, length);
+            return;
+        }
+        uint64_t position = tail_.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots_[position & (kRingSlots - 1)];
+            const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                position = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->time_ns = time_ns;
+        slot->level = level;
+        slot->length = static_cast<uint16_t>(length);
+        std::memcpy(slot->text, text, length);
+        slot->sequence.store(position + 1, std::memory_order_release);
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        uint64_t time_ns = 0;
+        LogLevel level = LogLevel::INFO;
+        uint16_t length = 0;
+        char text[kSlotTextBytes];
+    };
+
+    void write_direct(uint64_t time_ns, LogLevel level, const char* text, size_t length) {
+        // Synchronous path (before start / after stop); serialised so lines stay whole.
+        std::lock_guard<std::mutex> lock(direct_mutex_);
+        std::string line;
+        direct_formatter_.append(line, time_ns, level, text, length);
+        std::ostream& out = is_error_stream(level) ? std::cerr : std::cout;
+        out.write(line.data(), static_cast<std::streamsize>(line.size()));
+        out.flush();
+    }
+
+    // Writes up to one ring's worth of records (a batch per write); returns the number taken.
+    size_t drain() {
+        size_t taken = 0;
+        while (taken < kRingSlots) {
+            Slot& slot = slots_[head_ & (kRingSlots - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+                break;
+            }
+            std::string& buffer = is_error_stream(slot.level) ? err_buffer_ : out_buffer_;
+            formatter_.append(buffer, slot.time_ns, slot.level, slot.text, slot.length);
+            slot.sequence.store(head_ + kRingSlots, std::memory_order_release);
+            ++head_;
+            ++taken;
+        }
+        const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != reported_dropped_) {
+            std::string message = "Logger: " + std::to_string(dropped - reported_dropped_) +
+                                  " messages dropped (ring full).";
+            formatter_.append(err_buffer_, wall_clock_ns(), LogLevel::WARNING, message.data(), message.size());
+            reported_dropped_ = dropped;
+        }
+        // Stdout first: in a terminal, errors then follow the lines that led up to them.
+        if (!out_buffer_.empty()) {
+            std::cout.write(out_buffer_.data(), static_cast<std::streamsize>(out_buffer_.size()));
+            std::cout.flush();
+            out_buffer_.clear();
+        }
+        if (!err_buffer_.empty()) {
+            std::cerr.write(err_buffer_.data(), static_cast<std::streamsize>(err_buffer_.size()));
+            std::cerr.flush();
+            err_buffer_.clear();
+        }
+        return taken;
+    }
+
+    void run() {
+        set_current_thread_name("logger");
+        for (;;) {
+            const size_t taken = drain();
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            written_ = head_;
+            written_cv_.notify_all();
+            if (stopping_) {
+                break;
+            }
+            // Sleep only once the ring ran dry; producers never signal, to stay lock-free.
+            if (taken == 0 && !flush_requested_) {
+                wake_cv_.wait_for(lock, kIdleWait, [this] { return stopping_ || flush_requested_; });
+            }
+            flush_requested_ = false;
+        }
+        // A producer that passed the running_ check before stop() may still be copying;
+        // wait for the slots claimed so far.
+        const uint64_t claimed = tail_.load(std::memory_order_acquire);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+        while (head_ < claimed && std::chrono::steady_clock::now() < deadline) {
+            if (drain() == 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    Slot slots_[kRingSlots];
+    alignas(64) std::atomic<uint64_t> tail_{0};
+    alignas(64) std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> running_{false};
+
+    // Logger thread only
+    uint64_t head_ = 0;
+    uint64_t reported_dropped_ = 0;
+    LineFormatter formatter_;
+    std::string out_buffer_;
+    std::string err_buffer_;
+
+    std::thread thread_;
+    std::mutex control_mutex_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable written_cv_;
+    bool stopping_ = false;
+    bool flush_requested_ = false;
+    uint64_t written_ = 0;
+
+    std::mutex direct_mutex_;
+    LineFormatter direct_formatter_;
+};
+
+Backend& backend() {
+    // Never destroyed before other static destructors that may still log; stopped by the
+    // Stopper below instead.
+    static Backend* instance = new Backend();
+    return *instance;
+}
+
+// Drains the ring when the process exits normally (return from main or exit()).
+struct Stopper {
+    ~Stopper() { backend().stop(); }
+} stopper;
+
+} // namespace
+
+void start() {
+    backend().start();
+}
+
+void stop() {
+    backend().stop();
+}
+
+void flush() {
+    backend().flush();
+}
+
+uint64_t dropped() {
+    return backend().dropped();
+}
+
+void write(LogLevel level, const char* text, size_t length) {
+    backend().write(level, text, length);
+}
+
+void DedupSite::log(LogLevel level, const LogMessage& message) {
+    // FNV-1a; a collision only merges two messages into one count.
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < message.size(); ++i) {
+        hash = (hash ^ static_cast<unsigned char>(message.data()[i])) * 1099511628211ULL;
+    }
+    const uint64_t now = monotonic_ns();
+    if (last_hash_.exchange(hash, std::memory_order_relaxed) != hash) {
+        const uint64_t repeats = repeats_.exchange(0, std::memory_order_relaxed);
+        if (repeats > 0) {
+            LogMessage summary;
+            summary.append("Last message repeated ").append(repeats).append(repeats == 1 ? " time." : " times.");
+            write(level, summary.data(), summary.size());
+        }
+        last_written_ns_.store(now, std::memory_order_relaxed);
+        write(level, message.data(), message.size());
+        return;
+    }
+    uint64_t last = last_written_ns_.load(std::memory_order_relaxed);
+    if (now - last >= kDedupSummaryMs * 1000000 &&
+        last_written_ns_.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+        // This call plus the ones counted since the last line.
+        const uint64_t repeats = repeats_.exchange(0, std::memory_order_relaxed) + 1;
+        LogMessage line = message;
+        line.append(" (repeated ").append(repeats).append(repeats == 1 ? " time)" : " times)");
+        write(level, line.data(), line.size());
+        return;
+    }
+    repeats_.fetch_add(1, std::memory_order_relaxed);
+    suppressed_total.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace logger
+} // namespace hackrf_mqtt
@@ -1,10 +1,12 @@
-// #include <iostream> // Replaced by logger
+#include <iostream> // Config errors before the logger is set up
 #include <vector>
 #include <string>
 #include "logger.h" // Include our new logger
 #include <csignal>
 #include <thread>
 #include <chrono>
+#include <map>
+#include <memory>
 #include <fstream> // For reading config file
 #include <nlohmann/json.hpp> // For JSON parsing
 #include "hackrf_handler.h" 
@@ -14,10 +16,13 @@
 
 volatile sig_atomic_t keep_running = 1;
 
-#include "thread_safe_queue.h"
-
-// Define a type for our data queue
-using DataQueue = hackrf_mqtt::ThreadSafeQueue<std::vector<unsigned char>>;
+#include "pipeline.h"
+#include "pipeline_stages.h"
+#include "mqtt_sink.h"
+#include "device_session.h"
+#include "device_supervisor.h"
+#include "metrics.h"
+#include "metrics_http_server.h"
 
 
 void signal_handler(int signal_num) {
@@ -27,60 +32,6 @@ void signal_handler(int signal_num) {
     }
 }
 
-// HackRF callback function: Pushes data to the queue
-int hackrf_rx_callback(hackrf_transfer* transfer) {
-    if (!keep_running) { // Check global flag
-        return -1; // Signal libhackrf to stop streaming
-    }
-
-    DataQueue* data_queue_ptr = static_cast<DataQueue*>(transfer->rx_ctx);
-
-    if (data_queue_ptr && transfer->valid_length > 0) {
-        std::vector<unsigned char> data_chunk(transfer->buffer, transfer->buffer + transfer->valid_length);
-        if (!data_queue_ptr->try_push(std::move(data_chunk))) {
-            // Queue is full, data chunk was discarded.
-            // TODO: Implement rate-limited logging for this warning to avoid console spam.
-            LOG_WARN("IQ data queue full, discarding data chunk of size ", transfer->valid_length, " bytes.");
-        }
-    }
-    return 0; // Continue streaming
-}
-
-// MQTT Publisher Thread function
-void mqtt_publisher_thread_func(
-    DataQueue& data_queue, 
-    MqttClient& mqtt_client, 
-    const hackrf_mqtt::MqttConfig& mqtt_config,
-    const std::atomic<bool>& should_run
-) {
-    LOG_INFO("MQTT Publisher thread started.");
-    while (should_run.load()) {
-        std::optional<std::vector<unsigned char>> data_chunk_opt = 
-            data_queue.wait_for_and_pop(std::chrono::milliseconds(100));
-
-        if (data_chunk_opt) {
-            std::vector<unsigned char>& data_chunk = *data_chunk_opt;
-            if (mqtt_client.is_connected()) {
-                int rc = mqtt_client.publish_message(
-                    mqtt_config.topic,
-                    data_chunk.data(),
-                    static_cast<int>(data_chunk.size()),
-                    mqtt_config.qos
-                );
-                if (rc != MOSQ_ERR_SUCCESS) {
-                    LOG_ERROR("MQTT Publish error in publisher thread: ", mosqpp::strerror(rc));
-                    if (rc == MOSQ_ERR_NO_CONN || rc == MOSQ_ERR_CONN_LOST) {
-                        LOG_WARN("MQTT disconnected, publisher thread may pause.");
-                    }
-                }
-            } else {
-                LOG_DEBUG("MQTT not connected in publisher thread, discarding data chunk if any was popped.");
-            }
-        }
-    }
-    LOG_INFO("MQTT Publisher thread stopping.");
-}
-
 class MosquittoInitializer {
 public:
     MosquittoInitializer() {
@@ -130,9 +81,15 @@ int main(int argc, char* argv[]) {
         LOG_INFO("Config file ", config_file_path, " not found. Using default configuration.");
     }
     // --- End Load Configuration ---
+    // From here on, log calls only queue the message; the logger thread writes it.
+    hackrf_mqtt::logger::start();
 
     LOG_INFO("HackRF MQTT Transmitter starting...");
     LOG_INFO("Log level set to: ", app_config.log_level);
+    if (!hackrf_mqtt::logger::compiled_in(hackrf_mqtt::logger::string_to_log_level(app_config.log_level))) {
+        LOG_WARN("Log level ", app_config.log_level, " is below the level compiled in (HACKRF_MQTT_MIN_LOG_LEVEL); "
+                 "those messages are not available in this build.");
+    }
     LOG_INFO("MQTT Broker: ", app_config.mqtt.broker_host, ":", app_config.mqtt.broker_port);
     LOG_INFO("MQTT Topic: ", app_config.mqtt.topic);
     LOG_INFO("HackRF Frequency: ", app_config.hackrf.center_frequency_hz / 1e6, " MHz");
@@ -141,133 +98,350 @@ int main(int argc, char* argv[]) {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
-    HackRFHandler hackrf_handler;
     MqttClient mqtt_client(app_config.mqtt.client_id.c_str(), true); 
 
-    mqtt_client.set_host(app_config.mqtt.broker_host);
-    mqtt_client.set_port(app_config.mqtt.broker_port);
-    mqtt_client.set_keepalive(app_config.mqtt.keepalive_s);
-    if (!app_config.mqtt.username.empty()) {
-        mqtt_client.set_username_password(app_config.mqtt.username, app_config.mqtt.password);
+    auto configure_broker = [&](MqttClient& client) {
+        client.set_host(app_config.mqtt.broker_host);
+        client.set_port(app_config.mqtt.broker_port);
+        client.set_keepalive(app_config.mqtt.keepalive_s);
+        if (!app_config.mqtt.username.empty()) {
+            client.set_username_password(app_config.mqtt.username, app_config.mqtt.password);
+        }
+    };
+    configure_broker(mqtt_client);
+    mqtt_client.set_socket_tuning(app_config.mqtt.socket);
+    mqtt_client.set_inflight_window(app_config.mqtt.inflight_window,
+                                    std::chrono::milliseconds(app_config.mqtt.inflight_wait_ms));
+
+    // Control commands get their own connection unless configured otherwise: on the data
+    // connection a command waits behind every queued sample packet, and its handler runs
+    // on (and stalls) the thread that sends them.
+    std::unique_ptr<MqttClient> control_client_owned;
+    MqttClient* control_client = &mqtt_client;
+    if (!app_config.mqtt.control_topic.empty()) {
+        if (app_config.mqtt.control_connection == "separate") {
+            std::string control_client_id = app_config.mqtt.client_id + "_ctl";
+            control_client_owned = std::make_unique<MqttClient>(control_client_id.c_str(), true);
+            configure_broker(*control_client_owned);
+            hackrf_mqtt::MqttSocketConfig control_socket;
+            control_socket.tcp_nodelay = true; // Small packets; do not let Nagle hold a command reply
+            control_client_owned->set_socket_tuning(control_socket);
+            control_client = control_client_owned.get();
+        } else if (app_config.mqtt.control_connection != "shared") {
+            LOG_WARN("Unknown mqtt.control_connection '", app_config.mqtt.control_connection, "'; using 'shared'.");
+        }
+    }
+
+    // Each control command is answered on control_response_topic when it completes
+    // (or at once when it is rejected before reaching a device).
+    using Completion = hackrf_mqtt::DeviceCommandExecutor::Completion;
+    auto publish_reply = [&](const std::string& device, const Completion& completion) {
+        if (!completion.report) {
+            return; // Internal (scan hops); failures are already logged by the executor
+        }
+        LOG_INFO("Control command '", completion.command, "'", (device.empty() ? "" : " on '" + device + "'"), " ",
+                 (completion.superseded ? "superseded" : (completion.ok ? "done" : "failed")),
+                 " (queued ", completion.queue_wait_ns / 1000, " us, ran ", completion.run_ns / 1000, " us)",
+                 (completion.message.empty() ? "" : ": "), completion.message);
+        if (app_config.mqtt.control_response_topic.empty() || !control_client->is_connected()) {
+            return;
+        }
+        nlohmann::json reply = {
+            {"command", completion.command},
+            {"status", completion.superseded ? "superseded" : (completion.ok ? "ok" : "error")},
+            {"message", completion.message},
+            {"queue_us", completion.queue_wait_ns / 1000},
+            {"exec_us", completion.run_ns / 1000}
+        };
+        if (!device.empty()) {
+            reply["device"] = device;
+        }
+        if (!completion.request_id.empty()) {
+            reply["id"] = completion.request_id;
+        }
+        control_client->publish_message(app_config.mqtt.control_response_topic, reply.dump(), app_config.mqtt.qos);
+    };
+
+    // Device stall/recovery events, on the control connection like the command replies.
+    auto publish_device_event = [&](const nlohmann::json& event) {
+        if (app_config.recovery.status_topic.empty() || !control_client->is_connected()) {
+            return;
+        }
+        control_client->publish_message(app_config.recovery.status_topic, event.dump(), app_config.mqtt.qos);
+    };
+
+    if (app_config.recovery.stage_stall_action != "report" && app_config.recovery.stage_stall_action != "abort") {
+        LOG_WARN("Unknown recovery.stage_stall_action '", app_config.recovery.stage_stall_action, "'; using 'report'.");
+        app_config.recovery.stage_stall_action = "report";
+    }
+
+    // --- Devices, each with its own processing pipeline ---
+    // Without a devices array, the top-level hackrf/pipeline/scan/sweep sections describe the only one.
+    std::vector<hackrf_mqtt::DeviceConfig> device_configs = app_config.devices;
+    const bool multi_device = !device_configs.empty();
+    if (!multi_device) {
+        hackrf_mqtt::DeviceConfig single;
+        single.name = "hackrf0";
+        single.hackrf = app_config.hackrf;
+        single.pipeline = app_config.pipeline;
+        single.scan = app_config.scan;
+        single.sweep = app_config.sweep;
+        device_configs.push_back(single);
+    }
+    size_t unnamed_serials = 0;
+    for (size_t i = 0; i < device_configs.size(); ++i) {
+        hackrf_mqtt::DeviceConfig& device = device_configs[i];
+        if (device.name.empty()) {
+            device.name = "hackrf" + std::to_string(i);
+        }
+        for (size_t j = 0; j < i; ++j) {
+            if (device_configs[j].name == device.name) {
+                LOG_ERROR("Duplicate device name '", device.name, "'.");
+                return 1;
+            }
+        }
+        unnamed_serials += device.serial.empty() ? 1 : 0;
+    }
+    if (device_configs.size() > 1 && unnamed_serials > 0) {
+        LOG_WARN(unnamed_serials, " device(s) have no serial; each opens the first free HackRF, so the "
+                 "device-to-band mapping depends on USB enumeration order.");
     }
 
-    DataQueue iq_data_queue(app_config.data_queue_max_size);
-    LOG_INFO("IQ Data Queue initialized with max size: ", (app_config.data_queue_max_size == 0 ? "UNBOUNDED" : std::to_string(app_config.data_queue_max_size)));
+    // In "event_loop" mode the first dedicated mqtt_sink (of any device) owns the client's socket.
+    const bool want_external_loop = app_config.mqtt.network_loop == "event_loop";
+    bool network_driver_assigned = false;
+    // Declared after the MQTT clients: sessions (and their sinks) are torn down before them.
+    std::vector<std::unique_ptr<hackrf_mqtt::DeviceSession>> sessions;
+    for (const hackrf_mqtt::DeviceConfig& device : device_configs) {
+        auto session = std::make_unique<hackrf_mqtt::DeviceSession>(
+            device, app_config, multi_device,
+            [&, name = multi_device ? device.name : std::string()](const Completion& completion) {
+                publish_reply(name, completion);
+            },
+            publish_device_event);
+        hackrf_mqtt::DeviceSession* session_ptr = session.get();
+        hackrf_mqtt::StageFactory stage_factory;
+        hackrf_mqtt::register_builtin_stages(stage_factory);
+        stage_factory.register_type("mqtt_sink", [&, session_ptr](const hackrf_mqtt::StageConfig& stage_config) {
+            bool drive_network = want_external_loop && !network_driver_assigned && stage_config.threading == "dedicated";
+            network_driver_assigned = network_driver_assigned || drive_network;
+            return std::make_unique<hackrf_mqtt::MqttSinkStage>(stage_config, mqtt_client, session_ptr->config().mqtt,
+                                                                drive_network);
+        });
+        if (!session->build(stage_factory)) {
+            return 1;
+        }
+        sessions.push_back(std::move(session));
+    }
+    if (want_external_loop && !network_driver_assigned) {
+        LOG_WARN("mqtt.network_loop is 'event_loop' but no dedicated mqtt_sink stage exists; using the threaded network loop.");
+    } else if (app_config.mqtt.network_loop != "threaded" && !want_external_loop) {
+        LOG_WARN("Unknown mqtt.network_loop '", app_config.mqtt.network_loop, "'; using 'threaded'.");
+    }
+    mqtt_client.set_external_network_loop(network_driver_assigned);
+
+    // Metrics: every device and MQTT connection adds a collector; snapshots go to mqtt.stats_topic.
+    hackrf_mqtt::MetricsRegistry metrics;
+    std::vector<uint64_t> device_collectors;
+    for (auto& session : sessions) {
+        hackrf_mqtt::DeviceSession* session_ptr = session.get();
+        device_collectors.push_back(metrics.add_collector([session_ptr](hackrf_mqtt::MetricsSnapshot& out) {
+            session_ptr->collect_metrics(out);
+        }));
+    }
+    metrics.add_collector([&](hackrf_mqtt::MetricsSnapshot& out) {
+        auto add_client = [&out](const char* role, const MqttClient& client) {
+            MqttClient::ConnectionStats connection = client.connection_stats();
+            hackrf_mqtt::MetricLabels labels = {{"client", role}};
+            out.counter("mqtt_connects_total", labels, connection.connects);
+            out.counter("mqtt_disconnects_total", labels, connection.disconnects);
+            out.counter("mqtt_connect_failures_total", labels, connection.connect_failures);
+            out.gauge("mqtt_connected", labels, client.is_connected() ? 1 : 0);
+        };
+        add_client("data", mqtt_client);
+        // QoS 1/2 sinks sharing the data connection; sinks with their own connections report theirs.
+        MqttClient::AckLatency ack = mqtt_client.ack_latency();
+        out.histogram("mqtt_publish_to_ack_ns", {{"client", "data"}}, std::move(ack.publish_to_ack_ns));
+        out.histogram("mqtt_capture_to_ack_ns", {{"client", "data"}}, std::move(ack.capture_to_ack_ns));
+        if (control_client_owned) {
+            add_client("control", *control_client_owned);
+        }
+        out.counter("control_commands_total", {}, control_client->control_stats().commands);
+        out.counter("log_messages_dropped_total", {}, hackrf_mqtt::logger::dropped());
+        out.counter("log_messages_suppressed_total", {}, hackrf_mqtt::logger::suppressed());
+    });
+    metrics.add_collector(hackrf_mqtt::collect_thread_cpu);
+    std::unique_ptr<hackrf_mqtt::MetricsHttpServer> metrics_server;
+    if (app_config.metrics.http_enabled) {
+        metrics_server = std::make_unique<hackrf_mqtt::MetricsHttpServer>(metrics, app_config.metrics.http_bind,
+                                                                          app_config.metrics.http_port);
+        if (!metrics_server->start()) {
+            metrics_server.reset(); // Scrapes are optional; keep streaming without them
+        }
+    }
 
-    std::atomic<bool> publisher_should_run(true);
-    std::atomic<bool> hackrf_should_be_streaming(true);
+    std::unique_ptr<hackrf_mqtt::DeviceSupervisor> supervisor;
+    auto shutdown_devices = [&] {
+        if (metrics_server) {
+            metrics_server->stop();
+        }
+        if (supervisor) {
+            supervisor->stop(); // No recovery may start on a device being torn down
+        }
+        for (uint64_t id : device_collectors) {
+            metrics.remove_collector(id);
+        }
+        device_collectors.clear();
+        for (auto& session : sessions) {
+            session->shutdown();
+        }
+    };
 
-    auto control_command_handler =
-        [&](const std::string& payload, HackRFHandler& handler, DataQueue& queue) {
+    // Control payloads: "PAUSE" / "RESUME", or JSON {"cmd": "<name>", "value": ..., "id": "<echoed in the reply>",
+    // "device": "<name>"}. Without "device" a command goes to every device.
+    auto control_command_handler = [&](const std::string& payload) {
         LOG_INFO("Control command received: '", payload, "'");
-        if (payload == "PAUSE") {
-            if (hackrf_should_be_streaming.load() && handler.is_streaming()) {
-                LOG_INFO("Pausing HackRF stream via MQTT command.");
-                handler.stop_rx();
-                hackrf_should_be_streaming = false;
-            } else {
-                LOG_INFO("HackRF already paused or not streaming. 'PAUSE' command ignored.");
+        uint64_t requested_ns = hackrf_mqtt::monotonic_now_ns();
+
+        std::string cmd = payload;
+        std::string id;
+        std::string device;
+        nlohmann::json value;
+        if (!payload.empty() && payload.front() == '{') {
+            try {
+                nlohmann::json json = nlohmann::json::parse(payload);
+                cmd = json.at("cmd").get<std::string>();
+                id = json.value("id", std::string());
+                device = json.value("device", std::string());
+                value = json.value("value", nlohmann::json());
+            } catch (const nlohmann::json::exception& e) {
+                LOG_WARN("Malformed control command: ", e.what());
+                Completion rejected;
+                rejected.command = "invalid";
+                rejected.message = std::string("malformed command: ") + e.what();
+                publish_reply("", rejected);
+                return;
             }
-        } else if (payload == "RESUME") {
-            if (!hackrf_should_be_streaming.load() && !handler.is_streaming()) {
-                LOG_INFO("Resuming HackRF stream via MQTT command.");
-                if (handler.start_rx(hackrf_rx_callback, &queue)) {
-                    hackrf_should_be_streaming = true;
-                } else {
-                    LOG_ERROR("Failed to resume HackRF stream via MQTT command.");
-                }
-            } else {
-                LOG_INFO("HackRF already streaming or not in a state to resume. 'RESUME' command ignored.");
+        }
+
+        bool matched = false;
+        for (auto& session : sessions) {
+            if (device.empty() || session->name() == device) {
+                matched = true;
+                session->handle_command(cmd, value, id, requested_ns);
             }
-        } else {
-            LOG_WARN("Unknown control command received: '", payload, "'");
+        }
+        if (!matched) {
+            Completion rejected;
+            rejected.command = cmd;
+            rejected.request_id = id;
+            rejected.message = "unknown device '" + device + "'";
+            publish_reply(device, rejected);
         }
     };
 
     if (!app_config.mqtt.control_topic.empty()) {
-        mqtt_client.set_control_command_callback(
-            [&](const std::string& payload) {
-                control_command_handler(payload, hackrf_handler, iq_data_queue);
-            }
-        );
-        mqtt_client.set_control_topic(app_config.mqtt.control_topic, app_config.mqtt.qos);
-        LOG_INFO("MQTT control enabled. Subscribed to topic: ", app_config.mqtt.control_topic);
+        control_client->set_control_command_callback(control_command_handler);
+        control_client->set_control_topic(app_config.mqtt.control_topic, app_config.mqtt.qos);
+        LOG_INFO("MQTT control enabled (", control_client_owned ? "separate" : "shared",
+                 " connection). Subscribed to topic: ", app_config.mqtt.control_topic);
     }
 
-
-    // Start MQTT Publisher Thread
-    std::thread publisher_thread(
-        mqtt_publisher_thread_func, 
-        std::ref(iq_data_queue), 
-        std::ref(mqtt_client), 
-        std::cref(app_config.mqtt), // Pass MqttConfig by const reference
-        std::ref(publisher_should_run)
-    );
+    // Start pipeline stage threads (including the MQTT sinks)
+    for (auto& session : sessions) {
+        if (!session->start_pipeline()) {
+            shutdown_devices();
+            return 1;
+        }
+    }
 
 
     try {
-        LOG_INFO("Initializing HackRF...");
-        if (!hackrf_handler.init()) {
-            LOG_ERROR("Failed to initialize HackRF.");
-            publisher_should_run = false;
-            if(publisher_thread.joinable()) publisher_thread.join();
-            return 1;
+        for (auto& session : sessions) {
+            if (!session->open()) {
+                shutdown_devices();
+                return 1;
+            }
         }
-
-        hackrf_handler.set_frequency(app_config.hackrf.center_frequency_hz);
-        hackrf_handler.set_sample_rate(app_config.hackrf.sample_rate_hz);
-        hackrf_handler.set_baseband_filter_bandwidth(app_config.hackrf.baseband_filter_bandwidth_hz);
-        
-        LOG_INFO("Setting LNA gain to: ", app_config.hackrf.lna_gain, " dB");
-        hackrf_handler.set_lna_gain(app_config.hackrf.lna_gain);
-        LOG_INFO("Setting VGA gain to: ", app_config.hackrf.vga_gain, " dB");
-        hackrf_handler.set_vga_gain(app_config.hackrf.vga_gain);
         
         LOG_INFO("Connecting to MQTT broker...");
         if (!mqtt_client.connect_to_broker()) {
             LOG_ERROR("Failed to initiate MQTT connection.");
-            hackrf_handler.deinit();
+            shutdown_devices();
+            return 1;
+        }
+        
+        if (control_client_owned && !control_client_owned->connect_to_broker()) {
+            LOG_ERROR("Failed to initiate MQTT control connection.");
+            shutdown_devices();
             return 1;
         }
         
         int connect_timeout_ms = 5000;
         int time_waited_ms = 0;
-        while(!mqtt_client.is_connected() && time_waited_ms < connect_timeout_ms && keep_running == 1) {
+        while((!mqtt_client.is_connected() || !control_client->is_connected()) &&
+              time_waited_ms < connect_timeout_ms && keep_running == 1) {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
             time_waited_ms += 100;
         }
 
-        if (!mqtt_client.is_connected()) {
+        if (!mqtt_client.is_connected() || !control_client->is_connected()) {
             LOG_ERROR("MQTT connection timed out or failed.");
-            hackrf_handler.deinit();
-            publisher_should_run = false;
-            if(publisher_thread.joinable()) publisher_thread.join();
+            if (control_client_owned) control_client_owned->disconnect_from_broker();
+            shutdown_devices();
             return 1;
         }
         
         LOG_INFO("Attempting to start HackRF stream initially...");
-        if (hackrf_should_be_streaming.load()) {
-            if (!hackrf_handler.start_rx(hackrf_rx_callback, &iq_data_queue)) {
-                LOG_ERROR("Failed to start HackRF stream initially.");
+        for (auto& session : sessions) {
+            if (!session->start_streaming()) {
                 if (mqtt_client.is_connected()) mqtt_client.disconnect_from_broker();
-                hackrf_handler.deinit();
-                publisher_should_run = false; 
-                if (publisher_thread.joinable()) publisher_thread.join();
+                shutdown_devices();
                 return 1;
             }
-            LOG_INFO("HackRF stream started. Send 'PAUSE'/'RESUME' to '", app_config.mqtt.control_topic, "' to control.");
-        } else {
-            LOG_INFO("HackRF initially set to not stream.");
         }
+        LOG_INFO("HackRF stream started on ", sessions.size(), " device(s). Send 'PAUSE'/'RESUME' to '",
+                 app_config.mqtt.control_topic, "' to control.");
+        std::vector<hackrf_mqtt::DeviceSession*> supervised;
+        for (auto& session : sessions) {
+            supervised.push_back(session.get());
+        }
+        supervisor = std::make_unique<hackrf_mqtt::DeviceSupervisor>(
+            supervised, std::chrono::milliseconds(app_config.recovery.check_interval_ms));
+        supervisor->start();
         
+        auto last_stats_log = std::chrono::steady_clock::now();
+        auto last_metrics_publish = last_stats_log;
         while (keep_running == 1 ) {
             if (!mqtt_client.is_connected()) {
                 LOG_ERROR("MQTT client disconnected. Shutting down application.");
                 keep_running = 0;
                 break;
             }
-            // The main loop can perform other periodic tasks if needed.
-            // For now, it primarily keeps the application alive while other threads work.
+            // Periodic per-stage throughput report.
+            auto now = std::chrono::steady_clock::now();
+            if (app_config.pipeline.stats_interval_s > 0 &&
+                now - last_stats_log >= std::chrono::seconds(app_config.pipeline.stats_interval_s)) {
+                for (auto& session : sessions) {
+                    session->log_stats();
+                }
+                MqttClient::ControlStats control_stats = control_client->control_stats();
+                if (control_stats.commands > 0) {
+                    LOG_INFO("Stats [control]: ", control_stats.commands, " commands, dispatched in ",
+                             control_stats.total_ns / control_stats.commands / 1000, " us avg / ",
+                             control_stats.max_ns / 1000, " us max");
+                }
+                last_stats_log = now;
+            }
+            if (!app_config.mqtt.stats_topic.empty() && app_config.mqtt.stats_interval_s > 0 &&
+                control_client->is_connected() &&
+                now - last_metrics_publish >= std::chrono::seconds(app_config.mqtt.stats_interval_s)) {
+                // On the control connection, so a backed-up data stream does not delay it.
+                control_client->publish_message(app_config.mqtt.stats_topic,
+                                                 hackrf_mqtt::encode_metrics_json(metrics.snapshot()),
+                                                 app_config.mqtt.qos);
+                last_metrics_publish = now;
+            }
             std::this_thread::sleep_for(std::chrono::milliseconds(500));
         }
 
@@ -280,24 +454,17 @@ int main(int argc, char* argv[]) {
     }
 
     LOG_INFO("Shutting down...");
-    publisher_should_run = false;
-    if (publisher_thread.joinable()) {
-        LOG_INFO("Waiting for MQTT publisher thread to finish...");
-        publisher_thread.join();
-        LOG_INFO("MQTT publisher thread finished.");
-    }
-
-    if (hackrf_handler.is_streaming()) {
-        LOG_INFO("Stopping HackRF stream...");
-        hackrf_handler.stop_rx();
-    }
-    LOG_INFO("Deinitializing HackRF...");
-    hackrf_handler.deinit(); 
+    LOG_INFO("Stopping processing pipelines and HackRF devices...");
+    shutdown_devices();
 
     if (mqtt_client.is_connected()) {
         LOG_INFO("Disconnecting from MQTT broker...");
         mqtt_client.disconnect_from_broker();
     }
+    if (control_client_owned) {
+        control_client_owned->disconnect_from_broker();
+        control_client_owned->loop_stop(true);
+    }
     
     LOG_INFO("HackRF MQTT Transmitter finished.");
     return 0;
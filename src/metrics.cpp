@@ -0,0 +1,301 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#include <nlohmann/json.hpp>
+
+namespace hackrf_mqtt {
+
+uint64_t HistogramSnapshot::quantile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    // Rank of the quantile, 1-based: the smallest value with at least q * count at or below it.
+    uint64_t rank = static_cast<uint64_t>(q * count + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(Histogram::bucket_upper_bound(i), max);
+        }
+    }
+    return max;
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot& other) {
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+    if (buckets.size() < other.buckets.size()) {
+        buckets.resize(other.buckets.size(), 0);
+    }
+    for (size_t i = 0; i < other.buckets.size(); ++i) {
+        buckets[i] += other.buckets[i];
+    }
+}
+
+HistogramSnapshot Histogram::snapshot() const {
+    HistogramSnapshot snapshot;
+    snapshot.buckets.resize(kBucketCount);
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += snapshot.buckets[i];
+    }
+    // Use the bucket total as the count so quantiles stay consistent with the buckets read.
+    snapshot.count = total;
+    snapshot.sum = sum_.load(std::memory_order_relaxed);
+    snapshot.max = max_.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+uint64_t Histogram::bucket_upper_bound(size_t index) {
+    if (index < kSubBuckets) {
+        return index;
+    }
+    size_t shift = index / kSubBuckets - 1;
+    uint64_t lower = (uint64_t(kSubBuckets) + index % kSubBuckets) << shift;
+    return lower + ((uint64_t(1) << shift) - 1);
+}
+
+MetricLabels with_label(MetricLabels labels, std::string key, std::string value) {
+    labels.emplace_back(std::move(key), std::move(value));
+    return labels;
+}
+
+uint64_t MetricsRegistry::add_collector(Collector collector) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t id = next_id_++;
+    collectors_.emplace(id, std::move(collector));
+    return id;
+}
+
+void MetricsRegistry::remove_collector(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    collectors_.erase(id);
+}
+
+MetricsSnapshot MetricsRegistry::snapshot() const {
+    MetricsSnapshot snapshot;
+    snapshot.time_ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    snapshot.uptime_s = (monotonic_now_ns() - created_ns_) / 1e9;
+    // Held while collecting, so remove_collector() returns only once its collector is done.
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : collectors_) {
+        entry.second(snapshot);
+    }
+    return snapshot;
+}
+
+namespace {
+
+std::string metric_key(const std::string& name, const MetricLabels& labels) {
+    if (labels.empty()) {
+        return name;
+    }
+    std::string key = name + "{";
+    for (size_t i = 0; i < labels.size(); ++i) {
+        key += (i ? "," : "") + labels[i].first + "=" + labels[i].second;
+    }
+    return key + "}";
+}
+
+} // namespace
+
+std::string encode_metrics_json(const MetricsSnapshot& snapshot) {
+    nlohmann::json counters = nlohmann::json::object();
+    nlohmann::json gauges = nlohmann::json::object();
+    for (const auto& value : snapshot.values) {
+        nlohmann::json& target = value.type == MetricsSnapshot::Type::COUNTER ? counters : gauges;
+        // Integral values stay integers on the wire.
+        if (value.value == static_cast<double>(static_cast<uint64_t>(value.value))) {
+            target[metric_key(value.name, value.labels)] = static_cast<uint64_t>(value.value);
+        } else {
+            target[metric_key(value.name, value.labels)] = value.value;
+        }
+    }
+    nlohmann::json histograms = nlohmann::json::object();
+    for (const auto& value : snapshot.histograms) {
+        const HistogramSnapshot& h = value.histogram;
+        histograms[metric_key(value.name, value.labels)] = {
+            {"count", h.count}, {"sum", h.sum}, {"max", h.max},
+            {"p50", h.quantile(0.5)}, {"p90", h.quantile(0.9)}, {"p99", h.quantile(0.99)}, {"p999", h.quantile(0.999)}};
+    }
+    nlohmann::json out = {
+        {"time_ms", snapshot.time_ms},
+        {"uptime_s", snapshot.uptime_s},
+        {"counters", std::move(counters)},
+        {"gauges", std::move(gauges)},
+        {"histograms", std::move(histograms)}};
+    return out.dump();
+}
+
+namespace {
+
+std::string escape_label_value(const std::string& value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+void write_series(std::ostringstream& out, const std::string& name, const MetricLabels& labels,
+                  const char* extra_label, const char* extra_value, double value) {
+    out << name;
+    if (!labels.empty() || extra_label) {
+        out << '{';
+        bool first = true;
+        for (const auto& label : labels) {
+            out << (first ? "" : ",") << label.first << "=\"" << escape_label_value(label.second) << '"';
+            first = false;
+        }
+        if (extra_label) {
+            out << (first ? "" : ",") << extra_label << "=\"" << extra_value << '"';
+        }
+        out << '}';
+    }
+    out << ' ';
+    if (std::isnan(value)) {
+        out << "NaN";
+    } else if (std::isinf(value)) {
+        out << (value > 0 ? "+Inf" : "-Inf");
+    } else if (value == std::floor(value) && std::fabs(value) < 9.0e15) {
+        out << static_cast<int64_t>(value);
+    } else {
+        out << std::setprecision(12) << value;
+    }
+    out << '\n';
+}
+
+bool ends_with(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // namespace
+
+std::string encode_prometheus_text(const MetricsSnapshot& snapshot) {
+    // Samples of one metric must follow its # TYPE line, so group by name first.
+    std::map<std::string, std::vector<const MetricsSnapshot::Value*>> values;
+    for (const auto& value : snapshot.values) {
+        values[value.name].push_back(&value);
+    }
+    std::map<std::string, std::vector<const MetricsSnapshot::HistogramValue*>> histograms;
+    for (const auto& value : snapshot.histograms) {
+        histograms[value.name].push_back(&value);
+    }
+
+    std::ostringstream out;
+    for (const auto& metric : values) {
+        const char* type = metric.second.front()->type == MetricsSnapshot::Type::COUNTER ? "counter" : "gauge";
+        out << "# TYPE " << metric.first << ' ' << type << '\n';
+        for (const MetricsSnapshot::Value* value : metric.second) {
+            write_series(out, metric.first, value->labels, nullptr, nullptr, value->value);
+        }
+    }
+    static const std::pair<const char*, double> kQuantiles[] = {
+        {"0.5", 0.5}, {"0.9", 0.9}, {"0.99", 0.99}, {"0.999", 0.999}};
+    for (const auto& metric : histograms) {
+        std::string name = metric.first;
+        double scale = 1.0;
+        if (ends_with(name, "_ns")) {
+            name = name.substr(0, name.size() - 3) + "_seconds";
+            scale = 1e-9;
+        }
+        out << "# TYPE " << name << " summary\n";
+        for (const MetricsSnapshot::HistogramValue* value : metric.second) {
+            const HistogramSnapshot& h = value->histogram;
+            for (const auto& quantile : kQuantiles) {
+                write_series(out, name, value->labels, "quantile", quantile.first, h.quantile(quantile.second) * scale);
+            }
+            write_series(out, name + "_sum", value->labels, nullptr, nullptr, h.sum * scale);
+            write_series(out, name + "_count", value->labels, nullptr, nullptr, static_cast<double>(h.count));
+        }
+        out << "# TYPE " << name << "_max gauge\n";
+        for (const MetricsSnapshot::HistogramValue* value : metric.second) {
+            write_series(out, name + "_max", value->labels, nullptr, nullptr, value->histogram.max * scale);
+        }
+    }
+    return out.str();
+}
+
+void collect_thread_cpu(MetricsSnapshot& out) {
+#ifdef __linux__
+    const double tick_s = 1.0 / static_cast<double>(sysconf(_SC_CLK_TCK));
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir) {
+        return;
+    }
+    std::map<std::string, uint64_t> ticks_by_name;
+    uint64_t total_ticks = 0;
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        std::ifstream file(std::string("/proc/self/task/") + entry->d_name + "/stat");
+        std::string line;
+        if (!std::getline(file, line)) {
+            continue; // The thread exited in between
+        }
+        // "tid (comm) state ..." where comm may itself contain spaces or parentheses.
+        size_t open = line.find('(');
+        size_t close = line.rfind(')');
+        if (open == std::string::npos || close == std::string::npos || close < open) {
+            continue;
+        }
+        std::istringstream fields(line.substr(close + 2));
+        std::string field;
+        uint64_t utime = 0;
+        uint64_t stime = 0;
+        // Fields 3 to 13 precede utime (14) and stime (15).
+        for (int i = 3; i <= 15 && fields >> field; ++i) {
+            if (i == 14) utime = std::strtoull(field.c_str(), nullptr, 10);
+            if (i == 15) stime = std::strtoull(field.c_str(), nullptr, 10);
+        }
+        ticks_by_name[line.substr(open + 1, close - open - 1)] += utime + stime;
+        total_ticks += utime + stime;
+    }
+    closedir(dir);
+    // Threads that have exited are missing from the sum; the process total includes them.
+    std::ifstream file("/proc/self/stat");
+    std::string line;
+    if (std::getline(file, line) && line.rfind(')') != std::string::npos) {
+        std::istringstream fields(line.substr(line.rfind(')') + 2));
+        std::string field;
+        uint64_t process_ticks = 0;
+        for (int i = 3; i <= 15 && fields >> field; ++i) {
+            if (i == 14 || i == 15) process_ticks += std::strtoull(field.c_str(), nullptr, 10);
+        }
+        total_ticks = std::max(total_ticks, process_ticks);
+    }
+    out.counter("process_cpu_seconds_total", {}, total_ticks * tick_s);
+    for (const auto& entry : ticks_by_name) {
+        out.counter("thread_cpu_seconds_total", {{"thread", entry.first}}, entry.second * tick_s);
+    }
+#else
+    (void)out;
+#endif
+}
+
+} // namespace hackrf_mqtt
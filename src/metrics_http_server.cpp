@@ -0,0 +1,177 @@
+#include "metrics_http_server.h"
+#include "logger.h"
+#include "metrics.h"
+#include "thread_util.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace hackrf_mqtt {
+
+namespace {
+
+constexpr size_t kMaxRequestBytes = 8192;
+constexpr int kClientTimeoutMs = 2000;
+
+bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+std::string response(const char* status, const char* content_type, const std::string& body, bool head) {
+    std::string out = std::string("HTTP/1.1 ") + status + "\r\n" +
+                      "Content-Type: " + content_type + "\r\n" +
+                      "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+                      "Connection: close\r\n\r\n";
+    if (!head) {
+        out += body;
+    }
+    return out;
+}
+
+} // namespace
+
+MetricsHttpServer::MetricsHttpServer(const MetricsRegistry& registry, std::string bind_address, uint16_t port)
+    : registry_(registry),
+      bind_address_(std::move(bind_address)),
+      port_(port) {
+}
+
+MetricsHttpServer::~MetricsHttpServer() {
+    stop();
+}
+
+bool MetricsHttpServer::start() {
+    if (thread_.joinable()) {
+        return true;
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* results = nullptr;
+    std::string port = std::to_string(port_);
+    int gai = getaddrinfo(bind_address_.empty() ? nullptr : bind_address_.c_str(), port.c_str(), &hints, &results);
+    if (gai != 0) {
+        LOG_ERROR("Metrics HTTP: Cannot resolve ", bind_address_, ": ", gai_strerror(gai));
+        return false;
+    }
+    for (addrinfo* ai = results; ai && listen_fd_ < 0; ai = ai->ai_next) {
+        int fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (::bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || ::listen(fd, 8) != 0) {
+            ::close(fd);
+            continue;
+        }
+        listen_fd_ = fd;
+    }
+    freeaddrinfo(results);
+    if (listen_fd_ < 0) {
+        LOG_ERROR("Metrics HTTP: Cannot listen on ", bind_address_, ":", port_, ": ", std::strerror(errno));
+        return false;
+    }
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        LOG_ERROR("Metrics HTTP: eventfd failed: ", std::strerror(errno));
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    thread_ = std::thread([this] { run(); });
+    LOG_INFO("Metrics HTTP: Serving http://", bind_address_, ":", port_, "/metrics");
+    return true;
+}
+
+void MetricsHttpServer::stop() {
+    if (thread_.joinable()) {
+        uint64_t one = 1;
+        ssize_t written = ::write(wake_fd_, &one, sizeof(one));
+        (void)written;
+        thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+    }
+    if (wake_fd_ >= 0) {
+        ::close(wake_fd_);
+        wake_fd_ = -1;
+    }
+}
+
+void MetricsHttpServer::run() {
+    set_current_thread_name("metrics-http");
+    for (;;) {
+        pollfd fds[2] = {{listen_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Metrics HTTP: poll failed: ", std::strerror(errno));
+            return;
+        }
+        if (fds[1].revents) {
+            return;
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                serve(fd);
+                ::close(fd);
+            }
+        }
+    }
+}
+
+void MetricsHttpServer::serve(int fd) {
+    timeval timeout{kClientTimeoutMs / 1000, (kClientTimeoutMs % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Only the request line matters; read until the end of the headers.
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequestBytes) {
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        request.append(buffer, static_cast<size_t>(n));
+    }
+    size_t line_end = request.find("\r\n");
+    std::string line = request.substr(0, line_end);
+    size_t method_end = line.find(' ');
+    size_t path_end = method_end == std::string::npos ? std::string::npos : line.find(' ', method_end + 1);
+    if (line_end == std::string::npos || path_end == std::string::npos) {
+        send_all(fd, response("400 Bad Request", "text/plain", "Bad request\n", false));
+        return;
+    }
+    std::string method = line.substr(0, method_end);
+    std::string path = line.substr(method_end + 1, path_end - method_end - 1);
+    path = path.substr(0, path.find('?'));
+    const bool head = method == "HEAD";
+    if (method != "GET" && !head) {
+        send_all(fd, response("405 Method Not Allowed", "text/plain", "Only GET is supported\n", false));
+        return;
+    }
+    if (path != "/metrics") {
+        send_all(fd, response("404 Not Found", "text/plain", "Metrics are at /metrics\n", head));
+        return;
+    }
+    std::string body = encode_prometheus_text(registry_.snapshot());
+    send_all(fd, response("200 OK", "text/plain; version=0.0.4; charset=utf-8", body, head));
+}
+
+} // namespace hackrf_mqtt
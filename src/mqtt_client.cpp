@@ -1,6 +1,10 @@
 #include "mqtt_client.h"
 #include "logger.h" // Include our logger
+#include "sample_block.h"
+#include "socket_tuning.h"
+#include <algorithm>
 #include <cstring>  // For strlen, memcpy
+#include <poll.h>
 
 // The MosquittoInitializer in main.cpp handles lib_init/lib_cleanup globally.
 // No need for the static counter logic here anymore.
@@ -48,12 +52,25 @@ void MqttClient::set_keepalive(int keepalive) {
     keepalive_seconds_ = keepalive;
 }
 
+void MqttClient::set_socket_tuning(const hackrf_mqtt::MqttSocketConfig& tuning) {
+    socket_tuning_ = tuning;
+    socket_tuning_.zerocopy = false; // libmosquitto owns the send path
+    socket_tuning_.tcp_cork = false;
+}
+
 bool MqttClient::connect_to_broker() {
     if (connected_flag_.load()) {
         LOG_INFO("MQTT: Already connected or attempting to connect.");
         return true;
     }
 
+    if (external_loop_) {
+        // The driving thread picks this up in network_misc().
+        connect_pending_ = true;
+        LOG_INFO("MQTT: Attempting to connect to ", host_, ":", port_, " (external network loop)...");
+        return true;
+    }
+
     int rc = loop_start();
     if (rc != MOSQ_ERR_SUCCESS) {
         LOG_ERROR("MQTT: Error starting network loop: ", mosqpp::strerror(rc));
@@ -91,6 +108,48 @@ bool MqttClient::is_connected() const {
     return connected_flag_.load();
 }
 
+void MqttClient::set_external_network_loop(bool external) {
+    external_loop_ = external;
+}
+
+int MqttClient::network_socket() {
+    return socket();
+}
+
+bool MqttClient::network_wants_write() {
+    return want_write();
+}
+
+int MqttClient::network_read() {
+    network_owner_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    int rc = loop_read(1);
+    if (rc != MOSQ_ERR_SUCCESS && rc != MOSQ_ERR_NO_CONN) {
+        LOG_WARN("MQTT: Network read failed: ", mosqpp::strerror(rc));
+    }
+    return rc;
+}
+
+int MqttClient::network_write() {
+    network_owner_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    int rc = loop_write(1);
+    if (rc != MOSQ_ERR_SUCCESS && rc != MOSQ_ERR_NO_CONN) {
+        LOG_WARN("MQTT: Network write failed: ", mosqpp::strerror(rc));
+    }
+    return rc;
+}
+
+int MqttClient::network_misc() {
+    network_owner_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    if (connect_pending_.exchange(false)) {
+        int rc = connect_async(host_.c_str(), port_, keepalive_seconds_);
+        if (rc != MOSQ_ERR_SUCCESS) {
+            LOG_ERROR("MQTT: Error initiating connection: ", mosqpp::strerror(rc));
+            return rc;
+        }
+    }
+    return loop_misc();
+}
+
 void MqttClient::set_control_topic(const std::string& topic, int qos) {
     control_topic_str_ = topic;
     control_topic_qos_ = qos;
@@ -107,15 +166,122 @@ void MqttClient::set_control_command_callback(std::function<void(const std::stri
     on_control_command_received_callback_ = callback;
 }
 
-int MqttClient::publish_message(const std::string& topic, const void* payload, int payloadlen, int qos, bool retain) {
+MqttClient::ControlStats MqttClient::control_stats() const {
+    ControlStats stats;
+    stats.commands = control_commands_.load(std::memory_order_relaxed);
+    stats.total_ns = control_total_ns_.load(std::memory_order_relaxed);
+    stats.max_ns = control_max_ns_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+MqttClient::ConnectionStats MqttClient::connection_stats() const {
+    ConnectionStats stats;
+    stats.connects = connects_.load(std::memory_order_relaxed);
+    stats.disconnects = disconnects_.load(std::memory_order_relaxed);
+    stats.connect_failures = connect_failures_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void MqttClient::set_inflight_window(size_t max_messages, std::chrono::milliseconds wait_timeout) {
+    std::lock_guard<std::recursive_mutex> lock(inflight_mutex_);
+    inflight_window_ = max_messages;
+    inflight_wait_timeout_ = wait_timeout;
+    if (max_messages > 0) {
+        max_inflight_messages_set(static_cast<unsigned int>(max_messages));
+    }
+}
+
+MqttClient::InflightStats MqttClient::inflight_stats() const {
+    std::lock_guard<std::recursive_mutex> lock(inflight_mutex_);
+    InflightStats stats = inflight_stats_;
+    stats.in_flight = inflight_mids_.size();
+    return stats;
+}
+
+bool MqttClient::acquire_inflight_slot_locked(std::unique_lock<std::recursive_mutex>& lock) {
+    if (inflight_mids_.size() < inflight_window_) {
+        return true;
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + inflight_wait_timeout_;
+    // With the external loop, only the thread driving the socket may read it; nobody else
+    // would, so it services the socket here (acks in, queued messages out). Every other
+    // publisher waits for on_publish, as with the library's own network thread.
+    const bool drive_socket = external_loop_ &&
+        network_owner_.load(std::memory_order_relaxed) == std::this_thread::get_id();
+    while (inflight_mids_.size() >= inflight_window_) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) break;
+        if (!drive_socket) {
+            inflight_cv_.wait_until(lock, deadline);
+            continue;
+        }
+        lock.unlock();
+        int remaining_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count());
+        pollfd pfd{socket(), static_cast<short>(POLLIN | (want_write() ? POLLOUT : 0)), 0};
+        bool failed = pfd.fd < 0;
+        if (!failed && poll(&pfd, 1, std::max(1, remaining_ms)) > 0) {
+            if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                failed = true;
+            }
+            if (!failed && (pfd.revents & POLLIN)) {
+                failed = network_read() != MOSQ_ERR_SUCCESS;
+            }
+            if (!failed && (pfd.revents & POLLOUT)) {
+                failed = network_write() != MOSQ_ERR_SUCCESS;
+            }
+        }
+        lock.lock();
+        if (failed) {
+            // The caller's event loop sees the same error and reconnects.
+            break;
+        }
+    }
+    inflight_stats_.wait_ns += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    if (inflight_mids_.size() >= inflight_window_) {
+        ++inflight_stats_.window_full;
+        return false;
+    }
+    return true;
+}
+
+MqttClient::AckLatency MqttClient::ack_latency() const {
+    AckLatency latency;
+    latency.publish_to_ack_ns = publish_to_ack_ns_.snapshot();
+    latency.capture_to_ack_ns = capture_to_ack_ns_.snapshot();
+    return latency;
+}
+
+int MqttClient::publish_message(const std::string& topic, const void* payload, int payloadlen, int qos, bool retain,
+                                uint64_t capture_time_ns) {
     if (!connected_flag_.load()) {
-        LOG_WARN("MQTT: Not connected. Cannot publish message to topic '", topic, "'.");
+        LOG_WARN_EVERY_MS(1000, "MQTT: Not connected. Cannot publish message to topic '", topic, "'.");
         return MOSQ_ERR_NO_CONN;
     }
     int mid_ptr;
-    int rc = mosquittopp::publish(&mid_ptr, topic.c_str(), payloadlen, payload, qos, retain);
+    int rc;
+    if (qos > 0 && inflight_window_ > 0) {
+        // Held across publish() and the insert, so an ack racing in on the network
+        // thread cannot be looked up before its mid is recorded.
+        std::unique_lock<std::recursive_mutex> lock(inflight_mutex_);
+        if (!acquire_inflight_slot_locked(lock)) {
+            return PUBLISH_WINDOW_FULL;
+        }
+        rc = mosquittopp::publish(&mid_ptr, topic.c_str(), payloadlen, payload, qos, retain);
+        if (rc == MOSQ_ERR_SUCCESS) {
+            uint64_t now_ns = hackrf_mqtt::monotonic_now_ns();
+            if (inflight_mids_.empty()) {
+                inflight_stats_.progress_ns = now_ns;
+            }
+            inflight_mids_[mid_ptr] = InflightMessage{now_ns, capture_time_ns};
+            inflight_stats_.high_water = std::max(inflight_stats_.high_water, inflight_mids_.size());
+        }
+    } else {
+        rc = mosquittopp::publish(&mid_ptr, topic.c_str(), payloadlen, payload, qos, retain);
+    }
     if (rc != MOSQ_ERR_SUCCESS) {
-        LOG_ERROR("MQTT: Error publishing message to topic '", topic, "': ", mosqpp::strerror(rc));
+        LOG_ERROR_EVERY_MS(1000, "MQTT: Error publishing message to topic '", topic, "': ", mosqpp::strerror(rc));
     } else {
         LOG_DEBUG("MQTT: Published message to topic '", topic, "' (MID: ", mid_ptr, ")");
     }
@@ -123,7 +289,7 @@ int MqttClient::publish_message(const std::string& topic, const void* payload, i
 }
 
 int MqttClient::publish_message(const std::string& topic, const std::string& message, int qos, bool retain) {
-    return publish_message(topic, message.c_str(), static_cast<int>(message.length()), qos, retain);
+    return publish_message(topic, message.c_str(), static_cast<int>(message.length()), qos, retain, 0);
 }
 
 // --- Callbacks ---
@@ -132,6 +298,8 @@ void MqttClient::on_connect(int rc) {
     if (rc == 0) {
         LOG_INFO("MQTT: Connected to broker successfully.");
         connected_flag_ = true;
+        connects_.fetch_add(1, std::memory_order_relaxed);
+        hackrf_mqtt::apply_socket_tuning(socket(), socket_tuning_, "MQTT");
         if (!control_topic_str_.empty()) {
             int sub_rc = subscribe(nullptr, control_topic_str_.c_str(), control_topic_qos_);
             if (sub_rc != MOSQ_ERR_SUCCESS) {
@@ -142,6 +310,7 @@ void MqttClient::on_connect(int rc) {
     } else {
         LOG_ERROR("MQTT: Connection failed: ", mosqpp::connack_string(rc));
         connected_flag_ = false;
+        connect_failures_.fetch_add(1, std::memory_order_relaxed);
         // loop_stop(true); // Stop the loop if connection failed.
                          // This is important as connect_async was used.
                          // The main application loop might also handle this.
@@ -151,6 +320,18 @@ void MqttClient::on_connect(int rc) {
 void MqttClient::on_disconnect(int rc) {
     LOG_INFO("MQTT: Disconnected from broker (rc: ", rc, "). Reason: ", mosqpp::strerror(rc));
     connected_flag_ = false;
+    disconnects_.fetch_add(1, std::memory_order_relaxed);
+    {
+        // Acks for these mids will never arrive on this connection, so free their slots
+        // instead of leaving the window full until every later publish times out.
+        std::lock_guard<std::recursive_mutex> lock(inflight_mutex_);
+        if (!inflight_mids_.empty()) {
+            LOG_DEBUG("MQTT: Releasing ", inflight_mids_.size(), " in-flight slots after disconnect.");
+            inflight_mids_.clear();
+            inflight_stats_.progress_ns = hackrf_mqtt::monotonic_now_ns();
+        }
+        inflight_cv_.notify_all();
+    }
     // loop_stop(true); // Stop the network loop as we are disconnected.
                      // This is crucial if loop_start() was called.
                      // Consider if auto-reconnect logic is added, this might change.
@@ -158,6 +339,23 @@ void MqttClient::on_disconnect(int rc) {
 
 void MqttClient::on_publish(int mid) {
     LOG_DEBUG("MQTT: Message (MID: ", mid, ") published successfully.");
+    if (inflight_window_ == 0) {
+        return;
+    }
+    // QoS 0 mids are never recorded, so only QoS 1/2 completions free a slot.
+    std::lock_guard<std::recursive_mutex> lock(inflight_mutex_);
+    auto it = inflight_mids_.find(mid);
+    if (it != inflight_mids_.end()) {
+        uint64_t now_ns = hackrf_mqtt::monotonic_now_ns();
+        publish_to_ack_ns_.record(now_ns - std::min(it->second.published_ns, now_ns));
+        if (it->second.capture_time_ns != 0 && now_ns >= it->second.capture_time_ns) {
+            capture_to_ack_ns_.record(now_ns - it->second.capture_time_ns);
+        }
+        inflight_mids_.erase(it);
+        ++inflight_stats_.acked;
+        inflight_stats_.progress_ns = now_ns;
+        inflight_cv_.notify_all();
+    }
 }
 
 void MqttClient::on_message(const struct mosquitto_message* message) {
@@ -173,11 +371,20 @@ void MqttClient::on_message(const struct mosquitto_message* message) {
         if (!control_topic_str_.empty() && topic_str == control_topic_str_) {
             LOG_INFO("MQTT: Control command received on topic '", topic_str, "': '", payload_str, "'");
             if (on_control_command_received_callback_) {
+                auto received = std::chrono::steady_clock::now();
                 try {
                     on_control_command_received_callback_(payload_str);
                 } catch (const std::exception& e) {
                     LOG_ERROR("MQTT: Exception in control command callback: ", e.what());
                 }
+                uint64_t elapsed_ns = static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - received).count());
+                control_commands_.fetch_add(1, std::memory_order_relaxed);
+                control_total_ns_.fetch_add(elapsed_ns, std::memory_order_relaxed);
+                uint64_t prev_max = control_max_ns_.load(std::memory_order_relaxed);
+                while (elapsed_ns > prev_max && !control_max_ns_.compare_exchange_weak(prev_max, elapsed_ns)) {
+                }
+                LOG_DEBUG("MQTT: Control command handled in ", elapsed_ns / 1000, " us.");
             }
         } else {
             LOG_DEBUG("MQTT: Message on non-control topic '", topic_str, "'");
@@ -186,12 +393,16 @@ void MqttClient::on_message(const struct mosquitto_message* message) {
 }
 
 void MqttClient::on_subscribe(int mid, int qos_count, const int* granted_qos) {
-    std::stringstream ss;
-    ss << "MQTT: Subscribed (MID: " << mid << ") with QoS levels: ";
+    using hackrf_mqtt::logger::LogLevel;
+    if (!hackrf_mqtt::logger::compiled_in(LogLevel::INFO) || !hackrf_mqtt::logger::enabled(LogLevel::INFO)) {
+        return;
+    }
+    hackrf_mqtt::logger::LogMessage message;
+    message.append("MQTT: Subscribed (MID: ").append(mid).append(") with QoS levels: ");
     for (int i = 0; i < qos_count; ++i) {
-        ss << granted_qos[i] << (i == qos_count - 1 ? "" : ", ");
+        message.append(granted_qos[i]).append(i == qos_count - 1 ? "" : ", ");
     }
-    LOG_INFO(ss.str());
+    hackrf_mqtt::logger::write(LogLevel::INFO, message.data(), message.size());
 }
 
 void MqttClient::on_unsubscribe(int mid) {
@@ -202,7 +413,8 @@ void MqttClient::on_log(int level, const char* str) {
     // Map mosquitto log levels to our logger if desired, or just log them directly.
     // Mosquitto log levels: MOSQ_LOG_INFO, MOSQ_LOG_NOTICE, MOSQ_LOG_WARNING, MOSQ_LOG_ERR, MOSQ_LOG_DEBUG.
     // Our levels: DEBUG, INFO, WARNING, ERROR.
-    // This callback provides logs from the mosquitto library itself.
+    // This callback provides logs from the mosquitto library itself. A broker outage makes
+    // it repeat the same line on every reconnect attempt, so repeats are collapsed.
     if (str == nullptr) return;
 
     switch (level) {
@@ -211,13 +423,13 @@ void MqttClient::on_log(int level, const char* str) {
             break;
         case MOSQ_LOG_INFO:
         case MOSQ_LOG_NOTICE: // Treat Notice as Info
-            LOG_INFO("MQTT_LIB: ", str);
+            LOG_INFO_DEDUP("MQTT_LIB: ", str);
             break;
         case MOSQ_LOG_WARNING:
-            LOG_WARN("MQTT_LIB: ", str);
+            LOG_WARN_DEDUP("MQTT_LIB: ", str);
             break;
         case MOSQ_LOG_ERR:
-            LOG_ERROR("MQTT_LIB: ", str);
+            LOG_ERROR_DEDUP("MQTT_LIB: ", str);
             break;
         default:
             LOG_DEBUG("MQTT_LIB (Lvl ", level, "): ", str); // Log unknown levels as debug
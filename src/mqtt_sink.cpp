@@ -0,0 +1,539 @@
+#include "mqtt_sink.h"
+#include "block_header.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+namespace hackrf_mqtt {
+
+namespace {
+void store_max(std::atomic<uint64_t>& target, uint64_t value) {
+    // Single writer; a racing reset by the stats thread only loses one sample.
+    if (value > target.load(std::memory_order_relaxed)) target.store(value, std::memory_order_relaxed);
+}
+} // namespace
+
+MqttSinkStage::MqttSinkStage(const StageConfig& config, MqttClient& client, const MqttConfig& mqtt_config,
+                             bool drive_network)
+    : Stage(config.name),
+      client_(client),
+      topic_(config.params.value("topic", mqtt_config.topic)),
+      qos_(config.params.value("qos", mqtt_config.qos)),
+      batch_max_items_(config.batch_max_items),
+      batch_max_bytes_(config.batch_max_bytes),
+      drive_network_(drive_network),
+      block_header_(config.params.value("block_header", mqtt_config.block_header)),
+      zc_max_pending_(std::max<size_t>(1, mqtt_config.socket.zerocopy_max_pending)) {
+    std::string transport = config.params.value("transport", mqtt_config.data_transport);
+    native_transport_ = transport == "native";
+    if (!native_transport_ && transport != "mosquitto") {
+        LOG_WARN("MQTT sink '", name(), "': unknown transport '", transport, "', using mosquitto.");
+    }
+    size_t shard_count = std::max<size_t>(1, config.params.value("shards", mqtt_config.data_shards));
+    std::string policy = config.params.value("shard_policy", mqtt_config.shard_policy);
+    if (policy == "channel") {
+        shard_policy_ = ShardPolicy::CHANNEL;
+    } else if (policy != "round_robin") {
+        throw std::invalid_argument("mqtt_sink: 'shard_policy' must be 'round_robin' or 'channel', got '" + policy + "'");
+    }
+    if (shard_count > 1 && shard_policy_ == ShardPolicy::ROUND_ROBIN && !block_header_) {
+        LOG_INFO("MQTT sink '", name(), "': enabling the block header so subscribers can reorder ", shard_count, " shards.");
+        block_header_ = true;
+    }
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        auto shard = std::make_unique<Shard>();
+        std::string client_id = mqtt_config.client_id + "_" + config.name;
+        if (shard_count > 1) client_id += "_" + std::to_string(i);
+        if (native_transport_) {
+            NativeMqttPublisher::Options options;
+            options.host = mqtt_config.broker_host;
+            options.port = mqtt_config.broker_port;
+            options.client_id = client_id;
+            options.username = mqtt_config.username;
+            options.password = mqtt_config.password;
+            options.keepalive_s = mqtt_config.keepalive_s;
+            options.protocol_version = mqtt_config.native_protocol_version;
+            options.socket = mqtt_config.socket;
+            shard->native = std::make_unique<NativeMqttPublisher>(options);
+        } else if (shard_count == 1) {
+            shard->client = &client_;
+        } else {
+            shard->owned_client = std::make_unique<MqttClient>(client_id.c_str(), true);
+            shard->owned_client->set_host(mqtt_config.broker_host);
+            shard->owned_client->set_port(mqtt_config.broker_port);
+            shard->owned_client->set_keepalive(mqtt_config.keepalive_s);
+            shard->owned_client->set_username_password(mqtt_config.username, mqtt_config.password);
+            shard->owned_client->set_socket_tuning(mqtt_config.socket);
+            shard->owned_client->set_inflight_window(mqtt_config.inflight_window,
+                                                     std::chrono::milliseconds(mqtt_config.inflight_wait_ms));
+            shard->client = shard->owned_client.get();
+        }
+        shards_.push_back(std::move(shard));
+    }
+    if (native_transport_) {
+        native_topic_ = shards_.front()->native->prepare_topic(topic_);
+        if (qos_ != 0) {
+            LOG_WARN("MQTT sink '", name(), "': native transport publishes with QoS 0 (configured QoS ", qos_, ").");
+        }
+    }
+}
+
+bool MqttSinkStage::start() {
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        Shard& shard = *shards_[i];
+        if (shard.native && !shard.native->connect()) {
+            LOG_WARN("MQTT sink '", name(), "': native connection ", i, " failed, will retry.");
+        }
+        if (shard.owned_client && !shard.owned_client->connect_to_broker()) {
+            LOG_WARN("MQTT sink '", name(), "': connection ", i, " could not be started.");
+        }
+    }
+    last_native_service_ = std::chrono::steady_clock::now();
+    reported_time_ns_ = monotonic_now_ns();
+    return true;
+}
+
+void MqttSinkStage::stop() {
+    for (auto& shard : shards_) {
+        if (shard->native) {
+            shard->native->disconnect(); // Releases every zero-copy ticket
+            shard->zc_pending.clear();
+        }
+        if (shard->owned_client) {
+            shard->owned_client->disconnect_from_broker();
+            shard->owned_client->loop_stop(true);
+        }
+    }
+    zc_held_.store(0, std::memory_order_relaxed);
+}
+
+MqttSinkStage::Shard& MqttSinkStage::select_shard(const SampleBlock& block) {
+    if (shards_.size() == 1) {
+        return *shards_.front();
+    }
+    if (shard_policy_ == ShardPolicy::CHANNEL) {
+        // All blocks of a channel share one connection, so they stay in order.
+        return *shards_[block.channel % shards_.size()];
+    }
+    Shard& shard = *shards_[next_shard_];
+    next_shard_ = (next_shard_ + 1) % shards_.size();
+    return shard;
+}
+
+void MqttSinkStage::sync_zerocopy_watch(EventLoop& loop, Shard& shard) {
+#ifdef __linux__
+    // Completions arrive on the socket error queue, which epoll reports as EPOLLERR
+    // (always watched, hence no requested events). Only watched while blocks are held.
+    int fd = shard.zc_pending.empty() ? -1 : shard.native->socket_fd();
+    if (fd == shard.zc_watched_fd) {
+        return;
+    }
+    if (shard.zc_watched_fd >= 0) {
+        loop.remove(shard.zc_watched_fd);
+        shard.zc_watched_fd = -1;
+    }
+    if (fd >= 0 && loop.add(fd, 0, [this, &shard](uint32_t) {
+            size_t held = shard.zc_pending.size();
+            release_zerocopy_blocks(shard);
+            if (shard.zc_pending.size() == held) {
+                shard.native->service(); // Not a completion: a socket error or hang-up
+            }
+        })) {
+        shard.zc_watched_fd = fd;
+    }
+#else
+    (void)loop; (void)shard;
+#endif
+}
+
+void MqttSinkStage::service_native() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_native_service_ >= std::chrono::seconds(1)) {
+        for (auto& shard : shards_) {
+            shard->native->service();
+            release_zerocopy_blocks(*shard);
+        }
+        last_native_service_ = now;
+    }
+}
+
+void MqttSinkStage::release_zerocopy_blocks(Shard& shard) {
+    NativeMqttPublisher& native = *shard.native;
+    native.reap_zerocopy_completions();
+    int waits = 0;
+    for (;;) {
+        uint64_t now_ns = monotonic_now_ns();
+        while (!shard.zc_pending.empty() && native.zerocopy_done(shard.zc_pending.front().ticket)) {
+            uint64_t latency_ns = now_ns - shard.zc_pending.front().sent_ns;
+            zc_completions_.fetch_add(1, std::memory_order_relaxed);
+            zc_completion_ns_.fetch_add(latency_ns, std::memory_order_relaxed);
+            store_max(zc_completion_max_ns_, latency_ns);
+            shard.zc_pending.pop_front();
+        }
+        if (shard.zc_pending.size() < zc_max_pending_) break;
+        // Holding the thread here bounds pinned memory and turns a slow link into
+        // backpressure on the input queue.
+        if (++waits > 50) {
+            // The kernel may still read every pending block, so none can be freed while the
+            // socket is open. Closing it releases all tickets; the loop above then frees the
+            // blocks and service() reconnects.
+            LOG_WARN("MQTT sink '", name(), "': no zero-copy completions for 5 s, dropping the connection.");
+            native.abort_connection();
+            waits = 0;
+            continue;
+        }
+        native.wait_zerocopy_completions(100);
+    }
+    update_zerocopy_stats();
+}
+
+void MqttSinkStage::update_zerocopy_stats() {
+    uint64_t sends = 0, copied = 0, fallbacks = 0, held = 0;
+    for (const auto& shard : shards_) {
+        NativeMqttPublisher::ZeroCopyStats stats = shard->native->zerocopy_stats();
+        sends += stats.sends;
+        copied += stats.copied;
+        fallbacks += stats.fallbacks;
+        held += shard->zc_pending.size();
+    }
+    zc_sends_.store(sends, std::memory_order_relaxed);
+    zc_copied_.store(copied, std::memory_order_relaxed);
+    zc_fallbacks_.store(fallbacks, std::memory_order_relaxed);
+    zc_held_.store(held, std::memory_order_relaxed);
+}
+
+void MqttSinkStage::collect_metrics(MetricsSnapshot& out, const MetricLabels& labels) {
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        const Shard& shard = *shards_[i];
+        MetricLabels shard_labels = shards_.size() > 1 ? with_label(labels, "shard", std::to_string(i)) : labels;
+        out.counter("mqtt_published_blocks_total", shard_labels, shard.blocks.load(std::memory_order_relaxed));
+        out.counter("mqtt_published_bytes_total", shard_labels, shard.bytes.load(std::memory_order_relaxed));
+        if (shard.native) {
+            out.counter("mqtt_connects_total", shard_labels, shard.native->connects());
+        } else if (shard.owned_client) {
+            MqttClient::ConnectionStats connection = shard.owned_client->connection_stats();
+            out.counter("mqtt_connects_total", shard_labels, connection.connects);
+            out.counter("mqtt_disconnects_total", shard_labels, connection.disconnects);
+            if (qos_ > 0) {
+                MqttClient::AckLatency ack = shard.owned_client->ack_latency();
+                out.histogram("mqtt_publish_to_ack_ns", shard_labels, std::move(ack.publish_to_ack_ns));
+                out.histogram("mqtt_capture_to_ack_ns", shard_labels, std::move(ack.capture_to_ack_ns));
+            }
+        }
+        if (shard.client && qos_ > 0) {
+            out.gauge("mqtt_in_flight", shard_labels, shard.client->inflight_stats().in_flight);
+        }
+    }
+    out.counter("blocks_dropped_total", with_label(labels, "reason", "not_connected"),
+                dropped_not_connected_.load(std::memory_order_relaxed));
+    out.counter("blocks_dropped_total", with_label(labels, "reason", "window_full"),
+                dropped_window_full_.load(std::memory_order_relaxed));
+    out.counter("mqtt_publish_errors_total", labels, publish_errors_.load(std::memory_order_relaxed));
+    out.histogram("mqtt_publish_call_ns", labels, publish_latency_ns_.snapshot());
+    out.histogram("mqtt_capture_to_publish_ns", labels, capture_to_publish_ns_.snapshot());
+    if (native_transport_) {
+        out.counter("mqtt_zerocopy_sends_total", labels, zc_sends_.load(std::memory_order_relaxed));
+        out.gauge("mqtt_zerocopy_held_blocks", labels, zc_held_.load(std::memory_order_relaxed));
+    }
+}
+
+std::string MqttSinkStage::stalled_work(uint64_t now_ns, uint64_t timeout_ns) {
+    if (native_transport_ || qos_ == 0) {
+        return {}; // QoS 0 has no acks to wait for
+    }
+    std::ostringstream out;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        MqttClient::InflightStats stats = shards_[i]->client->inflight_stats();
+        if (stats.in_flight > 0 && now_ns > stats.progress_ns + timeout_ns) {
+            out << (out.tellp() > 0 ? "; " : "") << stats.in_flight << " publishes without ack for "
+                << (now_ns - stats.progress_ns) / 1000000 << " ms";
+            if (shards_.size() > 1) {
+                out << " on shard #" << i;
+            }
+        }
+    }
+    return out.str();
+}
+
+std::string MqttSinkStage::stats_detail() {
+    uint64_t now_ns = monotonic_now_ns();
+    double elapsed_s = (now_ns - reported_time_ns_) / 1e9;
+    reported_time_ns_ = now_ns;
+    uint64_t count = publish_count_.load(std::memory_order_relaxed);
+    uint64_t total_ns = publish_ns_.load(std::memory_order_relaxed);
+    uint64_t max_ns = publish_max_ns_.exchange(0, std::memory_order_relaxed);
+    uint64_t interval_count = count - reported_publish_count_;
+    double avg_us = interval_count ? (total_ns - reported_publish_ns_) / 1e3 / interval_count : 0.0;
+    reported_publish_count_ = count;
+    reported_publish_ns_ = total_ns;
+
+    std::ostringstream out;
+    out << "publish " << avg_us << " us avg / " << max_ns / 1e3 << " us max over " << interval_count << " blocks";
+    if (native_transport_ && zc_sends_.load(std::memory_order_relaxed) > 0) {
+        uint64_t done = zc_completions_.load(std::memory_order_relaxed);
+        uint64_t done_ns = zc_completion_ns_.load(std::memory_order_relaxed);
+        uint64_t done_max_ns = zc_completion_max_ns_.exchange(0, std::memory_order_relaxed);
+        uint64_t interval_done = done - reported_zc_completions_;
+        double done_avg_us = interval_done ? (done_ns - reported_zc_completion_ns_) / 1e3 / interval_done : 0.0;
+        reported_zc_completions_ = done;
+        reported_zc_completion_ns_ = done_ns;
+        out << "; zerocopy sends " << zc_sends_.load(std::memory_order_relaxed)
+            << " (kernel copied " << zc_copied_.load(std::memory_order_relaxed)
+            << ", ENOBUFS fallbacks " << zc_fallbacks_.load(std::memory_order_relaxed)
+            << "), completion " << done_avg_us << " us avg / " << done_max_ns / 1e3
+            << " us max, held " << zc_held_.load(std::memory_order_relaxed) << " blocks";
+    }
+    if (!native_transport_ && qos_ > 0) {
+        MqttClient::InflightStats total;
+        for (const auto& shard : shards_) {
+            MqttClient::InflightStats stats = shard->client->inflight_stats();
+            total.in_flight += stats.in_flight;
+            total.high_water = std::max(total.high_water, stats.high_water);
+            total.acked += stats.acked;
+            total.window_full += stats.window_full;
+            total.wait_ns += stats.wait_ns;
+        }
+        out << "; in flight " << total.in_flight << " (high water " << total.high_water << "), acked "
+            << total.acked << ", window-full drops " << total.window_full << ", waited "
+            << total.wait_ns / 1000000 << " ms total";
+    }
+    if (shards_.size() > 1 && elapsed_s > 0.0) {
+        out << "; shards";
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            Shard& shard = *shards_[i];
+            uint64_t blocks = shard.blocks.load(std::memory_order_relaxed);
+            uint64_t bytes = shard.bytes.load(std::memory_order_relaxed);
+            out << " #" << i << " " << (bytes - shard.reported_bytes) / elapsed_s / 1e6 << " MB/s ("
+                << (blocks - shard.reported_blocks) / elapsed_s << " blocks/s)";
+            shard.reported_blocks = blocks;
+            shard.reported_bytes = bytes;
+        }
+    }
+    return out.str();
+}
+
+void MqttSinkStage::sync_network_watch(EventLoop& loop) {
+#ifdef __linux__
+    int fd = client_.network_socket();
+    uint32_t events = EPOLLIN | (client_.network_wants_write() ? EPOLLOUT : 0u);
+    if (fd == watched_fd_) {
+        if (fd >= 0 && events != watched_events_ && loop.modify(fd, events)) {
+            watched_events_ = events;
+        }
+        return;
+    }
+    if (watched_fd_ >= 0) {
+        loop.remove(watched_fd_);
+        watched_fd_ = -1;
+    }
+    if (fd >= 0 && loop.add(fd, events, [this, &loop](uint32_t ready) {
+            int rc = MOSQ_ERR_SUCCESS;
+            if (ready & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                rc = client_.network_read();
+            }
+            if (rc == MOSQ_ERR_SUCCESS && (ready & EPOLLOUT)) {
+                rc = client_.network_write();
+            }
+            if (rc != MOSQ_ERR_SUCCESS) {
+                // The socket was closed (and its number may be reused); re-register on the next sync.
+                loop.remove(watched_fd_);
+                watched_fd_ = -1;
+            }
+        })) {
+        watched_fd_ = fd;
+        watched_events_ = events;
+    }
+#else
+    (void)loop;
+#endif
+}
+
+void MqttSinkStage::run_event_loop(BlockQueue& input, const std::atomic<bool>& running, const BlockHandler& handle) {
+    std::vector<SampleBlock> batch;
+    auto drain_batch = [&] {
+        batch.clear();
+        input.try_pop_batch(batch, batch_max_items_, batch_max_bytes_);
+        for (SampleBlock& block : batch) {
+            handle(std::move(block));
+        }
+    };
+
+    EventLoop loop;
+    int queue_fd = input.event_fd();
+    bool use_epoll = false;
+#ifdef __linux__
+    use_epoll = loop.is_valid() && queue_fd >= 0 && loop.add(queue_fd, EPOLLIN, [&](uint32_t) { drain_batch(); });
+#endif
+    // The queue eventfd stays readable while blocks remain, so a partial batch re-triggers.
+    auto last_misc = std::chrono::steady_clock::time_point{};
+    while (use_epoll && running.load()) {
+        int timeout_ms = 1000;
+        if (native_transport_) {
+            service_native();
+            for (auto& shard : shards_) {
+                sync_zerocopy_watch(loop, *shard);
+            }
+        }
+        if (drive_network_) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_misc >= std::chrono::seconds(1)) {
+                client_.network_misc();
+                last_misc = now;
+            }
+            // Publishes write straight to the socket; only a partial write needs EPOLLOUT.
+            sync_network_watch(loop);
+            if (watched_fd_ < 0) {
+                timeout_ms = 100; // Waiting for the (re)connect to create a socket
+                last_misc = std::chrono::steady_clock::time_point{};
+            }
+        }
+        if (loop.run_once(timeout_ms) < 0) {
+            use_epoll = false;
+        }
+    }
+    if (watched_fd_ >= 0) {
+        loop.remove(watched_fd_);
+        watched_fd_ = -1;
+    }
+    for (auto& shard : shards_) {
+        if (shard->zc_watched_fd >= 0) {
+            loop.remove(shard->zc_watched_fd);
+            shard->zc_watched_fd = -1;
+        }
+    }
+    if (!running.load()) {
+        return;
+    }
+    LOG_WARN("MQTT sink '", name(), "': epoll unavailable, using blocking queue waits.");
+    while (running.load()) {
+        batch.clear();
+        if (native_transport_) {
+            service_native();
+        }
+        if (drive_network_) {
+            // Without epoll the socket is polled between short queue waits.
+            client_.network_misc();
+            client_.network_read();
+            if (client_.network_wants_write()) client_.network_write();
+            input.wait_for_pop_batch(batch, batch_max_items_, batch_max_bytes_, std::chrono::milliseconds(10));
+        } else if (native_transport_) {
+            input.wait_for_pop_batch(batch, batch_max_items_, batch_max_bytes_, std::chrono::seconds(1));
+        } else {
+            input.wait_pop_batch(batch, batch_max_items_, batch_max_bytes_);
+        }
+        for (SampleBlock& block : batch) {
+            handle(std::move(block));
+        }
+    }
+}
+
+void MqttSinkStage::process(SampleBlock&& block) {
+    uint64_t start_ns = monotonic_now_ns();
+    Shard& shard = select_shard(block);
+    const size_t bytes = block.data.size();
+    const uint64_t capture_time_ns = block.capture_time_ns;
+    bool published;
+    if (native_transport_) {
+        service_native();
+        published = publish_native(shard, std::move(block));
+    } else {
+        published = publish_mosquitto(shard, block);
+    }
+    if (published) {
+        uint64_t end_ns = monotonic_now_ns();
+        uint64_t elapsed_ns = end_ns - start_ns;
+        if (capture_time_ns != 0 && end_ns >= capture_time_ns) {
+            capture_to_publish_ns_.record(end_ns - capture_time_ns);
+        }
+        publish_count_.fetch_add(1, std::memory_order_relaxed);
+        publish_ns_.fetch_add(elapsed_ns, std::memory_order_relaxed);
+        store_max(publish_max_ns_, elapsed_ns);
+        publish_latency_ns_.record(elapsed_ns);
+        shard.blocks.fetch_add(1, std::memory_order_relaxed);
+        shard.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+bool MqttSinkStage::publish_native(Shard& shard, SampleBlock&& block) {
+    NativeMqttPublisher& native = *shard.native;
+    if (!native.is_connected()) {
+        LOG_DEBUG("Native MQTT not connected in sink '", name(), "', discarding data chunk.");
+        dropped_not_connected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    unsigned char header[kBlockHeaderSize];
+    iovec parts[2];
+    size_t part_count = 0;
+    if (block_header_) {
+        encode_block_header(block, header);
+        parts[part_count++] = {header, sizeof(header)};
+    }
+    parts[part_count++] = {block.data.data(), block.data.size()};
+    uint64_t ticket = 0;
+    uint64_t sent_ns = monotonic_now_ns();
+    const bool sent = native.publish(native_topic_, parts, part_count, false, &ticket);
+    if (!sent) {
+        publish_errors_.fetch_add(1, std::memory_order_relaxed);
+        LOG_ERROR_EVERY_MS(1000, "Native MQTT publish error in sink '", name(), "'; reconnecting.");
+    }
+    if (ticket != 0) {
+        // The kernel still reads block.data; keep the block alive until it says otherwise.
+        shard.zc_pending.push_back(PendingZeroCopy{ticket, sent_ns, std::move(block)});
+    }
+    if (!shard.zc_pending.empty() || ticket != 0) {
+        release_zerocopy_blocks(shard);
+    }
+    return sent;
+}
+
+bool MqttSinkStage::publish_mosquitto(Shard& shard, const SampleBlock& block) {
+    MqttClient& client = *shard.client;
+    if (!client.is_connected()) {
+        LOG_DEBUG("MQTT not connected in sink '", name(), "', discarding data chunk.");
+        dropped_not_connected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    const void* payload = block.data.data();
+    size_t payload_len = block.data.size();
+    if (block_header_) {
+        // libmosquitto needs one contiguous payload, so this path pays one more copy.
+        scratch_.resize(kBlockHeaderSize + block.data.size());
+        encode_block_header(block, scratch_.data());
+        std::copy(block.data.begin(), block.data.end(), scratch_.begin() + kBlockHeaderSize);
+        payload = scratch_.data();
+        payload_len = scratch_.size();
+    }
+    int rc = client.publish_message(
+        topic_,
+        payload,
+        static_cast<int>(payload_len),
+        qos_,
+        false,
+        block.capture_time_ns
+    );
+    if (rc == MqttClient::PUBLISH_WINDOW_FULL) {
+        LOG_DEBUG("MQTT sink '", name(), "': QoS ", qos_, " window full, dropping block.");
+        dropped_window_full_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (rc != MOSQ_ERR_SUCCESS) {
+        publish_errors_.fetch_add(1, std::memory_order_relaxed);
+        LOG_ERROR_EVERY_MS(1000, "MQTT Publish error in sink '", name(), "': ", mosqpp::strerror(rc));
+        if (rc == MOSQ_ERR_NO_CONN || rc == MOSQ_ERR_CONN_LOST) {
+            LOG_WARN_EVERY_MS(1000, "MQTT disconnected, sink '", name(), "' may pause.");
+        }
+        return false;
+    }
+    return true;
+}
+
+} // namespace hackrf_mqtt
@@ -0,0 +1,436 @@
+#include "native_mqtt_publisher.h"
+#include "logger.h"
+#include "socket_tuning.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#endif
+
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define HACKRF_MQTT_HAVE_MSG_ZEROCOPY 1
+#endif
+
+namespace hackrf_mqtt {
+
+namespace {
+
+constexpr unsigned char kPacketConnect = 0x10;
+constexpr unsigned char kPacketConnack = 0x20;
+constexpr unsigned char kPacketPublish = 0x30;
+constexpr unsigned char kPacketPingreq = 0xC0;
+constexpr unsigned char kPacketDisconnect = 0xE0;
+constexpr size_t kMaxRemainingLength = 268435455;
+constexpr size_t kMaxIov = 8;
+
+// MQTT variable byte integer; returns the number of bytes written (1..4).
+size_t encode_remaining_length(size_t value, unsigned char* out) {
+    size_t n = 0;
+    do {
+        unsigned char byte = static_cast<unsigned char>(value % 128);
+        value /= 128;
+        if (value > 0) byte |= 0x80;
+        out[n++] = byte;
+    } while (value > 0 && n < 4);
+    return n;
+}
+
+void append_u16(std::vector<unsigned char>& out, size_t value) {
+    out.push_back(static_cast<unsigned char>((value >> 8) & 0xFF));
+    out.push_back(static_cast<unsigned char>(value & 0xFF));
+}
+
+void append_string(std::vector<unsigned char>& out, const std::string& value) {
+    append_u16(out, value.size());
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+bool wait_for(int fd, short events, int timeout_ms) {
+    pollfd pfd{fd, events, 0};
+    int rc;
+    do {
+        rc = poll(&pfd, 1, timeout_ms);
+    } while (rc < 0 && errno == EINTR);
+    return rc > 0 && (pfd.revents & events);
+}
+
+bool read_exact(int fd, unsigned char* out, size_t len, int timeout_ms) {
+    size_t got = 0;
+    while (got < len) {
+        if (!wait_for(fd, POLLIN, timeout_ms)) return false;
+        ssize_t n = recv(fd, out + got, len - got, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+NativeMqttPublisher::NativeMqttPublisher(Options options) : options_(std::move(options)) {
+}
+
+NativeMqttPublisher::~NativeMqttPublisher() {
+    disconnect();
+}
+
+bool NativeMqttPublisher::open_socket() {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* results = nullptr;
+    std::string port = std::to_string(options_.port);
+    int gai = getaddrinfo(options_.host.c_str(), port.c_str(), &hints, &results);
+    if (gai != 0) {
+        LOG_ERROR("Native MQTT: Cannot resolve ", options_.host, ": ", gai_strerror(gai));
+        return false;
+    }
+    for (addrinfo* ai = results; ai && fd_ < 0; ai = ai->ai_next) {
+        int fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        // Non-blocking connect so the timeout applies, then back to blocking sends.
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        int rc = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (rc != 0 && errno == EINPROGRESS && wait_for(fd, POLLOUT, options_.connect_timeout_ms)) {
+            int err = 0;
+            socklen_t err_len = sizeof(err);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+            rc = err == 0 ? 0 : -1;
+        }
+        if (rc != 0) {
+            ::close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, flags);
+        timeval send_timeout{options_.send_timeout_ms / 1000, (options_.send_timeout_ms % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+        fd_ = fd;
+    }
+    freeaddrinfo(results);
+    if (fd_ < 0) {
+        LOG_ERROR("Native MQTT: Cannot connect to ", options_.host, ":", options_.port);
+        return false;
+    }
+    zerocopy_enabled_ = apply_socket_tuning(fd_, options_.socket, "Native MQTT");
+#ifndef HACKRF_MQTT_HAVE_MSG_ZEROCOPY
+    zerocopy_enabled_ = false;
+#endif
+    zc_socket_base_ = zc_issued_;
+    return true;
+}
+
+bool NativeMqttPublisher::connect() {
+    if (fd_ >= 0) {
+        return true;
+    }
+    next_reconnect_ = Clock::now() + std::chrono::milliseconds(options_.reconnect_delay_ms);
+    if (!open_socket()) {
+        return false;
+    }
+
+    const bool v5 = options_.protocol_version == 5;
+    std::vector<unsigned char> body;
+    append_string(body, "MQTT");
+    body.push_back(static_cast<unsigned char>(v5 ? 5 : 4));
+    unsigned char flags = 0x02; // Clean session / clean start
+    if (!options_.username.empty()) flags |= 0x80;
+    if (!options_.username.empty() && !options_.password.empty()) flags |= 0x40;
+    body.push_back(flags);
+    append_u16(body, static_cast<size_t>(options_.keepalive_s));
+    if (v5) body.push_back(0); // No CONNECT properties
+    append_string(body, options_.client_id);
+    if (flags & 0x80) append_string(body, options_.username);
+    if (flags & 0x40) append_string(body, options_.password);
+
+    unsigned char fixed[5];
+    fixed[0] = kPacketConnect;
+    size_t fixed_len = 1 + encode_remaining_length(body.size(), fixed + 1);
+    iovec iov[2] = {{fixed, fixed_len}, {body.data(), body.size()}};
+    if (!send_iov(iov, 2) || !read_connack()) {
+        close_socket();
+        return false;
+    }
+    LOG_INFO("Native MQTT: Connected to ", options_.host, ":", options_.port, " as '", options_.client_id,
+             "' (MQTT ", v5 ? "5" : "3.1.1", ").");
+    connects_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool NativeMqttPublisher::read_connack() {
+    unsigned char type = 0;
+    if (!read_exact(fd_, &type, 1, options_.connect_timeout_ms) || (type & 0xF0) != kPacketConnack) {
+        LOG_ERROR("Native MQTT: No CONNACK from broker.");
+        return false;
+    }
+    size_t remaining = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+        unsigned char byte = 0;
+        if (!read_exact(fd_, &byte, 1, options_.connect_timeout_ms)) return false;
+        remaining |= static_cast<size_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    if (remaining < 2 || remaining > 1024) {
+        LOG_ERROR("Native MQTT: Malformed CONNACK.");
+        return false;
+    }
+    std::vector<unsigned char> body(remaining);
+    if (!read_exact(fd_, body.data(), body.size(), options_.connect_timeout_ms)) return false;
+    // Byte 0: acknowledge flags, byte 1: return code (3.1.1) or reason code (5); 0 = accepted.
+    if (body[1] != 0) {
+        LOG_ERROR("Native MQTT: Broker refused connection (code ", static_cast<int>(body[1]), ").");
+        return false;
+    }
+    return true;
+}
+
+void NativeMqttPublisher::disconnect() {
+    if (fd_ < 0) {
+        return;
+    }
+    // Zero remaining length is valid for both versions (MQTT 5: reason code 0, no properties).
+    unsigned char packet[2] = {kPacketDisconnect, 0};
+    ssize_t sent = send(fd_, packet, sizeof(packet), MSG_NOSIGNAL);
+    (void)sent;
+    close_socket();
+    LOG_INFO("Native MQTT: Disconnected from ", options_.host, ":", options_.port);
+}
+
+void NativeMqttPublisher::abort_connection() {
+    if (fd_ < 0) {
+        return;
+    }
+    close_socket();
+    next_reconnect_ = Clock::now() + std::chrono::milliseconds(options_.reconnect_delay_ms);
+    LOG_WARN("Native MQTT: Connection to ", options_.host, ":", options_.port, " aborted.");
+}
+
+void NativeMqttPublisher::close_socket() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    // No more notifications arrive for a closed socket. The kernel holds its own page
+    // references for anything still queued, and the stream is abandoned anyway, so every
+    // outstanding ticket is released.
+    zc_stats_.completed += zc_issued_ - zc_completed_;
+    zc_completed_ = zc_issued_;
+    zc_out_of_order_.clear();
+    zerocopy_enabled_ = false;
+}
+
+NativeMqttPublisher::Topic NativeMqttPublisher::prepare_topic(const std::string& topic) const {
+    Topic prepared;
+    append_string(prepared.encoded, topic);
+    if (options_.protocol_version == 5) {
+        prepared.encoded.push_back(0); // No PUBLISH properties
+    }
+    return prepared;
+}
+
+bool NativeMqttPublisher::send_iov(iovec* iov, size_t count, int flags) {
+    size_t index = 0;
+    while (index < count) {
+        msghdr msg{};
+        msg.msg_iov = iov + index;
+        msg.msg_iovlen = count - index;
+        ssize_t sent = sendmsg(fd_, &msg, MSG_NOSIGNAL | flags);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Native MQTT: Send failed: ", std::strerror(errno));
+            return false;
+        }
+        // Advance past whatever the kernel accepted; partial writes resume mid-iovec.
+        size_t remaining = static_cast<size_t>(sent);
+        while (index < count && remaining >= iov[index].iov_len) {
+            remaining -= iov[index].iov_len;
+            ++index;
+        }
+        if (index < count) {
+            iov[index].iov_base = static_cast<unsigned char*>(iov[index].iov_base) + remaining;
+            iov[index].iov_len -= remaining;
+        }
+    }
+    last_send_ = Clock::now();
+    return true;
+}
+
+bool NativeMqttPublisher::publish(const Topic& topic, const struct iovec* parts, size_t part_count, bool retain,
+                                  uint64_t* zerocopy_ticket) {
+    if (fd_ < 0) {
+        return false;
+    }
+    if (part_count + 2 > kMaxIov) {
+        LOG_ERROR("Native MQTT: Too many payload parts (", part_count, ").");
+        return false;
+    }
+    size_t remaining = topic.encoded.size();
+    for (size_t i = 0; i < part_count; ++i) {
+        remaining += parts[i].iov_len;
+    }
+    if (remaining > kMaxRemainingLength) {
+        LOG_ERROR("Native MQTT: Payload of ", remaining, " bytes exceeds the MQTT packet limit.");
+        return false;
+    }
+
+    unsigned char fixed[5];
+    fixed[0] = static_cast<unsigned char>(kPacketPublish | (retain ? 0x01 : 0x00));
+    size_t fixed_len = 1 + encode_remaining_length(remaining, fixed + 1);
+
+    iovec iov[kMaxIov];
+    iov[0] = {fixed, fixed_len};
+    iov[1] = {const_cast<unsigned char*>(topic.encoded.data()), topic.encoded.size()};
+    size_t count = 2;
+    for (size_t i = 0; i < part_count; ++i) {
+        if (parts[i].iov_len > 0) iov[count++] = parts[i];
+    }
+
+    if (zerocopy_ticket) *zerocopy_ticket = 0;
+    const bool use_zerocopy = zerocopy_enabled_ && count > 2 &&
+                              iov[count - 1].iov_len >= options_.socket.zerocopy_min_bytes;
+    if (options_.socket.tcp_cork) set_tcp_cork(fd_, true);
+    bool ok;
+    if (use_zerocopy) {
+        // Headers are copied (they live on our stack); only the sample memory is pinned.
+        uint64_t issued_before = zc_issued_;
+        ok = send_iov(iov, count - 1, MSG_MORE) && send_zerocopy(iov[count - 1]);
+        if (ok && zerocopy_ticket && zc_issued_ != issued_before) *zerocopy_ticket = zc_issued_;
+    } else {
+        ok = send_iov(iov, count);
+    }
+    if (!ok) {
+        close_socket();
+        next_reconnect_ = Clock::now() + std::chrono::milliseconds(options_.reconnect_delay_ms);
+        return false;
+    }
+    if (options_.socket.tcp_cork) set_tcp_cork(fd_, false);
+    return true;
+}
+
+bool NativeMqttPublisher::send_zerocopy(iovec part) {
+#ifdef HACKRF_MQTT_HAVE_MSG_ZEROCOPY
+    while (part.iov_len > 0) {
+        msghdr msg{};
+        msg.msg_iov = &part;
+        msg.msg_iovlen = 1;
+        ssize_t sent = sendmsg(fd_, &msg, MSG_NOSIGNAL | MSG_ZEROCOPY);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == ENOBUFS) {
+                // Too many notifications outstanding (optmem limit): send the rest copied.
+                reap_zerocopy_completions();
+                ++zc_stats_.fallbacks;
+                return send_iov(&part, 1);
+            }
+            LOG_ERROR("Native MQTT: Zero-copy send failed: ", std::strerror(errno));
+            return false;
+        }
+        ++zc_issued_;
+        ++zc_stats_.sends;
+        part.iov_base = static_cast<unsigned char*>(part.iov_base) + sent;
+        part.iov_len -= static_cast<size_t>(sent);
+    }
+    last_send_ = Clock::now();
+    return true;
+#else
+    return send_iov(&part, 1);
+#endif
+}
+
+void NativeMqttPublisher::mark_zerocopy_range(uint32_t lo, uint32_t hi, bool copied) {
+    // Widen the kernel's 32-bit per-socket ids relative to the newest id issued.
+    const uint64_t socket_issued = zc_issued_ - zc_socket_base_;
+    if (socket_issued == 0) return;
+    const uint64_t newest = socket_issued - 1;
+    const uint64_t first = zc_socket_base_ + 1 + (newest - static_cast<uint32_t>(static_cast<uint32_t>(newest) - lo));
+    const uint64_t last = zc_socket_base_ + 1 + (newest - static_cast<uint32_t>(static_cast<uint32_t>(newest) - hi));
+    if (last < first || last <= zc_completed_) return;
+
+    const uint64_t count = last - first + 1;
+    zc_stats_.completed += count;
+    if (copied) zc_stats_.copied += count;
+    zc_out_of_order_[first] = last;
+    // Advance the contiguous watermark over every range that now touches it.
+    for (auto it = zc_out_of_order_.begin(); it != zc_out_of_order_.end() && it->first <= zc_completed_ + 1;) {
+        if (it->second > zc_completed_) zc_completed_ = it->second;
+        it = zc_out_of_order_.erase(it);
+    }
+}
+
+void NativeMqttPublisher::reap_zerocopy_completions() {
+#ifdef HACKRF_MQTT_HAVE_MSG_ZEROCOPY
+    while (fd_ >= 0 && zc_completed_ < zc_issued_) {
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return; // EAGAIN: nothing queued
+        }
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            bool is_recverr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                              (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!is_recverr) continue;
+            const sock_extended_err* err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cm));
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            mark_zerocopy_range(err->ee_info, err->ee_data, (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0);
+        }
+    }
+#endif
+}
+
+void NativeMqttPublisher::wait_zerocopy_completions(int timeout_ms) {
+    if (fd_ < 0 || zc_completed_ >= zc_issued_) {
+        return;
+    }
+    // A pending error-queue entry is reported as POLLERR regardless of requested events.
+    pollfd pfd{fd_, 0, 0};
+    if (poll(&pfd, 1, timeout_ms) > 0) {
+        reap_zerocopy_completions();
+    }
+}
+
+void NativeMqttPublisher::service() {
+    auto now = Clock::now();
+    if (fd_ < 0) {
+        if (now >= next_reconnect_) {
+            connect();
+        }
+        return;
+    }
+    reap_zerocopy_completions();
+    // A publish-only QoS 0 session only ever receives PINGRESP; read and discard.
+    unsigned char scratch[256];
+    for (;;) {
+        ssize_t n = recv(fd_, scratch, sizeof(scratch), MSG_DONTWAIT);
+        if (n > 0) continue;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            LOG_WARN("Native MQTT: Connection to broker lost.");
+            close_socket();
+            next_reconnect_ = now + std::chrono::milliseconds(options_.reconnect_delay_ms);
+            return;
+        }
+        break;
+    }
+    if (options_.keepalive_s > 0 && now - last_send_ >= std::chrono::seconds(options_.keepalive_s) / 2) {
+        unsigned char ping[2] = {kPacketPingreq, 0};
+        iovec iov[1] = {{ping, sizeof(ping)}};
+        if (!send_iov(iov, 1)) {
+            close_socket();
+            next_reconnect_ = now + std::chrono::milliseconds(options_.reconnect_delay_ms);
+        }
+    }
+}
+
+} // namespace hackrf_mqtt
@@ -0,0 +1,602 @@
+#include "pipeline.h"
+#include "logger.h"
+#include "thread_util.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace hackrf_mqtt {
+
+// --- StreamHistory / ParallelStage ---
+
+void StreamHistory::advance(const std::vector<unsigned char>& input, size_t keep_bytes) {
+    stream_offset_ += input.size();
+    if (keep_bytes == 0) {
+        tail_.clear();
+        return;
+    }
+    if (input.size() >= keep_bytes) {
+        tail_.assign(input.end() - static_cast<std::ptrdiff_t>(keep_bytes), input.end());
+        return;
+    }
+    tail_.insert(tail_.end(), input.begin(), input.end());
+    if (tail_.size() > keep_bytes) {
+        tail_.erase(tail_.begin(), tail_.end() - static_cast<std::ptrdiff_t>(keep_bytes));
+    }
+}
+
+void ParallelStage::process(SampleBlock&& block) {
+    BlockHistory history = history_.view();
+    size_t keep = history_bytes(block.format);
+    // The tail must be captured before transform() consumes the block.
+    StreamHistory next = history_;
+    next.advance(block.data, keep);
+    out_.clear();
+    transform(history, std::move(block), out_);
+    history_ = std::move(next);
+    for (SampleBlock& result : out_) {
+        emit(std::move(result));
+    }
+}
+
+// --- StageFactory ---
+
+void StageFactory::register_type(const std::string& type, Creator creator) {
+    creators_[type] = std::move(creator);
+}
+
+bool StageFactory::has_type(const std::string& type) const {
+    return creators_.count(type) != 0;
+}
+
+std::unique_ptr<Stage> StageFactory::create(const StageConfig& config) const {
+    auto it = creators_.find(config.type);
+    if (it == creators_.end()) {
+        LOG_ERROR("Pipeline: Unknown stage type '", config.type, "' for stage '", config.name, "'.");
+        return nullptr;
+    }
+    try {
+        std::unique_ptr<Stage> stage = it->second(config);
+        if (!stage) {
+            LOG_ERROR("Pipeline: Failed to create stage '", config.name, "' of type '", config.type, "'.");
+        }
+        return stage;
+    } catch (const std::exception& e) {
+        LOG_ERROR("Pipeline: Invalid parameters for stage '", config.name, "': ", e.what());
+        return nullptr;
+    }
+}
+
+// --- Pipeline ---
+
+QueueOptions queue_options_from_config(const StageConfig& config) {
+    QueueOptions options;
+    options.max_items = config.queue_max_size;
+    options.max_bytes = config.queue_max_bytes;
+    options.policy = string_to_overflow_policy(config.overflow_policy);
+    options.block_timeout = std::chrono::milliseconds(std::max(0, config.block_timeout_ms));
+    options.keep_every_n = std::max<size_t>(1, config.keep_every_n);
+    return options;
+}
+
+PipelineConfig make_default_pipeline_config(const AppConfig& app_config) {
+    PipelineConfig config;
+
+    StageConfig source;
+    source.name = "rx";
+    source.type = "hackrf_source";
+    source.threading = "inline";
+    source.outputs = {"mqtt"};
+    if (app_config.sweep.enabled) {
+        source.type = "hackrf_sweep";
+        source.params = {{"ranges_mhz", app_config.sweep.ranges_mhz},
+                         {"fft_size", app_config.sweep.fft_size},
+                         {"blocks_per_step", app_config.sweep.blocks_per_step}};
+    }
+
+    StageConfig sink;
+    sink.name = "mqtt";
+    sink.type = "mqtt_sink";
+    sink.threading = "dedicated";
+    sink.queue_max_size = app_config.data_queue_max_size;
+    sink.queue_max_bytes = app_config.data_queue_max_bytes;
+    sink.overflow_policy = app_config.data_queue_overflow_policy;
+    sink.block_timeout_ms = app_config.data_queue_block_timeout_ms;
+    sink.keep_every_n = app_config.data_queue_keep_every_n;
+    if (app_config.sweep.enabled) {
+        sink.params = {{"topic", app_config.sweep.topic}};
+    }
+
+    config.stages = {source, sink};
+    return config;
+}
+
+Pipeline::~Pipeline() {
+    stop();
+}
+
+bool Pipeline::build(const PipelineConfig& config, const StageFactory& factory) {
+    if (running_.load()) {
+        LOG_ERROR("Pipeline: Cannot rebuild a running pipeline.");
+        return false;
+    }
+    nodes_.clear();
+
+    std::map<std::string, Node*> by_name;
+    for (const StageConfig& stage_config : config.stages) {
+        if (stage_config.name.empty()) {
+            LOG_ERROR("Pipeline: Stage of type '", stage_config.type, "' has no name.");
+            return false;
+        }
+        if (by_name.count(stage_config.name)) {
+            LOG_ERROR("Pipeline: Duplicate stage name '", stage_config.name, "'.");
+            return false;
+        }
+        if (stage_config.threading != "dedicated" && stage_config.threading != "inline" &&
+            stage_config.threading != "pool") {
+            LOG_ERROR("Pipeline: Stage '", stage_config.name, "' has unknown threading policy '",
+                      stage_config.threading, "' (expected 'dedicated', 'inline' or 'pool').");
+            return false;
+        }
+
+        auto node = std::make_unique<Node>();
+        node->config = stage_config;
+        node->stage = factory.create(stage_config);
+        if (!node->stage) {
+            return false;
+        }
+        node->dedicated = !node->stage->is_source() && stage_config.threading != "inline";
+        if (node->dedicated) {
+            node->input = std::make_unique<BlockQueue>(queue_options_from_config(stage_config));
+        }
+        if (!node->stage->is_source() && stage_config.threading == "pool") {
+            node->parallel = dynamic_cast<ParallelStage*>(node->stage.get());
+            if (!node->parallel) {
+                LOG_ERROR("Pipeline: Stage '", stage_config.name, "' of type '", stage_config.type,
+                          "' cannot run on the DSP pool.");
+                return false;
+            }
+            Node* self = node.get();
+            node->resequencer = std::make_unique<Resequencer<std::vector<SampleBlock>>>(
+                [this, self](std::vector<SampleBlock>&& outputs) { forward_bulk(*self, std::move(outputs)); });
+        }
+        by_name[stage_config.name] = node.get();
+        nodes_.push_back(std::move(node));
+    }
+
+    for (auto& node : nodes_) {
+        for (const std::string& output_name : node->config.outputs) {
+            auto it = by_name.find(output_name);
+            if (it == by_name.end()) {
+                LOG_ERROR("Pipeline: Stage '", node->config.name, "' outputs to unknown stage '", output_name, "'.");
+                return false;
+            }
+            if (it->second->stage->is_source()) {
+                LOG_ERROR("Pipeline: Source stage '", output_name, "' cannot have inputs.");
+                return false;
+            }
+            node->outputs.push_back(it->second);
+            it->second->input_count++;
+        }
+    }
+
+    // An inline stage with several producers could be entered concurrently.
+    for (const auto& node : nodes_) {
+        if (!node->stage->is_source() && !node->dedicated && node->input_count > 1) {
+            LOG_ERROR("Pipeline: Inline stage '", node->config.name,
+                      "' has multiple inputs; use threading 'dedicated' for fan-in.");
+            return false;
+        }
+        if (!node->stage->is_source() && node->input_count == 0) {
+            LOG_WARN("Pipeline: Stage '", node->config.name, "' has no inputs and will never receive data.");
+        }
+    }
+
+    // Kahn's algorithm: every node must be removable for the graph to be acyclic.
+    std::map<const Node*, size_t> indegree;
+    std::queue<Node*> ready;
+    for (const auto& node : nodes_) {
+        indegree[node.get()] = node->input_count;
+        if (node->input_count == 0) ready.push(node.get());
+    }
+    order_.clear();
+    while (!ready.empty()) {
+        Node* node = ready.front();
+        ready.pop();
+        order_.push_back(node);
+        for (Node* out : node->outputs) {
+            if (--indegree[out] == 0) ready.push(out);
+        }
+    }
+    if (order_.size() != nodes_.size()) {
+        LOG_ERROR("Pipeline: Stage graph contains a cycle.");
+        return false;
+    }
+
+    for (auto& node : nodes_) {
+        Node* self = node.get();
+        self->stage->output_ = [this, self](SampleBlock&& block) { forward(*self, std::move(block)); };
+        if (node->parallel && !pool_) {
+            pool_ = std::make_unique<WorkStealingPool>(config.pool.workers, config.pool.cpu_affinity);
+            pool_max_in_flight_ = config.pool.max_in_flight > 0 ? config.pool.max_in_flight
+                                                                 : 2 * pool_->worker_count();
+        }
+    }
+
+    LOG_INFO("Pipeline: Built ", nodes_.size(), " stages.");
+    for (const auto& node : nodes_) {
+        std::string outputs;
+        for (const Node* out : node->outputs) {
+            outputs += (outputs.empty() ? "" : ", ") + out->config.name;
+        }
+        LOG_INFO("Pipeline:   ", node->config.name, " [", node->config.type, ", ",
+                 (node->stage->is_source() ? "source" : node->config.threading), "] -> ",
+                 (outputs.empty() ? "(none)" : outputs));
+        if (node->input) {
+            const QueueOptions& options = node->input->options();
+            LOG_INFO("Pipeline:     input queue: max ",
+                     (options.max_items ? std::to_string(options.max_items) : "unbounded"), " items, max ",
+                     (options.max_bytes ? std::to_string(options.max_bytes) : "unbounded"), " bytes, overflow ",
+                     overflow_policy_name(options.policy));
+        }
+    }
+    return true;
+}
+
+bool Pipeline::start() {
+    if (running_.load()) {
+        return true;
+    }
+    for (auto& node : nodes_) {
+        if (!node->stage->start()) {
+            LOG_ERROR("Pipeline: Stage '", node->config.name, "' failed to start.");
+            for (auto& started : nodes_) {
+                if (started == node) break;
+                started->stage->stop();
+            }
+            return false;
+        }
+    }
+    for (auto& node : nodes_) {
+        if (node->input) node->input->reopen();
+        node->running = true;
+    }
+    running_ = true;
+    if (pool_) {
+        pool_->start();
+    }
+    for (auto& node : nodes_) {
+        if (node->dedicated) {
+            Node* self = node.get();
+            node->thread = std::thread([this, self] { thread_loop(*self); });
+        }
+    }
+    last_stats_ = stats_snapshot();
+    last_stats_time_ns_ = monotonic_now_ns();
+    LOG_INFO("Pipeline: Started.");
+    return true;
+}
+
+void Pipeline::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    // Sources first so nothing new enters while the stage threads wind down.
+    for (auto& node : nodes_) {
+        if (node->stage->is_source()) node->stage->stop();
+    }
+    // Upstream first, so every stage still accepts what the stages before it finish: a
+    // closed queue is drained by its thread (event-loop stages stop at once), and a pool
+    // stage's jobs complete before the stages it feeds are closed.
+    for (Node* node : order_) {
+        if (node->input) {
+            node->running = false;
+            node->input->close();
+        }
+        if (node->thread.joinable()) node->thread.join();
+        if (node->parallel) {
+            std::unique_lock<std::mutex> lock(node->in_flight_mutex);
+            node->in_flight_cv.wait(lock, [node] { return node->in_flight == 0; });
+        }
+        if (node->input && !node->input->empty()) {
+            LOG_WARN("Pipeline: Stage '", node->config.name, "' stopped with ", node->input->size(),
+                     " blocks still queued; they are discarded.");
+        }
+    }
+    if (pool_) {
+        pool_->shutdown();
+    }
+    for (auto& node : nodes_) {
+        if (!node->stage->is_source()) node->stage->stop();
+    }
+    LOG_INFO("Pipeline: Stopped.");
+}
+
+Stage* Pipeline::find_stage(const std::string& name) const {
+    for (const auto& node : nodes_) {
+        if (node->config.name == name) return node->stage.get();
+    }
+    return nullptr;
+}
+
+void Pipeline::deliver(Node& node, SampleBlock&& block) {
+    if (node.dedicated) {
+        size_t bytes = block.data.size();
+        block.enqueue_time_ns = monotonic_now_ns();
+        if (block.capture_time_ns != 0 && block.enqueue_time_ns >= block.capture_time_ns) {
+            node.stats.capture_to_enqueue_ns.record(block.enqueue_time_ns - block.capture_time_ns);
+        }
+        if (!node.input->try_push(std::move(block))) {
+            // Queue is full, block was discarded (counted in the queue's stats).
+            LOG_WARN_EVERY_MS(1000, "Pipeline: Input queue of stage '", node.config.name, "' full, discarding block of ", bytes, " bytes.");
+        }
+    } else {
+        run_process(node, std::move(block));
+    }
+}
+
+void Pipeline::deliver_bulk(Node& node, std::vector<SampleBlock>& blocks) {
+    if (node.dedicated) {
+        size_t offered = blocks.size();
+        uint64_t now_ns = monotonic_now_ns();
+        for (SampleBlock& block : blocks) {
+            block.enqueue_time_ns = now_ns;
+            if (block.capture_time_ns != 0 && now_ns >= block.capture_time_ns) {
+                node.stats.capture_to_enqueue_ns.record(now_ns - block.capture_time_ns);
+            }
+        }
+        size_t pushed = node.input->try_push_bulk(blocks);
+        if (pushed < offered) {
+            LOG_WARN_EVERY_MS(1000, "Pipeline: Input queue of stage '", node.config.name, "' full, discarded ",
+                              offered - pushed, " of ", offered, " blocks.");
+        }
+    } else {
+        for (SampleBlock& block : blocks) {
+            run_process(node, std::move(block));
+        }
+        blocks.clear();
+    }
+}
+
+void Pipeline::run_process(Node& node, SampleBlock&& block) {
+    node.stats.blocks_in.fetch_add(1, std::memory_order_relaxed);
+    node.stats.bytes_in.fetch_add(block.data.size(), std::memory_order_relaxed);
+    uint64_t start_ns = monotonic_now_ns();
+    if (node.dedicated) {
+        record_queue_wait(node, block, start_ns);
+    }
+    node.stats.busy_since_ns.store(start_ns, std::memory_order_relaxed);
+    try {
+        node.stage->process(std::move(block));
+    } catch (const std::exception& e) {
+        LOG_ERROR("Pipeline: Exception in stage '", node.config.name, "': ", e.what());
+    }
+    uint64_t end_ns = monotonic_now_ns();
+    node.stats.busy_since_ns.store(0, std::memory_order_relaxed);
+    node.stats.busy_ns.fetch_add(end_ns - start_ns, std::memory_order_relaxed);
+    node.stage->heartbeat(end_ns);
+}
+
+void Pipeline::record_queue_wait(Node& node, const SampleBlock& block, uint64_t now_ns) {
+    if (block.enqueue_time_ns != 0 && now_ns >= block.enqueue_time_ns) {
+        node.stats.queue_wait_ns.record(now_ns - block.enqueue_time_ns);
+    }
+}
+
+void Pipeline::dispatch_to_pool(Node& node, SampleBlock&& block) {
+    {
+        // Bound the work in flight so a slow stage backs up into its input queue.
+        std::unique_lock<std::mutex> lock(node.in_flight_mutex);
+        node.in_flight_cv.wait(lock, [&] { return node.in_flight < pool_max_in_flight_; });
+        ++node.in_flight;
+    }
+    node.stats.blocks_in.fetch_add(1, std::memory_order_relaxed);
+    node.stats.bytes_in.fetch_add(block.data.size(), std::memory_order_relaxed);
+    record_queue_wait(node, block, monotonic_now_ns());
+
+    std::vector<unsigned char> history = node.history.tail();
+    uint64_t stream_offset = node.history.stream_offset();
+    node.history.advance(block.data, node.parallel->history_bytes(block.format));
+    uint64_t ticket = node.next_ticket++;
+
+    Node* self = &node;
+    pool_->submit([this, self, ticket, stream_offset, history = std::move(history), block = std::move(block)]() mutable {
+        std::vector<SampleBlock> outputs;
+        uint64_t start_ns = monotonic_now_ns();
+        try {
+            BlockHistory view{history.data(), history.size(), stream_offset};
+            self->parallel->transform(view, std::move(block), outputs);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Pipeline: Exception in stage '", self->config.name, "': ", e.what());
+            outputs.clear();
+        }
+        uint64_t end_ns = monotonic_now_ns();
+        self->stats.busy_ns.fetch_add(end_ns - start_ns, std::memory_order_relaxed);
+        self->stage->heartbeat(end_ns);
+        // Always complete the ticket, even when empty, so later results are not held back.
+        self->resequencer->complete(ticket, std::move(outputs));
+        {
+            std::lock_guard<std::mutex> lock(self->in_flight_mutex);
+            --self->in_flight;
+        }
+        self->in_flight_cv.notify_one();
+    });
+}
+
+void Pipeline::forward(Node& node, SampleBlock&& block) {
+    node.stats.blocks_out.fetch_add(1, std::memory_order_relaxed);
+    node.stats.bytes_out.fetch_add(block.data.size(), std::memory_order_relaxed);
+    const size_t count = node.outputs.size();
+    for (size_t i = 0; i < count; ++i) {
+        if (i + 1 == count) {
+            deliver(*node.outputs[i], std::move(block));
+        } else {
+            SampleBlock copy = block;
+            deliver(*node.outputs[i], std::move(copy));
+        }
+    }
+}
+
+void Pipeline::forward_bulk(Node& node, std::vector<SampleBlock>&& blocks) {
+    if (blocks.empty()) {
+        return;
+    }
+    for (const SampleBlock& block : blocks) {
+        node.stats.blocks_out.fetch_add(1, std::memory_order_relaxed);
+        node.stats.bytes_out.fetch_add(block.data.size(), std::memory_order_relaxed);
+    }
+    const size_t count = node.outputs.size();
+    for (size_t i = 0; i < count; ++i) {
+        if (i + 1 == count) {
+            deliver_bulk(*node.outputs[i], blocks);
+        } else {
+            std::vector<SampleBlock> copy = blocks;
+            deliver_bulk(*node.outputs[i], copy);
+        }
+    }
+}
+
+void Pipeline::thread_loop(Node& node) {
+    LOG_INFO("Pipeline: Stage '", node.config.name, "' thread started.");
+    set_current_thread_name(node.config.name);
+    if (node.config.cpu >= 0) {
+        pin_current_thread_to_cpu(node.config.cpu);
+    }
+    if (node.stage->has_event_loop()) {
+        Node* self = &node;
+        node.stage->run_event_loop(*node.input, node.running,
+                                   [this, self](SampleBlock&& block) { run_process(*self, std::move(block)); });
+        LOG_INFO("Pipeline: Stage '", node.config.name, "' thread stopping.");
+        return;
+    }
+    std::vector<SampleBlock> batch;
+    while (true) {
+        // One lock acquisition per batch. After close() in stop(), what is left is still
+        // processed; an empty batch then means the queue is closed and drained.
+        batch.clear();
+        if (node.input->wait_pop_batch(batch, node.config.batch_max_items, node.config.batch_max_bytes) == 0) {
+            break;
+        }
+        for (SampleBlock& block : batch) {
+            if (node.parallel) {
+                dispatch_to_pool(node, std::move(block));
+            } else {
+                run_process(node, std::move(block));
+            }
+        }
+    }
+    LOG_INFO("Pipeline: Stage '", node.config.name, "' thread stopping.");
+}
+
+std::vector<StageStatsSnapshot> Pipeline::stats_snapshot() const {
+    std::vector<StageStatsSnapshot> result;
+    result.reserve(nodes_.size());
+    for (const auto& node : nodes_) {
+        StageStatsSnapshot snap;
+        snap.name = node->config.name;
+        snap.blocks_in = node->stats.blocks_in.load(std::memory_order_relaxed);
+        snap.bytes_in = node->stats.bytes_in.load(std::memory_order_relaxed);
+        snap.blocks_out = node->stats.blocks_out.load(std::memory_order_relaxed);
+        snap.bytes_out = node->stats.bytes_out.load(std::memory_order_relaxed);
+        snap.busy_ns = node->stats.busy_ns.load(std::memory_order_relaxed);
+        if (node->input) {
+            snap.queue = node->input->stats();
+        }
+        snap.detail = node->stage->stats_detail();
+        result.push_back(std::move(snap));
+    }
+    return result;
+}
+
+std::vector<StageStall> Pipeline::find_stalls(uint64_t now_ns, uint64_t timeout_ns) {
+    std::vector<StageStall> stalls;
+    for (auto& node : nodes_) {
+        if (node->stage->is_source()) {
+            continue; // Sources stop when their device does; the device supervisor watches them
+        }
+        uint64_t heartbeat_ns = node->stage->last_heartbeat_ns();
+        uint64_t busy_since_ns = node->stats.busy_since_ns.load(std::memory_order_relaxed);
+        size_t queued = node->input ? node->input->stats().items : 0;
+        std::string detail = node->stage->stalled_work(now_ns, timeout_ns);
+        bool progressed = heartbeat_ns != node->watched_heartbeat_ns;
+        node->watched_heartbeat_ns = heartbeat_ns;
+        if (queued == 0 && busy_since_ns == 0 && detail.empty()) {
+            node->waiting_since_ns = 0; // Idle is not stalled
+            continue;
+        }
+        // The clock starts when work is first seen waiting, not at the last beat, so a
+        // stage that idled for a while is not reported the moment a block arrives.
+        if (progressed || node->waiting_since_ns == 0) {
+            node->waiting_since_ns = busy_since_ns > heartbeat_ns ? std::min(busy_since_ns, now_ns) : now_ns;
+        }
+        uint64_t stalled_ns = now_ns - node->waiting_since_ns;
+        if (stalled_ns < timeout_ns && detail.empty()) {
+            continue; // stalled_work() applies the timeout itself
+        }
+        StageStall stall;
+        stall.name = label_.empty() ? node->config.name : label_ + "/" + node->config.name;
+        stall.stalled_ns = stalled_ns;
+        stall.busy_ns = busy_since_ns != 0 && now_ns > busy_since_ns ? now_ns - busy_since_ns : 0;
+        stall.queued = queued;
+        stall.detail = std::move(detail);
+        stalls.push_back(std::move(stall));
+    }
+    return stalls;
+}
+
+void Pipeline::collect_metrics(MetricsSnapshot& out, const MetricLabels& labels) const {
+    for (const auto& node : nodes_) {
+        MetricLabels stage = with_label(labels, "stage", node->config.name);
+        const StageStats& stats = node->stats;
+        out.counter("stage_blocks_in_total", stage, stats.blocks_in.load(std::memory_order_relaxed));
+        out.counter("stage_bytes_in_total", stage, stats.bytes_in.load(std::memory_order_relaxed));
+        out.counter("stage_blocks_out_total", stage, stats.blocks_out.load(std::memory_order_relaxed));
+        out.counter("stage_bytes_out_total", stage, stats.bytes_out.load(std::memory_order_relaxed));
+        out.counter("stage_busy_seconds_total", stage, stats.busy_ns.load(std::memory_order_relaxed) / 1e9);
+        out.counter("stage_heartbeats_total", stage, node->stage->heartbeats());
+        if (node->input) {
+            QueueStats queue = node->input->stats();
+            out.gauge("queue_items", stage, queue.items);
+            out.gauge("queue_bytes", stage, queue.bytes);
+            out.gauge("queue_high_water_items", stage, queue.high_water_items);
+            out.counter("blocks_dropped_total", with_label(stage, "reason", "queue_full"), queue.dropped_newest);
+            out.counter("blocks_dropped_total", with_label(stage, "reason", "evicted"), queue.dropped_oldest);
+            out.histogram("stage_capture_to_enqueue_ns", stage, stats.capture_to_enqueue_ns.snapshot());
+            out.histogram("stage_queue_wait_ns", stage, stats.queue_wait_ns.snapshot());
+        }
+        node->stage->collect_metrics(out, stage);
+    }
+}
+
+void Pipeline::log_stats() {
+    std::vector<StageStatsSnapshot> current = stats_snapshot();
+    uint64_t now_ns = monotonic_now_ns();
+    double elapsed_s = (now_ns - last_stats_time_ns_) / 1e9;
+    if (elapsed_s <= 0.0 || current.size() != last_stats_.size()) {
+        last_stats_ = std::move(current);
+        last_stats_time_ns_ = now_ns;
+        return;
+    }
+    for (size_t i = 0; i < current.size(); ++i) {
+        const StageStatsSnapshot& cur = current[i];
+        const StageStatsSnapshot& prev = last_stats_[i];
+        const std::string name = label_.empty() ? cur.name : label_ + "/" + cur.name;
+        double in_mb_s = (cur.bytes_in - prev.bytes_in) / elapsed_s / 1e6;
+        double out_mb_s = (cur.bytes_out - prev.bytes_out) / elapsed_s / 1e6;
+        double blocks_s = (cur.blocks_out - prev.blocks_out) / elapsed_s;
+        double busy_pct = (cur.busy_ns - prev.busy_ns) / (elapsed_s * 1e9) * 100.0;
+        LOG_INFO("Stats [", name, "]: in ", in_mb_s, " MB/s, out ", out_mb_s, " MB/s (",
+                 blocks_s, " blocks/s), busy ", busy_pct, "%, queue ", cur.queue.items, " items / ",
+                 cur.queue.bytes / 1024, " KiB (high water ", cur.queue.high_water_items, " / ",
+                 cur.queue.high_water_bytes / 1024, " KiB), dropped new ",
+                 cur.queue.dropped_newest - prev.queue.dropped_newest, ", evicted old ",
+                 cur.queue.dropped_oldest - prev.queue.dropped_oldest);
+        if (!cur.detail.empty()) {
+            LOG_INFO("Stats [", name, "]: ", cur.detail);
+        }
+    }
+    last_stats_ = std::move(current);
+    last_stats_time_ns_ = now_ns;
+}
+
+} // namespace hackrf_mqtt
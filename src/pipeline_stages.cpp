@@ -0,0 +1,447 @@
+#include "pipeline_stages.h"
+#include "logger.h"
+#include "sweep_source.h"
+#include "thread_util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace hackrf_mqtt {
+
+namespace {
+
+// Expands I/Q bytes into complex floats scaled to roughly [-1, 1), appending to `out`.
+bool append_iq_as_complex(const unsigned char* data, size_t size, SampleFormat format,
+                          std::vector<std::complex<float>>& out) {
+    size_t count = size / bytes_per_sample(format);
+    size_t base = out.size();
+    switch (format) {
+        case SampleFormat::INT8_IQ: {
+            const int8_t* src = reinterpret_cast<const int8_t*>(data);
+            out.resize(base + count);
+            for (size_t i = 0; i < count; ++i) {
+                out[base + i] = std::complex<float>(src[2 * i] / 128.0f, src[2 * i + 1] / 128.0f);
+            }
+            return true;
+        }
+        case SampleFormat::INT16_IQ: {
+            out.resize(base + count);
+            for (size_t i = 0; i < count; ++i) {
+                int16_t iq[2];
+                std::memcpy(iq, data + i * sizeof(iq), sizeof(iq));
+                out[base + i] = std::complex<float>(iq[0] / 32768.0f, iq[1] / 32768.0f);
+            }
+            return true;
+        }
+        case SampleFormat::FLOAT32_IQ: {
+            out.resize(base + count);
+            std::memcpy(out.data() + base, data, count * sizeof(std::complex<float>));
+            return true;
+        }
+        case SampleFormat::FLOAT32_POWER_DB:
+        case SampleFormat::SPECTRUM_U8:
+            break;
+    }
+    return false;
+}
+
+bool iq_to_complex(const SampleBlock& block, std::vector<std::complex<float>>& out) {
+    out.clear();
+    return append_iq_as_complex(block.data.data(), block.data.size(), block.format, out);
+}
+
+template <typename T>
+void assign_samples(SampleBlock& block, const T* samples, size_t count, SampleFormat format) {
+    block.data.resize(count * sizeof(T));
+    std::memcpy(block.data.data(), samples, count * sizeof(T));
+    block.format = format;
+}
+
+} // namespace
+
+// --- HackRFSourceStage ---
+
+HackRFSourceStage::HackRFSourceStage(const StageConfig& config)
+    : Stage(config.name), channel_(config.params.value("channel", uint32_t(0))), cpu_(config.cpu) {
+}
+
+bool HackRFSourceStage::start() {
+    accepting_ = true;
+    return true;
+}
+
+void HackRFSourceStage::stop() {
+    accepting_ = false;
+}
+
+void HackRFSourceStage::process(SampleBlock&&) {
+    // Sources have no inputs; blocks enter through rx_callback().
+}
+
+int HackRFSourceStage::rx_callback(hackrf_transfer* transfer) {
+    HackRFSourceStage* self = static_cast<HackRFSourceStage*>(transfer->rx_ctx);
+    if (!self || !self->accepting_.load(std::memory_order_relaxed)) {
+        return -1; // Signal libhackrf to stop streaming
+    }
+    if (self->callback_thread_ != std::this_thread::get_id()) {
+        // libhackrf starts a new transfer thread each time streaming starts.
+        set_current_thread_name(self->name());
+        if (self->cpu_ >= 0) {
+            pin_current_thread_to_cpu(self->cpu_);
+        }
+        self->callback_thread_ = std::this_thread::get_id();
+    }
+    uint64_t now = monotonic_now_ns();
+    self->heartbeat(now);
+    self->samples_.fetch_add(static_cast<uint64_t>(transfer->valid_length / 2), std::memory_order_relaxed);
+    if (transfer->valid_length > 0) {
+        SampleBlock block;
+        block.capture_time_ns = now;
+        block.sequence = self->next_sequence_++;
+        block.channel = self->channel_;
+        block.center_frequency_hz = self->center_frequency_hz_.load(std::memory_order_relaxed);
+        block.format = SampleFormat::INT8_IQ;
+
+        // capture_time_ns is when the transfer completed; its first sample is one transfer earlier.
+        uint32_t rate = self->sample_rate_hz_.load(std::memory_order_relaxed);
+        uint64_t span_ns = rate ? static_cast<uint64_t>(transfer->valid_length / 2) * 1000000000ULL / rate : 0;
+        uint64_t first_sample_ns = block.capture_time_ns - std::min(span_ns, block.capture_time_ns);
+        if (first_sample_ns < self->settle_until_ns_.load(std::memory_order_acquire)) {
+            if (!self->mark_settling_.load(std::memory_order_relaxed)) {
+                self->settle_dropped_.fetch_add(1, std::memory_order_relaxed);
+                return 0;
+            }
+            block.flags |= kBlockFlagSettling;
+            self->settle_marked_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            uint64_t generation = self->change_generation_.load(std::memory_order_acquire);
+            if (generation != self->seen_generation_) {
+                self->seen_generation_ = generation;
+                block.flags |= kBlockFlagDiscontinuity;
+                uint64_t requested = self->change_requested_ns_.load(std::memory_order_relaxed);
+                if (requested != 0 && block.capture_time_ns > requested) {
+                    self->valid_latency_ns_.record(block.capture_time_ns - requested);
+                }
+            }
+        }
+        block.data.assign(transfer->buffer, transfer->buffer + transfer->valid_length);
+        self->emit(std::move(block));
+    }
+    return 0; // Continue streaming
+}
+
+void HackRFSourceStage::set_tuning(uint64_t center_frequency_hz, uint32_t sample_rate_hz) {
+    center_frequency_hz_.store(center_frequency_hz, std::memory_order_relaxed);
+    sample_rate_hz_.store(sample_rate_hz, std::memory_order_relaxed);
+}
+
+void HackRFSourceStage::set_settle_policy(uint64_t settle_ns, bool mark_only) {
+    settle_ns_.store(settle_ns, std::memory_order_relaxed);
+    mark_settling_.store(mark_only, std::memory_order_relaxed);
+}
+
+void HackRFSourceStage::begin_setting_change(uint64_t requested_ns) {
+    change_requested_ns_.store(requested_ns, std::memory_order_relaxed);
+    // Everything captured until end_setting_change() may straddle the change.
+    settle_until_ns_.store(UINT64_MAX, std::memory_order_release);
+}
+
+void HackRFSourceStage::end_setting_change(bool needs_settle) {
+    uint64_t settle = needs_settle ? settle_ns_.load(std::memory_order_relaxed) : 0;
+    changes_.fetch_add(1, std::memory_order_relaxed);
+    change_generation_.fetch_add(1, std::memory_order_release);
+    settle_until_ns_.store(monotonic_now_ns() + settle, std::memory_order_release);
+}
+
+void HackRFSourceStage::cancel_setting_change() {
+    change_requested_ns_.store(0, std::memory_order_relaxed);
+    settle_until_ns_.store(0, std::memory_order_release);
+}
+
+std::string HackRFSourceStage::stats_detail() {
+    uint64_t changes = changes_.load(std::memory_order_relaxed);
+    if (changes == 0) {
+        return {};
+    }
+    HistogramSnapshot latency = valid_latency_ns_.snapshot();
+    std::ostringstream out;
+    out << "setting changes " << changes << ", settling blocks dropped "
+        << settle_dropped_.load(std::memory_order_relaxed) << " / marked "
+        << settle_marked_.load(std::memory_order_relaxed) << ", command to valid samples "
+        << (latency.count ? latency.sum / latency.count / 1000 : 0) << " us avg / "
+        << latency.quantile(0.99) / 1000 << " us p99 / " << latency.max / 1000 << " us max";
+    return out.str();
+}
+
+void HackRFSourceStage::collect_metrics(MetricsSnapshot& out, const MetricLabels& labels) {
+    out.counter("rx_samples_total", labels, samples_.load(std::memory_order_relaxed));
+    out.counter("rx_setting_changes_total", labels, changes_.load(std::memory_order_relaxed));
+    out.counter("blocks_dropped_total", with_label(labels, "reason", "settling"),
+                settle_dropped_.load(std::memory_order_relaxed));
+    out.counter("rx_settling_marked_total", labels, settle_marked_.load(std::memory_order_relaxed));
+    out.histogram("rx_retune_to_valid_ns", labels, valid_latency_ns_.snapshot());
+}
+
+// --- ConvertStage ---
+
+ConvertStage::ConvertStage(const StageConfig& config) : Stage(config.name) {
+    std::string to = config.params.value("to", std::string("float32"));
+    if (to == "int16") {
+        target_ = SampleFormat::INT16_IQ;
+    } else if (to == "float32") {
+        target_ = SampleFormat::FLOAT32_IQ;
+    } else {
+        throw std::invalid_argument("convert: 'to' must be 'int16' or 'float32', got '" + to + "'");
+    }
+}
+
+void ConvertStage::process(SampleBlock&& block) {
+    if (block.format == target_) {
+        emit(std::move(block));
+        return;
+    }
+    if (target_ == SampleFormat::INT16_IQ && block.format == SampleFormat::INT8_IQ) {
+        const int8_t* src = reinterpret_cast<const int8_t*>(block.data.data());
+        std::vector<int16_t> converted(block.data.size());
+        for (size_t i = 0; i < converted.size(); ++i) {
+            converted[i] = static_cast<int16_t>(src[i] * 256);
+        }
+        assign_samples(block, converted.data(), converted.size(), target_);
+        emit(std::move(block));
+        return;
+    }
+    std::vector<std::complex<float>> samples;
+    if (target_ == SampleFormat::FLOAT32_IQ && iq_to_complex(block, samples)) {
+        assign_samples(block, samples.data(), samples.size(), target_);
+        emit(std::move(block));
+        return;
+    }
+    LOG_WARN_EVERY_MS(1000, "convert '", name(), "': Cannot convert ", sample_format_name(block.format),
+                      " to ", sample_format_name(target_), ", dropping block.");
+}
+
+// --- DecimateStage ---
+
+DecimateStage::DecimateStage(const StageConfig& config)
+    : ParallelStage(config.name), factor_(config.params.value("factor", size_t(1))) {
+    if (factor_ == 0) {
+        throw std::invalid_argument("decimate: 'factor' must be >= 1");
+    }
+    size_t taps = config.params.value("taps", 8 * factor_ + 1);
+    if (taps == 0) {
+        throw std::invalid_argument("decimate: 'taps' must be >= 1");
+    }
+    taps_ = (factor_ == 1) ? std::vector<float>{1.0f} : dsp::design_lowpass(taps, 0.5 / static_cast<double>(factor_));
+}
+
+size_t DecimateStage::history_bytes(SampleFormat format) const {
+    return (taps_.size() - 1) * bytes_per_sample(format);
+}
+
+void DecimateStage::transform(const BlockHistory& history, SampleBlock&& block, std::vector<SampleBlock>& out) const {
+    // x = [history samples | block samples]; filter output at every input index that is a multiple of factor_.
+    std::vector<std::complex<float>> x;
+    x.reserve((history.size + block.data.size()) / bytes_per_sample(block.format));
+    if (!append_iq_as_complex(history.data, history.size, block.format, x) ||
+        !append_iq_as_complex(block.data.data(), block.data.size(), block.format, x)) {
+        LOG_WARN_EVERY_MS(1000, "decimate '", name(), "': Unsupported input format ", sample_format_name(block.format), ", dropping block.");
+        return;
+    }
+    const size_t sample_bytes = bytes_per_sample(block.format);
+    const size_t history_samples = history.size / sample_bytes;
+    const size_t block_samples = x.size() - history_samples;
+    const uint64_t first_index = history.stream_offset / sample_bytes;
+    size_t phase = static_cast<size_t>((factor_ - first_index % factor_) % factor_);
+
+    std::vector<std::complex<float>> output;
+    output.reserve(block_samples / factor_ + 1);
+    for (size_t n = phase; n < block_samples; n += factor_) {
+        size_t pos = history_samples + n;
+        size_t count = std::min(taps_.size(), pos + 1); // Fewer taps at stream start
+        std::complex<float> acc(0.0f, 0.0f);
+        for (size_t k = 0; k < count; ++k) {
+            acc += x[pos - k] * taps_[k];
+        }
+        output.push_back(acc);
+    }
+    assign_samples(block, output.data(), output.size(), SampleFormat::FLOAT32_IQ);
+    out.push_back(std::move(block));
+}
+
+// --- FftStage ---
+
+FftStage::FftStage(const StageConfig& config)
+    : ParallelStage(config.name), plan_(config.params.value("size", size_t(1024))) {
+    window_ = dsp::hann_window(plan_.size());
+}
+
+void FftStage::transform(const BlockHistory&, SampleBlock&& block, std::vector<SampleBlock>& out) const {
+    std::vector<std::complex<float>> samples;
+    if (!iq_to_complex(block, samples)) {
+        LOG_WARN_EVERY_MS(1000, "fft '", name(), "': Unsupported input format ", sample_format_name(block.format), ", dropping block.");
+        return;
+    }
+    const size_t size = plan_.size();
+    const size_t frames = samples.size() / size;
+    if (frames == 0) {
+        return;
+    }
+    std::vector<std::complex<float>> frame(size);
+    std::vector<float> frame_db(size);
+    std::vector<float> average(size, 0.0f);
+    for (size_t f = 0; f < frames; ++f) {
+        const std::complex<float>* src = samples.data() + f * size;
+        for (size_t i = 0; i < size; ++i) {
+            frame[i] = src[i] * window_[i];
+        }
+        plan_.forward(frame.data());
+        dsp::power_spectrum_db(frame.data(), size, frame_db.data());
+        for (size_t i = 0; i < size; ++i) {
+            average[i] += frame_db[i];
+        }
+    }
+    for (float& value : average) {
+        value /= static_cast<float>(frames);
+    }
+    assign_samples(block, average.data(), average.size(), SampleFormat::FLOAT32_POWER_DB);
+    out.push_back(std::move(block));
+}
+
+// --- FileSinkStage ---
+
+FileSinkStage::FileSinkStage(const StageConfig& config)
+    : Stage(config.name),
+      path_(config.params.value("path", std::string())),
+      append_(config.params.value("append", false)) {
+    if (path_.empty()) {
+        throw std::invalid_argument("file_sink: 'path' is required");
+    }
+}
+
+bool FileSinkStage::start() {
+    out_.open(path_, std::ios::binary | (append_ ? std::ios::app : std::ios::trunc));
+    if (!out_.is_open()) {
+        LOG_ERROR("file_sink '", name(), "': Cannot open '", path_, "' for writing.");
+        return false;
+    }
+    LOG_INFO("file_sink '", name(), "': Writing to '", path_, "'.");
+    return true;
+}
+
+void FileSinkStage::stop() {
+    if (out_.is_open()) {
+        out_.close();
+    }
+}
+
+void FileSinkStage::process(SampleBlock&& block) {
+    out_.write(reinterpret_cast<const char*>(block.data.data()), static_cast<std::streamsize>(block.data.size()));
+    if (!out_) {
+        LOG_ERROR_EVERY_MS(1000, "file_sink '", name(), "': Write to '", path_, "' failed.");
+        out_.clear();
+    }
+}
+
+// --- ShmSinkStage ---
+
+ShmSinkStage::ShmSinkStage(const StageConfig& config)
+    : Stage(config.name),
+      shm_name_(config.params.value("name", std::string("/hackrf_mqtt_iq"))),
+      size_bytes_(config.params.value("size_bytes", size_t(16 * 1024 * 1024))) {
+    if (size_bytes_ < 2 * sizeof(ShmRecordHeader)) {
+        throw std::invalid_argument("shm_sink: 'size_bytes' too small");
+    }
+}
+
+ShmSinkStage::~ShmSinkStage() {
+    stop();
+}
+
+bool ShmSinkStage::start() {
+    fd_ = shm_open(shm_name_.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd_ < 0) {
+        LOG_ERROR("shm_sink '", name(), "': shm_open('", shm_name_, "') failed: ", std::strerror(errno));
+        return false;
+    }
+    mapping_size_ = sizeof(ShmRingHeader) + size_bytes_;
+    if (ftruncate(fd_, static_cast<off_t>(mapping_size_)) != 0) {
+        LOG_ERROR("shm_sink '", name(), "': ftruncate failed: ", std::strerror(errno));
+        stop();
+        return false;
+    }
+    mapping_ = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapping_ == MAP_FAILED) {
+        mapping_ = nullptr;
+        LOG_ERROR("shm_sink '", name(), "': mmap failed: ", std::strerror(errno));
+        stop();
+        return false;
+    }
+    header_ = new (mapping_) ShmRingHeader;
+    std::memcpy(header_->magic, "HRFSHM1", 8);
+    header_->capacity = size_bytes_;
+    header_->write_pos.store(0, std::memory_order_relaxed);
+    header_->records.store(0, std::memory_order_release);
+    ring_ = static_cast<unsigned char*>(mapping_) + sizeof(ShmRingHeader);
+    LOG_INFO("shm_sink '", name(), "': Ring '", shm_name_, "' of ", size_bytes_, " bytes ready.");
+    return true;
+}
+
+void ShmSinkStage::stop() {
+    if (mapping_) {
+        munmap(mapping_, mapping_size_);
+        mapping_ = nullptr;
+        header_ = nullptr;
+        ring_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+void ShmSinkStage::write_wrapped(uint64_t pos, const void* src, size_t len) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(src);
+    size_t offset = static_cast<size_t>(pos % size_bytes_);
+    size_t first = std::min(len, size_bytes_ - offset);
+    std::memcpy(ring_ + offset, bytes, first);
+    if (first < len) {
+        std::memcpy(ring_, bytes + first, len - first);
+    }
+}
+
+void ShmSinkStage::process(SampleBlock&& block) {
+    if (!header_) {
+        return;
+    }
+    size_t payload_len = std::min(block.data.size(), size_bytes_ - sizeof(ShmRecordHeader));
+    ShmRecordHeader record{};
+    record.length = static_cast<uint32_t>(payload_len);
+    record.format = static_cast<uint8_t>(block.format);
+    record.sequence = block.sequence;
+
+    uint64_t pos = header_->write_pos.load(std::memory_order_relaxed);
+    write_wrapped(pos, &record, sizeof(record));
+    write_wrapped(pos + sizeof(record), block.data.data(), payload_len);
+    header_->records.fetch_add(1, std::memory_order_relaxed);
+    header_->write_pos.store(pos + sizeof(record) + payload_len, std::memory_order_release);
+}
+
+// --- Registration ---
+
+void register_builtin_stages(StageFactory& factory) {
+    factory.register_type("hackrf_source", [](const StageConfig& c) { return std::make_unique<HackRFSourceStage>(c); });
+    factory.register_type("hackrf_sweep", [](const StageConfig& c) { return std::make_unique<HackRFSweepSourceStage>(c); });
+    factory.register_type("convert", [](const StageConfig& c) { return std::make_unique<ConvertStage>(c); });
+    factory.register_type("decimate", [](const StageConfig& c) { return std::make_unique<DecimateStage>(c); });
+    factory.register_type("fft", [](const StageConfig& c) { return std::make_unique<FftStage>(c); });
+    factory.register_type("file_sink", [](const StageConfig& c) { return std::make_unique<FileSinkStage>(c); });
+    factory.register_type("shm_sink", [](const StageConfig& c) { return std::make_unique<ShmSinkStage>(c); });
+}
+
+} // namespace hackrf_mqtt
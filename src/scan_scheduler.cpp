@@ -0,0 +1,108 @@
+#include "scan_scheduler.h"
+#include "logger.h"
+#include "thread_util.h"
+
+#include <algorithm>
+
+namespace hackrf_mqtt {
+
+ScanScheduler::ScanScheduler(std::vector<ScanEntry> entries, HopFn hop)
+    : hop_(std::move(hop)) {
+    for (auto& entry : entries) {
+        if (entry.frequency_hz == 0 || entry.priority == 0) {
+            LOG_WARN("Scan: Skipping entry with zero frequency or priority.");
+            continue;
+        }
+        entry.dwell_ms = std::max<uint32_t>(entry.dwell_ms, 1);
+        entries_.push_back(entry);
+        total_weight_ += entry.priority;
+    }
+    current_weight_.assign(entries_.size(), 0);
+}
+
+ScanScheduler::~ScanScheduler() {
+    stop();
+}
+
+bool ScanScheduler::start() {
+    if (entries_.empty()) {
+        LOG_ERROR("Scan: No valid entries; scan not started.");
+        return false;
+    }
+    if (thread_.joinable()) {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = false;
+    }
+    thread_ = std::thread([this] { run(); });
+    LOG_INFO("Scan: Started over ", entries_.size(), " frequencies.");
+    return true;
+}
+
+void ScanScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+        LOG_INFO("Scan: Stopped after ", hops_.load(), " hops.");
+    }
+}
+
+ScanScheduler::Stats ScanScheduler::stats() const {
+    Stats stats;
+    stats.hops = hops_.load(std::memory_order_relaxed);
+    stats.late = late_.load(std::memory_order_relaxed);
+    stats.max_late_us = max_late_us_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+size_t ScanScheduler::next_entry() {
+    // Smooth weighted round robin: every entry gains its weight, the largest is chosen
+    // and pays back the total. Over one cycle each entry is chosen `priority` times.
+    size_t best = 0;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        current_weight_[i] += entries_[i].priority;
+        if (current_weight_[i] > current_weight_[best]) {
+            best = i;
+        }
+    }
+    current_weight_[best] -= total_weight_;
+    return best;
+}
+
+void ScanScheduler::run() {
+    set_current_thread_name("scan");
+    Clock::time_point scheduled = Clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        const ScanEntry& entry = entries_[next_entry()];
+
+        Clock::time_point now = Clock::now();
+        uint64_t late_us = now > scheduled
+            ? static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - scheduled).count())
+            : 0;
+        if (late_us > 1000) {
+            late_.fetch_add(1, std::memory_order_relaxed);
+            max_late_us_.store(std::max(max_late_us_.load(std::memory_order_relaxed), late_us),
+                               std::memory_order_relaxed);
+        }
+        if (late_us > uint64_t(entry.dwell_ms) * 1000) {
+            scheduled = now; // Fell a whole dwell behind: restart the schedule instead of bursting
+        }
+
+        lock.unlock();
+        hop_(entry.frequency_hz);
+        lock.lock();
+        hops_.fetch_add(1, std::memory_order_relaxed);
+
+        scheduled += std::chrono::milliseconds(entry.dwell_ms);
+        cv_.wait_until(lock, scheduled, [this] { return stopping_; });
+    }
+}
+
+} // namespace hackrf_mqtt
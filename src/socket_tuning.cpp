@@ -0,0 +1,65 @@
+#include "socket_tuning.h"
+#include "logger.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace hackrf_mqtt {
+
+namespace {
+
+bool set_int_option(int fd, int level, int option, int value, const char* option_name, const char* label) {
+    if (setsockopt(fd, level, option, &value, sizeof(value)) != 0) {
+        LOG_WARN(label, ": Cannot set ", option_name, "=", value, ": ", std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool apply_socket_tuning(int fd, const MqttSocketConfig& config, const char* label) {
+    if (fd < 0) {
+        return false;
+    }
+    if (config.sndbuf_bytes > 0 && set_int_option(fd, SOL_SOCKET, SO_SNDBUF, config.sndbuf_bytes, "SO_SNDBUF", label)) {
+        int effective = 0;
+        socklen_t len = sizeof(effective);
+        getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &effective, &len);
+        // Linux doubles the request for bookkeeping and caps it at net.core.wmem_max.
+        LOG_INFO(label, ": SO_SNDBUF requested ", config.sndbuf_bytes, ", effective ", effective, " bytes.");
+    }
+    if (config.tcp_nodelay) {
+        set_int_option(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY", label);
+    }
+    if (config.busy_poll_us > 0) {
+#ifdef SO_BUSY_POLL
+        set_int_option(fd, SOL_SOCKET, SO_BUSY_POLL, config.busy_poll_us, "SO_BUSY_POLL", label);
+#else
+        LOG_WARN(label, ": SO_BUSY_POLL is not available on this platform.");
+#endif
+    }
+    if (config.zerocopy) {
+#ifdef SO_ZEROCOPY
+        return set_int_option(fd, SOL_SOCKET, SO_ZEROCOPY, 1, "SO_ZEROCOPY", label);
+#else
+        LOG_WARN(label, ": MSG_ZEROCOPY is not available in this build; payloads are copied.");
+#endif
+    }
+    return false;
+}
+
+void set_tcp_cork(int fd, bool on) {
+#ifdef TCP_CORK
+    int value = on ? 1 : 0;
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+#else
+    (void)fd; (void)on;
+#endif
+}
+
+} // namespace hackrf_mqtt
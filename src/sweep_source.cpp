@@ -0,0 +1,219 @@
+#include "sweep_source.h"
+#include "logger.h"
+#include "spectrum_message.h"
+#include "thread_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace hackrf_mqtt {
+
+namespace {
+constexpr uint32_t kMaxSweepRanges = 10;   // Firmware limit
+constexpr uint32_t kMaxSweepMhz = 7250;
+}
+
+HackRFSweepSourceStage::HackRFSweepSourceStage(const StageConfig& config)
+    : Stage(config.name),
+      channel_(config.params.value("channel", uint32_t(0))),
+      cpu_(config.cpu),
+      blocks_per_step_(std::max<uint32_t>(1, config.params.value("blocks_per_step", uint32_t(1)))),
+      plan_(config.params.value("fft_size", size_t(256))) {
+    const size_t size = plan_.size();
+    if (!dsp::is_power_of_two(size) || size < 16 || size > 4096) {
+        throw std::invalid_argument("hackrf_sweep: 'fft_size' must be a power of two from 16 to 4096");
+    }
+
+    std::vector<std::array<uint32_t, 2>> ranges =
+        config.params.value("ranges_mhz", std::vector<std::array<uint32_t, 2>>{{2400, 2490}});
+    if (ranges.empty() || ranges.size() > kMaxSweepRanges) {
+        throw std::invalid_argument("hackrf_sweep: 'ranges_mhz' must hold 1 to 10 [start, stop] ranges");
+    }
+    const uint32_t step_mhz = kStepWidthHz / 1000000;
+    uint32_t low_mhz = UINT32_MAX;
+    uint32_t high_mhz = 0;
+    for (const auto& range : ranges) {
+        if (range[0] >= range[1]) {
+            throw std::invalid_argument("hackrf_sweep: range start must be below its stop");
+        }
+        uint32_t steps = 1 + (range[1] - range[0] - 1) / step_mhz;
+        uint32_t stop = range[0] + steps * step_mhz;
+        if (stop > kMaxSweepMhz) {
+            throw std::invalid_argument("hackrf_sweep: range " + std::to_string(range[0]) + "-" +
+                                        std::to_string(range[1]) + " MHz ends above 7250 MHz after widening to " +
+                                        std::to_string(stop) + " MHz");
+        }
+        if (stop != range[1]) {
+            LOG_INFO("hackrf_sweep '", name(), "': Range ", range[0], "-", range[1], " MHz widened to ",
+                     range[0], "-", stop, " MHz (whole 20 MHz steps).");
+        }
+        frequency_list_mhz_.push_back(static_cast<uint16_t>(range[0]));
+        frequency_list_mhz_.push_back(static_cast<uint16_t>(stop));
+        low_mhz = std::min(low_mhz, range[0]);
+        high_mhz = std::max(high_mhz, stop);
+    }
+    start_hz_ = uint64_t(low_mhz) * 1000000;
+    first_step_hz_ = uint64_t(frequency_list_mhz_[0]) * 1000000;
+    // Panorama bins have the FFT's resolution (20 MHz / fft_size).
+    bins_ = static_cast<uint32_t>((uint64_t(high_mhz - low_mhz) * size + step_mhz - 1) / step_mhz);
+
+    window_ = dsp::hann_window(size);
+    frame_.resize(size);
+    power_sum_.assign(bins_, 0.0);
+    power_count_.assign(bins_, 0);
+}
+
+bool HackRFSweepSourceStage::start() {
+    accepting_ = true;
+    return true;
+}
+
+void HackRFSweepSourceStage::stop() {
+    accepting_ = false;
+}
+
+void HackRFSweepSourceStage::process(SampleBlock&&) {
+    // Sources have no inputs; blocks enter through rx_callback().
+}
+
+int HackRFSweepSourceStage::rx_callback(hackrf_transfer* transfer) {
+    HackRFSweepSourceStage* self = static_cast<HackRFSweepSourceStage*>(transfer->rx_ctx);
+    if (!self || !self->accepting_.load(std::memory_order_relaxed)) {
+        return -1; // Signal libhackrf to stop streaming
+    }
+    if (self->callback_thread_ != std::this_thread::get_id()) {
+        set_current_thread_name(self->name());
+        if (self->cpu_ >= 0) {
+            pin_current_thread_to_cpu(self->cpu_);
+        }
+        self->callback_thread_ = std::this_thread::get_id();
+    }
+    self->heartbeat(monotonic_now_ns());
+    if (self->discontinuity_requested_.exchange(false, std::memory_order_acq_rel)) {
+        std::fill(self->power_sum_.begin(), self->power_sum_.end(), 0.0);
+        std::fill(self->power_count_.begin(), self->power_count_.end(), 0);
+        self->sweep_has_data_ = false;
+        self->last_step_hz_ = 0;
+        self->discontinuity_ = true;
+    }
+    for (int offset = 0; offset + int(kBlockBytes) <= transfer->valid_length; offset += kBlockBytes) {
+        const unsigned char* block = transfer->buffer + offset;
+        if (block[0] != 0x7f || block[1] != 0x7f) {
+            self->missing_markers_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        uint64_t frequency_hz = detail::get_le(block + 2, 8);
+        // The first step of a new sweep closes the previous panorama. Steps span several
+        // blocks when blocks_per_step > 1, so only the change of frequency counts.
+        if (frequency_hz == self->first_step_hz_ && self->last_step_hz_ != frequency_hz) {
+            uint64_t now = monotonic_now_ns();
+            if (self->sweep_has_data_) {
+                self->emit_panorama(now);
+            }
+            self->sweep_start_ns_ = now;
+        }
+        self->last_step_hz_ = frequency_hz;
+        self->process_step_block(block, frequency_hz);
+    }
+    return 0; // Continue streaming
+}
+
+void HackRFSweepSourceStage::process_step_block(const unsigned char* block, uint64_t frequency_hz) {
+    const int64_t size = static_cast<int64_t>(plan_.size());
+    if (frequency_hz < start_hz_) {
+        missing_markers_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // Transform the last fft_size samples: the start of a block holds the marker and is
+    // the closest to the retune.
+    const int8_t* samples = reinterpret_cast<const int8_t*>(block + kBlockBytes - 2 * size);
+    for (int64_t i = 0; i < size; ++i) {
+        frame_[i] = std::complex<float>(samples[2 * i] / 128.0f, samples[2 * i + 1] / 128.0f) * window_[i];
+    }
+    plan_.forward(frame_.data());
+
+    // FFT bin k sits at LO + k * (Fs / size) with LO = frequency + 7.5 MHz; its panorama bin
+    // is (frequency - start) / bin_width + 3/8 * size + k. Keep 1/8..3/8 of Fs from the LO.
+    const int64_t base = static_cast<int64_t>((frequency_hz - start_hz_) * uint64_t(size) / kStepWidthHz) + 3 * size / 8;
+    const double coherent_gain = size / 2.0; // Hann window sum: a full-scale tone reads 0 dB
+    const double scale = 1.0 / (coherent_gain * coherent_gain);
+    for (int64_t k = 0; k < size; ++k) {
+        int64_t offset = k < size / 2 ? k : k - size;
+        int64_t magnitude = offset < 0 ? -offset : offset;
+        if (offset < 0 ? (magnitude <= size / 8 || magnitude > 3 * size / 8)
+                       : (magnitude < size / 8 || magnitude >= 3 * size / 8)) {
+            continue;
+        }
+        int64_t bin = base + offset;
+        if (bin < 0 || bin >= int64_t(bins_)) {
+            continue;
+        }
+        power_sum_[bin] += std::norm(frame_[k]) * scale;
+        ++power_count_[bin];
+    }
+    sweep_has_data_ = true;
+    blocks_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HackRFSweepSourceStage::emit_panorama(uint64_t now_ns) {
+    SampleBlock block;
+    block.capture_time_ns = now_ns;
+    block.sequence = next_sequence_++;
+    block.channel = channel_;
+    block.format = SampleFormat::SPECTRUM_U8;
+    if (discontinuity_) {
+        block.flags |= kBlockFlagDiscontinuity;
+        discontinuity_ = false;
+    }
+    const uint64_t bin_width = kStepWidthHz / plan_.size();
+    const uint64_t stop_hz = start_hz_ + uint64_t(bins_) * bin_width;
+    block.center_frequency_hz = (start_hz_ + stop_hz) / 2;
+
+    SpectrumHeaderInfo header;
+    header.start_hz = start_hz_;
+    header.stop_hz = stop_hz;
+    header.bins = bins_;
+    uint64_t duration_us = (now_ns - std::min(sweep_start_ns_, now_ns)) / 1000;
+    header.sweep_duration_us = static_cast<uint32_t>(std::min<uint64_t>(duration_us, UINT32_MAX));
+
+    block.data.resize(kSpectrumHeaderSize + bins_);
+    encode_spectrum_header(header, block.data.data());
+    unsigned char* out = block.data.data() + kSpectrumHeaderSize;
+    for (uint32_t i = 0; i < bins_; ++i) {
+        if (power_count_[i] == 0) {
+            out[i] = 0;
+            continue;
+        }
+        double power = power_sum_[i] / power_count_[i];
+        out[i] = encode_spectrum_db(power > 0.0 ? static_cast<float>(10.0 * std::log10(power)) : kSpectrumDbFloor);
+    }
+    std::fill(power_sum_.begin(), power_sum_.end(), 0.0);
+    std::fill(power_count_.begin(), power_count_.end(), 0);
+    sweep_has_data_ = false;
+
+    sweeps_.fetch_add(1, std::memory_order_relaxed);
+    last_sweep_us_.store(duration_us, std::memory_order_relaxed);
+    emit(std::move(block));
+}
+
+void HackRFSweepSourceStage::collect_metrics(MetricsSnapshot& out, const MetricLabels& labels) {
+    out.counter("sweep_panoramas_total", labels, sweeps_.load(std::memory_order_relaxed));
+    out.counter("sweep_step_blocks_total", labels, blocks_.load(std::memory_order_relaxed));
+    out.counter("blocks_dropped_total", with_label(labels, "reason", "no_marker"),
+                missing_markers_.load(std::memory_order_relaxed));
+    out.gauge("sweep_duration_seconds", labels, last_sweep_us_.load(std::memory_order_relaxed) / 1e6);
+}
+
+std::string HackRFSweepSourceStage::stats_detail() {
+    std::ostringstream out;
+    out << "sweeps " << sweeps_.load(std::memory_order_relaxed) << " (last "
+        << last_sweep_us_.load(std::memory_order_relaxed) / 1000 << " ms), step blocks "
+        << blocks_.load(std::memory_order_relaxed) << ", blocks without marker "
+        << missing_markers_.load(std::memory_order_relaxed) << ", " << bins_ << " bins of "
+        << kStepWidthHz / plan_.size() << " Hz";
+    return out.str();
+}
+
+} // namespace hackrf_mqtt
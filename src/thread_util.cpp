@@ -0,0 +1,36 @@
+#include "thread_util.h"
+#include "logger.h"
+
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
+namespace hackrf_mqtt {
+
+bool pin_current_thread_to_cpu(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        LOG_WARN("Failed to pin thread to CPU ", cpu, ": ", std::strerror(rc));
+        return false;
+    }
+    return true;
+#else
+    (void)cpu;
+    LOG_WARN("CPU pinning is not supported on this platform.");
+    return false;
+#endif
+}
+
+void set_current_thread_name(const std::string& name) {
+#ifdef __linux__
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#else
+    (void)name;
+#endif
+}
+
+} // namespace hackrf_mqtt
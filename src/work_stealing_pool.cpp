@@ -0,0 +1,137 @@
+#include "work_stealing_pool.h"
+#include "logger.h"
+#include "thread_util.h"
+
+#include <algorithm>
+
+namespace hackrf_mqtt {
+
+namespace {
+// Set on worker threads so submit() from inside a task targets the worker's own deque.
+thread_local const WorkStealingPool* tls_pool = nullptr;
+thread_local size_t tls_worker_index = 0;
+}
+
+WorkStealingPool::WorkStealingPool(size_t workers, std::vector<int> cpu_affinity)
+    : cpu_affinity_(std::move(cpu_affinity)) {
+    if (workers == 0) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < workers; ++i) {
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    shutdown();
+}
+
+void WorkStealingPool::start() {
+    if (!threads_.empty()) {
+        return;
+    }
+    stopping_ = false;
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        threads_.emplace_back([this, i] { worker_loop(i); });
+    }
+    LOG_INFO("DSP pool: Started ", queues_.size(), " workers",
+             (cpu_affinity_.empty() ? "." : " with CPU pinning."));
+}
+
+void WorkStealingPool::shutdown() {
+    if (threads_.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        stopping_ = true;
+    }
+    idle_cv_.notify_all();
+    for (auto& thread : threads_) {
+        if (thread.joinable()) thread.join();
+    }
+    threads_.clear();
+    LOG_INFO("DSP pool: Stopped (", steals_.load(), " steals).");
+}
+
+void WorkStealingPool::submit(Task task) {
+    size_t index;
+    if (tls_pool == this) {
+        index = tls_worker_index;
+    } else {
+        index = next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    }
+    {
+        // Counted before the task becomes visible, so a worker that pops it at once can
+        // never take pending_ below zero. Taking the idle mutex means a worker about to
+        // sleep either sees the count or is already waiting when notify_one() runs.
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        pending_.fetch_add(1, std::memory_order_release);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+    idle_cv_.notify_one();
+}
+
+bool WorkStealingPool::try_pop_local(size_t index, Task& task) {
+    WorkerQueue& queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::try_steal(size_t thief, Task& task) {
+    const size_t count = queues_.size();
+    for (size_t offset = 1; offset < count; ++offset) {
+        WorkerQueue& victim = *queues_[(thief + offset) % count];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks.empty()) {
+            continue;
+        }
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        steals_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::worker_loop(size_t index) {
+    tls_pool = this;
+    tls_worker_index = index;
+    set_current_thread_name("dsp-" + std::to_string(index));
+    if (!cpu_affinity_.empty()) {
+        pin_current_thread_to_cpu(cpu_affinity_[index % cpu_affinity_.size()]);
+    }
+
+    Task task;
+    while (true) {
+        if (try_pop_local(index, task) || try_steal(index, task)) {
+            pending_.fetch_sub(1, std::memory_order_acq_rel);
+            try {
+                task();
+            } catch (const std::exception& e) {
+                LOG_ERROR("DSP pool: Exception in worker ", index, ": ", e.what());
+            }
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        if (pending_.load(std::memory_order_acquire) > 0) {
+            continue; // A task exists (or is being pushed) but a try_lock steal missed it; retry.
+        }
+        if (stopping_.load()) {
+            break;
+        }
+        idle_cv_.wait(lock, [this] { return stopping_.load() || pending_.load(std::memory_order_acquire) > 0; });
+    }
+    tls_pool = nullptr;
+}
+
+} // namespace hackrf_mqtt
@@ -0,0 +1,105 @@
+// A failed live setting write must not leave the source stuck in its settle window.
+// Runs without a HackRF: a handler that was never opened fails every write.
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "device_session.h"
+#include "hackrf_handler.h"
+#include "pipeline.h"
+#include "pipeline_stages.h"
+#include "sample_block.h"
+
+using namespace hackrf_mqtt;
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+                         #condition);                                             \
+            ++failures;                                                           \
+        }                                                                         \
+    } while (0)
+
+// Records the flags of every block it receives.
+class CaptureStage : public Stage {
+public:
+    explicit CaptureStage(const StageConfig& config) : Stage(config.name) {}
+    void process(SampleBlock&& block) override { flags.push_back(block.flags); }
+
+    std::vector<uint16_t> flags;
+};
+
+// Feeds one transfer of silence through the source's libhackrf callback.
+void deliver_transfer(HackRFSourceStage& source) {
+    std::vector<uint8_t> buffer(HackRFHandler::kTransferBytes);
+    hackrf_transfer transfer{};
+    transfer.buffer = buffer.data();
+    transfer.buffer_length = static_cast<int>(buffer.size());
+    transfer.valid_length = static_cast<int>(buffer.size());
+    transfer.rx_ctx = &source;
+    HackRFSourceStage::rx_callback(&transfer);
+}
+
+void failed_write_keeps_stream_valid(bool mark_only) {
+    StageFactory factory;
+    register_builtin_stages(factory);
+    factory.register_type("capture", [](const StageConfig& c) { return std::make_unique<CaptureStage>(c); });
+
+    PipelineConfig config;
+    config.stats_interval_s = 0;
+    StageConfig rx;
+    rx.name = "rx";
+    rx.type = "hackrf_source";
+    rx.threading = "inline";
+    rx.outputs = {"capture"};
+    StageConfig capture;
+    capture.name = "capture";
+    capture.type = "capture";
+    capture.threading = "inline";
+    config.stages = {rx, capture};
+
+    Pipeline pipeline;
+    CHECK(pipeline.build(config, factory));
+    CHECK(pipeline.start());
+    auto* source = pipeline.find_stage_of_type<HackRFSourceStage>();
+    auto* sink = pipeline.find_stage_of_type<CaptureStage>();
+    CHECK(source != nullptr && sink != nullptr);
+    if (!source || !sink) return;
+
+    HackRFConfig current;
+    source->set_tuning(current.center_frequency_hz, current.sample_rate_hz);
+    source->set_settle_policy(0, mark_only);
+
+    HackRFHandler handler; // Never opened: every write fails
+    HackRFConfig target = current;
+    target.lna_gain = current.lna_gain == 0 ? 8 : 0;
+    HackRFHandler::ApplyResult result = apply_live_settings(handler, *source, target, current, monotonic_now_ns());
+    CHECK(!result.ok);
+    CHECK(result.applied == 0);
+
+    deliver_transfer(*source);
+    CHECK(sink->flags.size() == 1);
+    if (!sink->flags.empty()) {
+        CHECK((sink->flags.front() & kBlockFlagSettling) == 0);
+    }
+    pipeline.stop();
+}
+
+} // namespace
+
+int main() {
+    failed_write_keeps_stream_valid(false);
+    failed_write_keeps_stream_valid(true);
+    if (failures != 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("live_settings_test: OK\n");
+    return 0;
+}